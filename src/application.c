@@ -1,12 +1,24 @@
 #include "application.h"
 
 extern struct event_loop g_event_loop;
+extern struct window_manager g_window_manager;
+extern int g_connection;
+
+static void application_post_geometry_event(enum event_type type, uint32_t window_id)
+{
+    struct event event = event_create(type, (void *)(intptr_t) window_id);
+    if (SLSGetWindowBounds(g_connection, window_id, &event.payload.frame) == kCGErrorSuccess) {
+        event.payload.type = EVENT_PAYLOAD_FRAME;
+    }
+
+    event_loop_post(&g_event_loop, &event);
+}
 
 static OBSERVER_CALLBACK(application_notification_handler)
 {
     if (CFEqual(notification, kAXCreatedNotification)) {
-        struct event *event = event_create(&g_event_loop, WINDOW_CREATED, (void *) CFRetain(element));
-        event_loop_post(&g_event_loop, event);
+        struct event event = event_create(WINDOW_CREATED, (void *) CFRetain(element));
+        event_loop_post(&g_event_loop, &event);
     } else if (CFEqual(notification, kAXUIElementDestroyedNotification)) {
         uint32_t *window_id_ptr = *(uint32_t **) context;
         if (!window_id_ptr) return;
@@ -14,34 +26,32 @@ static OBSERVER_CALLBACK(application_notification_handler)
         uint32_t window_id = *window_id_ptr;
         while (!__sync_bool_compare_and_swap((uint32_t **) context, window_id_ptr, NULL));
 
-        struct event *event = event_create(&g_event_loop, WINDOW_DESTROYED, (void *)(uintptr_t) window_id);
-        event_loop_post(&g_event_loop, event);
+        struct event event = event_create(WINDOW_DESTROYED, (void *)(uintptr_t) window_id);
+        event_loop_post(&g_event_loop, &event);
     } else if (CFEqual(notification, kAXFocusedWindowChangedNotification)) {
         uint32_t window_id = ax_window_id(element);
         if (!window_id) return;
 
-        struct event *event = event_create(&g_event_loop, WINDOW_FOCUSED, (void *)(intptr_t) window_id);
-        event_loop_post(&g_event_loop, event);
+        struct event event = event_create(WINDOW_FOCUSED, (void *)(intptr_t) window_id);
+        event_loop_post(&g_event_loop, &event);
     } else if (CFEqual(notification, kAXWindowMovedNotification)) {
         uint32_t window_id = ax_window_id(element);
         if (!window_id) return;
 
-        struct event *event = event_create(&g_event_loop, WINDOW_MOVED, (void *)(intptr_t) window_id);
-        event_loop_post(&g_event_loop, event);
+        application_post_geometry_event(WINDOW_MOVED, window_id);
     } else if (CFEqual(notification, kAXWindowResizedNotification)) {
         uint32_t window_id = ax_window_id(element);
         if (!window_id) return;
 
-        struct event *event = event_create(&g_event_loop, WINDOW_RESIZED, (void *)(intptr_t) window_id);
-        event_loop_post(&g_event_loop, event);
+        application_post_geometry_event(WINDOW_RESIZED, window_id);
     } else if (CFEqual(notification, kAXWindowMiniaturizedNotification)) {
         uint32_t window_id = **((uint32_t **) context);
-        struct event *event = event_create(&g_event_loop, WINDOW_MINIMIZED, (void *)(intptr_t) window_id);
-        event_loop_post(&g_event_loop, event);
+        struct event event = event_create(WINDOW_MINIMIZED, (void *)(intptr_t) window_id);
+        event_loop_post(&g_event_loop, &event);
     } else if (CFEqual(notification, kAXWindowDeminiaturizedNotification)) {
         uint32_t window_id = **((uint32_t **) context);
-        struct event *event = event_create(&g_event_loop, WINDOW_DEMINIMIZED, (void *)(intptr_t) window_id);
-        event_loop_post(&g_event_loop, event);
+        struct event event = event_create(WINDOW_DEMINIMIZED, (void *)(intptr_t) window_id);
+        event_loop_post(&g_event_loop, &event);
     }
 }
 
@@ -64,17 +74,28 @@ application_unobserve_notification(struct application *application, int notifica
     application->notification &= ~(1 << notification);
 }
 
+//
+// NOTE(koekeishiya): May be called again after it returned false with ax_retry set, in which case
+// the observer is kept and only the notifications that could not be registered are retried.
+//
+
 bool application_observe(struct application *application)
 {
-    if (AXObserverCreate(application->pid, application_notification_handler, &application->observer_ref) == kAXErrorSuccess) {
-        for (int i = 0; i < array_count(ax_application_notification); ++i) {
-            application_observe_notification(application, i);
+    if (!application->is_observing) {
+        if (AXObserverCreate(application->pid, application_notification_handler, &application->observer_ref) != kAXErrorSuccess) {
+            return false;
         }
 
         application->is_observing = true;
         CFRunLoopAddSource(CFRunLoopGetMain(), AXObserverGetRunLoopSource(application->observer_ref), kCFRunLoopDefaultMode);
     }
 
+    application->ax_retry = false;
+    for (int i = 0; i < array_count(ax_application_notification); ++i) {
+        if (application->notification & (1 << i)) continue;
+        application_observe_notification(application, i);
+    }
+
     return (application->notification & AX_APPLICATION_ALL) == AX_APPLICATION_ALL;
 }
 
@@ -95,7 +116,7 @@ void application_unobserve(struct application *application)
 uint32_t application_main_window(struct application *application)
 {
     CFTypeRef window_ref;
-    bool result = AXUIElementCopyAttributeValue(application->ref, kAXMainWindowAttribute, &window_ref) == kAXErrorSuccess;
+    bool result = ax_copy_attribute_value(application->ref, kAXMainWindowAttribute, &window_ref) == kAXErrorSuccess;
     if (!result) return 0;
 
     uint32_t window_id = ax_window_id(window_ref);
@@ -107,7 +128,7 @@ uint32_t application_main_window(struct application *application)
 uint32_t application_focused_window(struct application *application)
 {
     CFTypeRef window_ref = NULL;
-    AXUIElementCopyAttributeValue(application->ref, kAXFocusedWindowAttribute, &window_ref);
+    ax_copy_attribute_value(application->ref, kAXFocusedWindowAttribute, &window_ref);
     if (!window_ref) return 0;
 
     uint32_t window_id = ax_window_id(window_ref);
@@ -134,11 +155,12 @@ bool application_is_hidden(struct application *application)
 struct window **application_window_list(struct application *application, int *window_count)
 {
     CFTypeRef window_list_ref = NULL;
-    AXUIElementCopyAttributeValue(application->ref, kAXWindowsAttribute, &window_list_ref);
+    ax_copy_attribute_value(application->ref, kAXWindowsAttribute, &window_list_ref);
     if (!window_list_ref) return NULL;
 
     *window_count = CFArrayGetCount(window_list_ref);
-    struct window **window_list = malloc((*window_count) * sizeof(struct window *));
+    struct window **window_list = memory_arena_push(event_loop_scratch(&g_event_loop), struct window *, *window_count);
+    if (!window_list) goto out;
 
     for (int i = 0; i < *window_count; ++i) {
         AXUIElementRef window_ref = CFArrayGetValueAtIndex(window_list_ref, i);
@@ -146,14 +168,16 @@ struct window **application_window_list(struct application *application, int *wi
         window_list[i] = window_id ? window_create(application, CFRetain(window_ref), window_id) : NULL;
     }
 
+out:
     CFRelease(window_list_ref);
     return window_list;
 }
 
 struct application *application_create(struct process *process)
 {
-    struct application *application = malloc(sizeof(struct application));
-    memset(application, 0, sizeof(struct application));
+    struct application *application = memory_slab_alloc(&g_window_manager.application_slab);
+    if (!application) return NULL;
+
     application->ref = AXUIElementCreateApplication(process->pid);
     application->psn = process->psn;
     application->pid = process->pid;
@@ -165,5 +189,5 @@ struct application *application_create(struct process *process)
 void application_destroy(struct application *application)
 {
     CFRelease(application->ref);
-    free(application);
+    memory_slab_free(&g_window_manager.application_slab, application);
 }
@@ -60,10 +60,11 @@ struct application
     ProcessSerialNumber psn;
     uint32_t pid;
     char *name;
+    struct window *window_list;
     AXObserverRef observer_ref;
     uint8_t notification;
     bool is_observing;
-    bool is_hidden;
+    volatile bool is_hidden;
     bool ax_retry;
 };
 
@@ -1,8 +1,70 @@
 #include "border.h"
 
 extern struct window_manager g_window_manager;
+extern struct event_loop g_event_loop;
 extern int g_connection;
 
+static __thread bool g_border_batch;
+static __thread bool g_border_updates_disabled;
+
+//
+// NOTE(koekeishiya): Every SkyLight call made for a border is wrapped in the sls__begin and
+// sls__end probes, with the name of the function as argument, so that the time spent in the
+// window server can be attributed per call.
+//
+
+#define border_sls(fn, ...)                     \
+    do {                                        \
+        probe1(sls__begin, #fn);                \
+        fn(__VA_ARGS__);                        \
+        probe1(sls__end, #fn);                  \
+    } while (0)
+
+//
+// NOTE(koekeishiya): While the event loop is handling a batch we only disable updates once, the
+// first time a border is redrawn, and reenable them when the batch ends. The window server then
+// presents every border that was changed during the batch in a single update.
+//
+// SLSDisableUpdate is counted per connection, not per thread, so updates stay disabled for every
+// border for as long as any thread has them disabled. Event loop workers handle the geometry
+// events of applications that may take a long time to answer AX requests, and a worker that kept
+// updates disabled across such a request would hold back the borders redrawn by everybody else
+// until its batch of up to EVENT_BATCH_MAX events ends. Workers therefore do not batch; they
+// reenable updates at the end of every redraw. The batch state is kept per thread.
+//
+
+EVENT_LOOP_BATCH_CALLBACK(border_batch_begin)
+{
+    g_border_batch = pthread_equal(pthread_self(), g_event_loop.thread);
+}
+
+EVENT_LOOP_BATCH_CALLBACK(border_batch_end)
+{
+    if (g_border_updates_disabled) {
+        border_sls(SLSReenableUpdate, g_connection);
+        g_border_updates_disabled = false;
+    }
+
+    g_border_batch = false;
+}
+
+static void border_disable_update(void)
+{
+    if (!g_border_batch) {
+        border_sls(SLSDisableUpdate, g_connection);
+    } else if (!g_border_updates_disabled) {
+        border_sls(SLSDisableUpdate, g_connection);
+        g_border_updates_disabled = true;
+    }
+}
+
+static void border_reenable_update(void)
+{
+    if (!g_border_batch) {
+        border_sls(SLSReenableUpdate, g_connection);
+    }
+}
+
 static void border_window_ensure_same_space(struct window *window)
 {
     int space_count;
@@ -11,14 +73,12 @@ static void border_window_ensure_same_space(struct window *window)
 
     if (space_count > 1) {
         uint32_t tags[2] = { (1 << 11) };
-        SLSSetWindowTags(g_connection, window->border.id, tags, 32);
+        border_sls(SLSSetWindowTags, g_connection, window->border.id, tags, 32);
     } else {
         uint32_t tags[2] = { (1 << 11) };
-        SLSClearWindowTags(g_connection, window->border.id, tags, 32);
-        SLSMoveWindowsToManagedSpace(g_connection, window->border.id_ref, space_list[0]);
+        border_sls(SLSClearWindowTags, g_connection, window->border.id, tags, 32);
+        border_sls(SLSMoveWindowsToManagedSpace, g_connection, window->border.id_ref, space_list[0]);
     }
-
-    free(space_list);
 }
 
 static CGMutablePathRef border_normal_shape(CGRect frame, float radius)
@@ -47,16 +107,51 @@ static inline float border_radius_clamp(CGRect frame, float radius, int width)
     return radius;
 }
 
+//
+// NOTE(koekeishiya): A border can be redrawn by a worker (window moved or resized) while the event
+// loop thread changes its color, width or level (window focused, config), and a CGContext must not
+// be used from two threads at once. The lock is taken after we have asked for the window frame, so
+// that a window that is slow to answer AX requests never holds it. Geometry events already carry
+// the frame, and pass it to border_window_refresh_frame.
+//
+// The same lock guards the decision whether a border is on screen, which depends on
+// application->is_hidden and window->is_fullscreen. is_hidden is only changed by the event loop
+// thread, which then hides or shows the borders of the application, each with its lock held.
+// is_fullscreen is only changed by the thread that handles the geometry events of the window, with
+// the lock held, through border_window_set_fullscreen. Everything that orders a border in checks
+// both flags with the lock held, so that a worker that read a stale flag can never show a border
+// that the event loop thread has just hidden. is_minimized is only used by the event loop thread,
+// and is checked by the callers.
+//
+
+static inline bool border_window_is_visible(struct window *window)
+{
+    return !window->application->is_hidden && !window->is_fullscreen;
+}
+
 void border_window_refresh(struct window *window)
+{
+    if (!window->border.id) return;
+    border_window_refresh_frame(window, window_ax_frame(window));
+}
+
+void border_window_refresh_frame(struct window *window, CGRect frame)
 {
     if (!window->border.id) return;
     struct border *border = &window->border;
+
+    os_unfair_lock_lock(&border->lock);
+    if (!border_window_is_visible(window)) {
+        os_unfair_lock_unlock(&border->lock);
+        return;
+    }
+
     border_window_ensure_same_space(window);
 
     CFTypeRef region_ref;
     CGRect border_frame;
 
-    CGRect region = window_ax_frame(window);
+    CGRect region = frame;
     region.origin.x -= border->width;
     region.origin.y -= border->width;
     region.size.width  += (2*border->width);
@@ -75,17 +170,18 @@ void border_window_refresh(struct window *window)
     CGMutablePathRef path = border_normal_shape(border_frame, radius);
     CGRect clear_region = { { 0, 0 }, { region.size.width, region.size.height } };
 
-    SLSDisableUpdate(g_connection);
-    SLSOrderWindow(g_connection, border->id, 0, window->id);
-    SLSSetWindowShape(g_connection, border->id, 0.0f, 0.0f, region_ref);
+    border_disable_update();
+    border_sls(SLSOrderWindow, g_connection, border->id, 0, window->id);
+    border_sls(SLSSetWindowShape, g_connection, border->id, 0.0f, 0.0f, region_ref);
     CGContextClearRect(border->context, clear_region);
 
     CGContextAddPath(border->context, path);
     CGContextStrokePath(border->context);
 
     CGContextFlush(border->context);
-    SLSOrderWindow(g_connection, border->id, 1, window->id);
-    SLSReenableUpdate(g_connection);
+    border_sls(SLSOrderWindow, g_connection, border->id, 1, window->id);
+    border_reenable_update();
+    os_unfair_lock_unlock(&border->lock);
 
     CFRelease(region_ref);
     CGPathRelease(path);
@@ -96,9 +192,13 @@ void border_window_activate(struct window *window)
     if (!window->border.id) return;
 
     struct border *border = &window->border;
+    int level = window_level(window) + 1;
+
+    os_unfair_lock_lock(&border->lock);
     border->color = rgba_color_from_hex(g_window_manager.active_window_border_color);
     CGContextSetRGBStrokeColor(border->context, border->color.r, border->color.g, border->color.b, border->color.a);
-    SLSSetWindowLevel(g_connection, window->border.id, window_level(window) + 1);
+    border_sls(SLSSetWindowLevel, g_connection, border->id, level);
+    os_unfair_lock_unlock(&border->lock);
 
     if (window_is_fullscreen(window)) {
         border_window_hide(window);
@@ -112,9 +212,13 @@ void border_window_deactivate(struct window *window)
     if (!window->border.id) return;
 
     struct border *border = &window->border;
+    int level = window_level(window);
+
+    os_unfair_lock_lock(&border->lock);
     border->color = rgba_color_from_hex(g_window_manager.normal_window_border_color);
     CGContextSetRGBStrokeColor(border->context, border->color.r, border->color.g, border->color.b, border->color.a);
-    SLSSetWindowLevel(g_connection, window->border.id, window_level(window));
+    border_sls(SLSSetWindowLevel, g_connection, border->id, level);
+    os_unfair_lock_unlock(&border->lock);
 
     if (window_is_fullscreen(window)) {
         border_window_hide(window);
@@ -126,13 +230,27 @@ void border_window_deactivate(struct window *window)
 void border_window_show(struct window *window)
 {
     if (!window->border.id) return;
-    SLSOrderWindow(g_connection, window->border.id, 1, window->id);
+
+    os_unfair_lock_lock(&window->border.lock);
+    if (border_window_is_visible(window)) border_sls(SLSOrderWindow, g_connection, window->border.id, 1, window->id);
+    os_unfair_lock_unlock(&window->border.lock);
 }
 
 void border_window_hide(struct window *window)
 {
     if (!window->border.id) return;
-    SLSOrderWindow(g_connection, window->border.id, 0, window->id);
+
+    os_unfair_lock_lock(&window->border.lock);
+    border_sls(SLSOrderWindow, g_connection, window->border.id, 0, window->id);
+    os_unfair_lock_unlock(&window->border.lock);
+}
+
+void border_window_set_fullscreen(struct window *window, bool is_fullscreen)
+{
+    os_unfair_lock_lock(&window->border.lock);
+    window->is_fullscreen = is_fullscreen;
+    if (window->border.id) border_sls(SLSOrderWindow, g_connection, window->border.id, border_window_is_visible(window), window->id);
+    os_unfair_lock_unlock(&window->border.lock);
 }
 
 void border_window_create(struct window *window)
@@ -149,11 +267,11 @@ void border_window_create(struct window *window)
     CGSNewRegionWithRect(&frame, &frame_region);
 
     uint32_t tags[2] = { (1 << 3) | (1 << 7) | (1 << 9), 0 };
-    SLSNewWindow(g_connection, 2, 0.0f, 0.0f, frame_region, &border->id);
-    SLSSetWindowResolution(g_connection, border->id, 2.0f);
-    SLSSetWindowTags(g_connection, border->id, tags, 64);
-    SLSSetWindowOpacity(g_connection, border->id, 0);
-    SLSSetWindowLevel(g_connection, border->id, window_level(window));
+    border_sls(SLSNewWindow, g_connection, 2, 0.0f, 0.0f, frame_region, &border->id);
+    border_sls(SLSSetWindowResolution, g_connection, border->id, 2.0f);
+    border_sls(SLSSetWindowTags, g_connection, border->id, tags, 64);
+    border_sls(SLSSetWindowOpacity, g_connection, border->id, 0);
+    border_sls(SLSSetWindowLevel, g_connection, border->id, window_level(window));
     border->context = SLWindowContextCreate(g_connection, border->id, 0);
     CGContextSetLineWidth(border->context, border->width);
     CGContextSetRGBStrokeColor(border->context, border->color.r, border->color.g, border->color.b, border->color.a);
@@ -166,7 +284,7 @@ void border_window_destroy(struct window *window)
     if (window->border.id) {
         CFRelease(window->border.id_ref);
         CGContextRelease(window->border.context);
-        SLSReleaseWindow(g_connection, window->border.id);
+        border_sls(SLSReleaseWindow, g_connection, window->border.id);
         memset(&window->border, 0, sizeof(struct border));
     }
 }
@@ -33,6 +33,7 @@ static const char *border_placement_str[] =
 
 struct border
 {
+    os_unfair_lock lock;
     CGContextRef context;
     uint32_t id;
     CFArrayRef id_ref;
@@ -43,10 +44,14 @@ struct border
 
 struct window;
 
+EVENT_LOOP_BATCH_CALLBACK(border_batch_begin);
+EVENT_LOOP_BATCH_CALLBACK(border_batch_end);
 void border_window_refresh(struct window *window);
+void border_window_refresh_frame(struct window *window, CGRect frame);
 void border_window_activate(struct window *window);
 void border_window_deactivate(struct window *window);
 void border_window_show(struct window *window);
 void border_window_hide(struct window *window);
+void border_window_set_fullscreen(struct window *window, bool is_fullscreen);
 
 #endif
@@ -7,24 +7,86 @@ extern struct window_manager g_window_manager;
 extern bool g_mission_control_active;
 extern void *g_workspace_context;
 
-struct event *event_create(struct event_loop *event_loop, enum event_type type, void *context)
+struct event event_create(enum event_type type, void *context)
 {
-    struct event *event = memory_pool_push(&event_loop->pool, struct event);
-    event->type = type;
-    event->context = context;
-    event->param1 = 0;
-    event->info = 0;
-    return event;
+    return (struct event) { .context = context, .info = 0, .timestamp = 0, .type = type, .param1 = 0, .coalesce_owner = false, .payload = { .type = EVENT_PAYLOAD_NONE } };
 }
 
-struct event *event_create_p1(struct event_loop *event_loop, enum event_type type, void *context, int param1)
+struct event event_create_p1(enum event_type type, void *context, int param1)
 {
-    struct event *event = memory_pool_push(&event_loop->pool, struct event);
-    event->type = type;
-    event->context = context;
-    event->param1 = param1;
-    event->info = 0;
-    return event;
+    return (struct event) { .context = context, .info = 0, .timestamp = 0, .type = type, .param1 = param1, .coalesce_owner = false, .payload = { .type = EVENT_PAYLOAD_NONE } };
+}
+
+uint32_t event_trace_id(struct event *event)
+{
+    switch (event->type) {
+    default: return 0;
+
+    case APPLICATION_LAUNCHED:
+    case APPLICATION_TERMINATED:
+    case APPLICATION_FRONT_SWITCHED: {
+        struct process *process = event->context;
+        return process->pid;
+    } break;
+    case APPLICATION_ACTIVATED:
+    case APPLICATION_DEACTIVATED:
+    case APPLICATION_VISIBLE:
+    case APPLICATION_HIDDEN:
+    case WINDOW_DESTROYED:
+    case WINDOW_FOCUSED:
+    case WINDOW_MOVED:
+    case WINDOW_RESIZED:
+    case WINDOW_MINIMIZED:
+    case WINDOW_DEMINIMIZED: {
+        return (uint32_t)(uintptr_t) event->context;
+    } break;
+    }
+}
+
+//
+// NOTE(koekeishiya): Maps the id returned by event_trace_id back to the pid of the application
+// that the event belongs to, or 0 if it has none. Called from the watchdog thread, while the
+// event is still being handled on another thread.
+//
+
+pid_t event_trace_pid(enum event_type type, uint32_t id)
+{
+    switch (type) {
+    default: return 0;
+
+    case APPLICATION_LAUNCHED:
+    case APPLICATION_TERMINATED:
+    case APPLICATION_FRONT_SWITCHED:
+    case APPLICATION_ACTIVATED:
+    case APPLICATION_DEACTIVATED:
+    case APPLICATION_VISIBLE:
+    case APPLICATION_HIDDEN: {
+        return id;
+    } break;
+    case WINDOW_DESTROYED:
+    case WINDOW_FOCUSED:
+    case WINDOW_MOVED:
+    case WINDOW_RESIZED:
+    case WINDOW_MINIMIZED:
+    case WINDOW_DEMINIMIZED: {
+        return window_manager_find_window_pid(&g_window_manager, id);
+    } break;
+    }
+}
+
+//
+// NOTE(koekeishiya): Windows and applications that have been published in the window manager
+// tables may still be in use by an event loop worker, so they are released with event_loop_retire.
+//
+
+static EVENT_LOOP_RETIRE_CALLBACK(window_retire)
+{
+    window_destroy(object);
+}
+
+static EVENT_LOOP_RETIRE_CALLBACK(application_retire)
+{
+    application_destroy(object);
 }
 
 void event_destroy(struct event_loop *event_loop, struct event *event)
@@ -41,6 +103,30 @@ void event_destroy(struct event_loop *event_loop, struct event *event)
     }
 }
 
+//
+// NOTE(koekeishiya): Launching an application is a resumable task. process->launch_stage records
+// how far it got, and every APPLICATION_LAUNCHED event for the process resumes from there, so a
+// stage that has completed is never repeated. A stage that has to wait either subscribes to the
+// KVO notification that posts the next APPLICATION_LAUNCHED (see workspace.m), or schedules it
+// itself. Applications that are not ready to be observed yet are retried with exponential backoff,
+// keeping the observer and the notifications that were already registered.
+//
+
+static void application_launch_retry(struct process *process)
+{
+    uint32_t delay = PROCESS_LAUNCH_RETRY_MIN_MS << process->launch_attempt;
+    if (delay < PROCESS_LAUNCH_RETRY_MAX_MS) {
+        ++process->launch_attempt;
+    } else {
+        delay = PROCESS_LAUNCH_RETRY_MAX_MS;
+    }
+
+    if (process->retry_timer) event_loop_cancel(&g_event_loop, process->retry_timer);
+
+    struct event event = event_create(APPLICATION_LAUNCHED, process);
+    process->retry_timer = event_loop_post_after(&g_event_loop, &event, delay);
+}
+
 static EVENT_CALLBACK(EVENT_HANDLER_APPLICATION_LAUNCHED)
 {
     struct process *process = context;
@@ -51,49 +137,76 @@ static EVENT_CALLBACK(EVENT_HANDLER_APPLICATION_LAUNCHED)
         return EVENT_FAILURE;
     }
 
-    if (!workspace_application_is_observable(process)) {
-        debug("%s: %s (%d) is not observable, subscribing to activationPolicy changes\n", __FUNCTION__, process->name, process->pid);
-        workspace_application_observe_activation_policy(g_workspace_context, process);
-        return EVENT_FAILURE;
-    }
+    switch (process->launch_stage) {
+    case PROCESS_LAUNCH_OBSERVABLE: {
+        if (!workspace_application_is_observable(process)) {
+            debug("%s: %s (%d) is not observable, subscribing to activationPolicy changes\n", __FUNCTION__, process->name, process->pid);
+            workspace_application_observe_activation_policy(g_workspace_context, process);
+            return EVENT_FAILURE;
+        }
 
-    if (!workspace_application_is_finished_launching(process)) {
-        debug("%s: %s (%d) is not finished launching, subscribing to finishedLaunching changes\n", __FUNCTION__, process->name, process->pid);
-        workspace_application_observe_finished_launching(g_workspace_context, process);
-        return EVENT_FAILURE;
-    }
+        process->launch_stage = PROCESS_LAUNCH_FINISHED_LAUNCHING;
+    } // fallthrough
+    case PROCESS_LAUNCH_FINISHED_LAUNCHING: {
+        if (!workspace_application_is_finished_launching(process)) {
+            debug("%s: %s (%d) is not finished launching, subscribing to finishedLaunching changes\n", __FUNCTION__, process->name, process->pid);
+            workspace_application_observe_finished_launching(g_workspace_context, process);
+            return EVENT_FAILURE;
+        }
 
-    struct application *application = application_create(process);
-    if (!application_observe(application)) {
-        bool ax_retry = application->ax_retry;
-        application_unobserve(application);
-        application_destroy(application);
+        process->launch_stage = PROCESS_LAUNCH_OBSERVE;
+    } // fallthrough
+    case PROCESS_LAUNCH_OBSERVE: {
+        if (!process->launch_application) process->launch_application = application_create(process);
+        struct application *application = process->launch_application;
+        if (!application) {
+            debug("%s: could not allocate application for %s (%d)\n", __FUNCTION__, process->name, process->pid);
+            return EVENT_FAILURE;
+        }
 
-        debug("%s: could not observe notifications for %s (%d) (ax_retry = %d)\n", __FUNCTION__, process->name, process->pid, ax_retry);
+        if (!application_observe(application)) {
+            bool ax_retry = application->ax_retry;
+            debug("%s: could not observe notifications for %s (%d) (ax_retry = %d)\n", __FUNCTION__, process->name, process->pid, ax_retry);
 
-        if (ax_retry) {
-            __block ProcessSerialNumber psn = process->psn;
-            dispatch_after(dispatch_time(DISPATCH_TIME_NOW, 0.1f * NSEC_PER_SEC), dispatch_get_main_queue(), ^{
-                struct process *_process = process_manager_find_process(&g_process_manager, &psn);
-                if (!_process) return;
+            if (ax_retry) {
+                application_launch_retry(process);
+            } else {
+                application_unobserve(application);
+                application_destroy(application);
+                process->launch_application = NULL;
+            }
 
-                struct event *event = event_create(&g_event_loop, APPLICATION_LAUNCHED, _process);
-                event_loop_post(&g_event_loop, event);
-            });
+            return EVENT_FAILURE;
         }
 
-        return EVENT_FAILURE;
-    }
+        if (!window_manager_add_application(&g_window_manager, application)) {
+            debug("%s: could not add application %s (%d)\n", __FUNCTION__, process->name, process->pid);
+            application_unobserve(application);
+            application_destroy(application);
+            process->launch_application = NULL;
+            return EVENT_FAILURE;
+        }
 
+        if (process->retry_timer) {
+            event_loop_cancel(&g_event_loop, process->retry_timer);
+            process->retry_timer = 0;
+        }
 
-    debug("%s: %s (%d)\n", __FUNCTION__, process->name, process->pid);
-    window_manager_add_application(&g_window_manager, application);
-    window_manager_add_application_windows(&g_window_manager, application);
+        process->launch_application = NULL;
+        process->launch_stage = PROCESS_LAUNCH_DONE;
 
-    if (window_manager_find_lost_front_switched_event(&g_window_manager, process->pid)) {
-        struct event *event = event_create(&g_event_loop, APPLICATION_FRONT_SWITCHED, process);
-        event_loop_post(&g_event_loop, event);
-        window_manager_remove_lost_front_switched_event(&g_window_manager, process->pid);
+        debug("%s: %s (%d)\n", __FUNCTION__, process->name, process->pid);
+        window_manager_add_application_windows(&g_window_manager, application);
+
+        if (window_manager_find_lost_front_switched_event(&g_window_manager, process->pid)) {
+            struct event event = event_create(APPLICATION_FRONT_SWITCHED, process);
+            event_loop_post(&g_event_loop, &event);
+            window_manager_remove_lost_front_switched_event(&g_window_manager, process->pid);
+        }
+    } break;
+    case PROCESS_LAUNCH_DONE: {
+        debug("%s: %s (%d) is already observed\n", __FUNCTION__, process->name, process->pid);
+    } break;
     }
 
     return EVENT_SUCCESS;
@@ -102,6 +215,24 @@ static EVENT_CALLBACK(EVENT_HANDLER_APPLICATION_LAUNCHED)
 static EVENT_CALLBACK(EVENT_HANDLER_APPLICATION_TERMINATED)
 {
     struct process *process = context;
+
+    //
+    // NOTE(koekeishiya): The process is destroyed once this event has been handled, so a pending
+    // retry of APPLICATION_LAUNCHED must not be allowed to fire afterwards, and an application
+    // that was still being launched is destroyed here.
+    //
+
+    if (process->retry_timer) {
+        event_loop_cancel(&g_event_loop, process->retry_timer);
+        process->retry_timer = 0;
+    }
+
+    if (process->launch_application) {
+        application_unobserve(process->launch_application);
+        application_destroy(process->launch_application);
+        process->launch_application = NULL;
+    }
+
     struct application *application = window_manager_find_application(&g_window_manager, process->pid);
 
     if (!application) {
@@ -112,23 +243,16 @@ static EVENT_CALLBACK(EVENT_HANDLER_APPLICATION_TERMINATED)
     debug("%s: %s (%d)\n", __FUNCTION__, process->name, process->pid);
     window_manager_remove_application(&g_window_manager, application->pid);
 
-    int window_count = 0;
-    struct window **window_list = window_manager_find_application_windows(&g_window_manager, application, &window_count);
-    if (!window_list) goto end;
-
-    for (int i = 0; i < window_count; ++i) {
-        struct window *window = window_list[i];
-        if (!window) continue;
-
+    struct window *window = application->window_list;
+    while (window) {
+        struct window *next = window->application_next;
         window_manager_remove_window(&g_window_manager, window->id);
-        window_destroy(window);
+        event_loop_retire(&g_event_loop, window_retire, window);
+        window = next;
     }
 
-    free(window_list);
-
-end:
     application_unobserve(application);
-    application_destroy(application);
+    event_loop_retire(&g_event_loop, application_retire, application);
 
     return EVENT_SUCCESS;
 }
@@ -145,11 +269,11 @@ static EVENT_CALLBACK(EVENT_HANDLER_APPLICATION_FRONT_SWITCHED)
         return EVENT_FAILURE;
     }
 
-    struct event *de_event = event_create(&g_event_loop, APPLICATION_DEACTIVATED, (void *)(intptr_t) g_process_manager.front_pid);
-    event_loop_post(&g_event_loop, de_event);
+    struct event de_event = event_create(APPLICATION_DEACTIVATED, (void *)(intptr_t) g_process_manager.front_pid);
+    event_loop_post(&g_event_loop, &de_event);
 
-    struct event *re_event = event_create(&g_event_loop, APPLICATION_ACTIVATED, (void *)(intptr_t) process->pid);
-    event_loop_post(&g_event_loop, re_event);
+    struct event re_event = event_create(APPLICATION_ACTIVATED, (void *)(intptr_t) process->pid);
+    event_loop_post(&g_event_loop, &re_event);
 
     debug("%s: %s (%d)\n", __FUNCTION__, process->name, process->pid);
     g_process_manager.front_pid = process->pid;
@@ -213,23 +337,13 @@ static EVENT_CALLBACK(EVENT_HANDLER_APPLICATION_VISIBLE)
     debug("%s: %s\n", __FUNCTION__, application->name);
     application->is_hidden = false;
 
-    int window_count = 0;
-    struct window **window_list = window_manager_find_application_windows(&g_window_manager, application, &window_count);
-    if (!window_list) return EVENT_SUCCESS;
-
-    for (int i = 0; i < window_count; ++i) {
-        struct window *window = window_list[i];
-        if (!window) continue;
-
+    for (struct window *window = application->window_list; window; window = window->application_next) {
         if ((!window->is_minimized) &&
-            (!window->is_fullscreen) &&
-            (!window->is_minimized) &&
             (!window_is_fullscreen(window))) {
             border_window_show(window);
         }
     }
 
-    free(window_list);
     return EVENT_SUCCESS;
 }
 
@@ -241,17 +355,10 @@ static EVENT_CALLBACK(EVENT_HANDLER_APPLICATION_HIDDEN)
     debug("%s: %s\n", __FUNCTION__, application->name);
     application->is_hidden = true;
 
-    int window_count = 0;
-    struct window **window_list = window_manager_find_application_windows(&g_window_manager, application, &window_count);
-    if (!window_list) return EVENT_SUCCESS;
-
-    for (int i = 0; i < window_count; ++i) {
-        struct window *window = window_list[i];
-        if (!window) continue;
+    for (struct window *window = application->window_list; window; window = window->application_next) {
         border_window_hide(window);
     }
 
-    free(window_list);
     return EVENT_SUCCESS;
 }
 
@@ -270,6 +377,8 @@ static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_CREATED)
     if (!application) return EVENT_FAILURE;
 
     struct window *window = window_create(application, CFRetain(context), window_id);
+    if (!window) return EVENT_FAILURE;
+
     if (window_is_popover(window) || window_is_unknown(window)) {
         debug("%s: ignoring window %s %d\n", __FUNCTION__, window->application->name, window->id);
         window_manager_remove_lost_focused_event(&g_window_manager, window->id);
@@ -285,12 +394,19 @@ static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_CREATED)
         return EVENT_FAILURE;
     }
 
+    if (!window_manager_add_window(&g_window_manager, window)) {
+        debug("%s: could not add %s %d\n", __FUNCTION__, window->application->name, window->id);
+        window_manager_remove_lost_focused_event(&g_window_manager, window->id);
+        window_unobserve(window);
+        window_destroy(window);
+        return EVENT_FAILURE;
+    }
+
     debug("%s: %s %d\n", __FUNCTION__, window->application->name, window->id);
-    window_manager_add_window(&g_window_manager, window);
 
     if (window_manager_find_lost_focused_event(&g_window_manager, window->id)) {
-        struct event *event = event_create(&g_event_loop, WINDOW_FOCUSED, (void *)(intptr_t) window->id);
-        event_loop_post(&g_event_loop, event);
+        struct event event = event_create(WINDOW_FOCUSED, (void *)(intptr_t) window->id);
+        event_loop_post(&g_event_loop, &event);
         window_manager_remove_lost_focused_event(&g_window_manager, window->id);
     }
 
@@ -308,7 +424,7 @@ static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_DESTROYED)
     window_unobserve(window);
 
     window_manager_remove_window(&g_window_manager, window->id);
-    window_destroy(window);
+    event_loop_retire(&g_event_loop, window_retire, window);
 
     return EVENT_SUCCESS;
 }
@@ -353,6 +469,17 @@ static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_FOCUSED)
     return EVENT_SUCCESS;
 }
 
+//
+// NOTE(koekeishiya): The frame of a moved or resized window comes with the event. When it was
+// cleared because newer events were merged into this one, we ask the window server again, which
+// is still a lot cheaper than asking the application for its position and size over AX.
+//
+
+static inline CGRect event_window_frame(struct window *window, struct event_payload *payload)
+{
+    return payload->type == EVENT_PAYLOAD_FRAME ? payload->frame : window_frame(window);
+}
+
 static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_MOVED)
 {
     uint32_t window_id = (uint32_t)(intptr_t) context;
@@ -364,9 +491,14 @@ static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_MOVED)
         return EVENT_FAILURE;
     }
 
+    //
+    // NOTE(koekeishiya): is_hidden is written by the event loop thread, so this is only a fast path;
+    // border_window_refresh_frame checks it again with the border lock held (see border.c).
+    //
+
     if (window->application->is_hidden) return EVENT_SUCCESS;
 
-    if (!window->is_fullscreen) border_window_refresh(window);
+    if (!window->is_fullscreen) border_window_refresh_frame(window, event_window_frame(window, payload));
 
     debug("%s: %s %d\n", __FUNCTION__, window->application->name, window->id);
 
@@ -390,28 +522,26 @@ static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_RESIZED)
 
     bool is_fullscreen = window_is_fullscreen(window);
 
-    if (!window->is_fullscreen && is_fullscreen) {
-        border_window_hide(window);
-    } else if (window->is_fullscreen && !is_fullscreen) {
+    if (window->is_fullscreen && !is_fullscreen) {
         uint32_t did = window_display_id(window);
 
-        while (display_manager_display_is_animating(did)) {
+        if (display_manager_display_is_animating(did)) {
 
             //
-            // NOTE(koekeishiya): Window has exited native-fullscreen mode.
-            // We need to spin lock until the display is finished animating
-            // because we are not actually able to interact with the window.
+            // NOTE(koekeishiya): Window has exited native-fullscreen mode. We are not able to
+            // interact with the window until the display is finished animating, so we check
+            // again in a little while. window->is_fullscreen is left as is, so that the check
+            // takes this path again; other events are handled in the meantime.
             //
 
-            usleep(100000);
+            struct event event = event_create(WINDOW_RESIZED, context);
+            event_loop_continue_after(&g_event_loop, &event, 100);
+            return EVENT_SUCCESS;
         }
-
-        border_window_show(window);
     }
 
-    window->is_fullscreen = is_fullscreen;
-
-    if (!window->is_fullscreen) border_window_refresh(window);
+    if (window->is_fullscreen != is_fullscreen) border_window_set_fullscreen(window, is_fullscreen);
+    if (!is_fullscreen) border_window_refresh_frame(window, event_window_frame(window, payload));
 
     return EVENT_SUCCESS;
 }
@@ -450,8 +580,8 @@ static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_DEMINIMIZED)
     border_window_show(window);
 
     if (window_manager_find_lost_focused_event(&g_window_manager, window->id)) {
-        struct event *event = event_create(&g_event_loop, WINDOW_FOCUSED, (void *)(intptr_t) window->id);
-        event_loop_post(&g_event_loop, event);
+        struct event event = event_create(WINDOW_FOCUSED, (void *)(intptr_t) window->id);
+        event_loop_post(&g_event_loop, &event);
         window_manager_remove_lost_focused_event(&g_window_manager, window->id);
     }
 
@@ -493,22 +623,14 @@ static EVENT_CALLBACK(EVENT_HANDLER_MISSION_CONTROL_ENTER)
     debug("%s:\n", __FUNCTION__);
     g_mission_control_active = true;
 
-    for (int window_index = 0; window_index < g_window_manager.window.capacity; ++window_index) {
-        struct bucket *bucket = g_window_manager.window.buckets[window_index];
-        while (bucket) {
-            if (bucket->value) {
-                struct window *window = bucket->value;
-                border_window_hide(window);
-            }
-
-            bucket = bucket->next;
-        }
+    struct window_table_entry *entry;
+    table_foreach(entry, &g_window_manager.window) {
+        struct window *window = entry->value;
+        border_window_hide(window);
     }
 
-    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, 0.1f * NSEC_PER_SEC), dispatch_get_main_queue(), ^{
-        struct event *event = event_create(&g_event_loop, MISSION_CONTROL_CHECK_FOR_EXIT, NULL);
-        event_loop_post(&g_event_loop, event);
-    });
+    struct event event = event_create(MISSION_CONTROL_CHECK_FOR_EXIT, NULL);
+    event_loop_post_after(&g_event_loop, &event, 100);
 
     return EVENT_SUCCESS;
 }
@@ -544,15 +666,11 @@ static EVENT_CALLBACK(EVENT_HANDLER_MISSION_CONTROL_CHECK_FOR_EXIT)
     }
 
     if (found) {
-        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, 0.1f * NSEC_PER_SEC), dispatch_get_main_queue(), ^{
-            struct event *event = event_create(&g_event_loop, MISSION_CONTROL_CHECK_FOR_EXIT, NULL);
-            event_loop_post(&g_event_loop, event);
-        });
+        struct event event = event_create(MISSION_CONTROL_CHECK_FOR_EXIT, NULL);
+        event_loop_post_after(&g_event_loop, &event, 100);
     } else {
-        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, 0.0f), dispatch_get_main_queue(), ^{
-            struct event *event = event_create(&g_event_loop, MISSION_CONTROL_EXIT, NULL);
-            event_loop_post(&g_event_loop, event);
-        });
+        struct event event = event_create(MISSION_CONTROL_EXIT, NULL);
+        event_loop_post(&g_event_loop, &event);
     }
 
     CFRelease(window_list);
@@ -564,20 +682,12 @@ static EVENT_CALLBACK(EVENT_HANDLER_MISSION_CONTROL_EXIT)
     debug("%s:\n", __FUNCTION__);
     g_mission_control_active = false;
 
-    for (int window_index = 0; window_index < g_window_manager.window.capacity; ++window_index) {
-        struct bucket *bucket = g_window_manager.window.buckets[window_index];
-        while (bucket) {
-            if (bucket->value) {
-                struct window *window = bucket->value;
-                if ((!window->application->is_hidden) &&
-                    (!window->is_fullscreen) &&
-                    (!window->is_minimized) &&
-                    (!window_is_fullscreen(window))) {
-                    border_window_show(window);
-                }
-            }
-
-            bucket = bucket->next;
+    struct window_table_entry *entry;
+    table_foreach(entry, &g_window_manager.window) {
+        struct window *window = entry->value;
+        if ((!window->is_minimized) &&
+            (!window_is_fullscreen(window))) {
+            border_window_show(window);
         }
     }
 
@@ -612,3 +722,23 @@ out:
 
     return EVENT_SUCCESS;
 }
+
+static EVENT_CALLBACK(EVENT_HANDLER_DAEMON_MESSAGE_TIMEOUT)
+{
+    message_connection_expire(context);
+    return EVENT_SUCCESS;
+}
+
+static EVENT_CALLBACK(EVENT_HANDLER_DAEMON_STARTED)
+{
+    debug("%s:\n", __FUNCTION__);
+
+    struct window *window = window_manager_focused_window(&g_window_manager);
+    if (!window) return EVENT_FAILURE;
+
+    border_window_activate(window);
+    g_window_manager.focused_window_id = window->id;
+    g_window_manager.focused_window_psn = window->application->psn;
+
+    return EVENT_SUCCESS;
+}
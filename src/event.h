@@ -1,7 +1,9 @@
 #ifndef EVENT_LOOP_EVENT_H
 #define EVENT_LOOP_EVENT_H
 
-#define EVENT_CALLBACK(name) uint32_t name(void *context, int param1)
+struct event_payload;
+
+#define EVENT_CALLBACK(name) uint32_t name(void *context, int param1, struct event_payload *payload)
 typedef EVENT_CALLBACK(event_callback);
 
 static EVENT_CALLBACK(EVENT_HANDLER_APPLICATION_LAUNCHED);
@@ -25,9 +27,13 @@ static EVENT_CALLBACK(EVENT_HANDLER_MISSION_CONTROL_CHECK_FOR_EXIT);
 static EVENT_CALLBACK(EVENT_HANDLER_MISSION_CONTROL_EXIT);
 static EVENT_CALLBACK(EVENT_HANDLER_SYSTEM_WOKE);
 static EVENT_CALLBACK(EVENT_HANDLER_DAEMON_MESSAGE);
+static EVENT_CALLBACK(EVENT_HANDLER_DAEMON_MESSAGE_TIMEOUT);
+static EVENT_CALLBACK(EVENT_HANDLER_DAEMON_STARTED);
 
 #define EVENT_QUEUED    0x0
 #define EVENT_PROCESSED 0x1
+#define EVENT_WAITING   0x80000000
+#define EVENT_ABANDONED 0x40000000
 
 #define EVENT_SUCCESS 0x0
 #define EVENT_FAILURE 0x1
@@ -60,6 +66,8 @@ enum event_type
     MISSION_CONTROL_EXIT,
     SYSTEM_WOKE,
     DAEMON_MESSAGE,
+    DAEMON_MESSAGE_TIMEOUT,
+    DAEMON_STARTED,
 
     EVENT_TYPE_COUNT
 };
@@ -89,10 +97,61 @@ static const char *event_type_str[] =
     [MISSION_CONTROL_EXIT]           = "mission_control_exit",
     [SYSTEM_WOKE]                    = "system_woke",
     [DAEMON_MESSAGE]                 = "daemon_message",
+    [DAEMON_MESSAGE_TIMEOUT]         = "daemon_message_timeout",
+    [DAEMON_STARTED]                 = "daemon_started",
 
     [EVENT_TYPE_COUNT]               = "event_type_count"
 };
 
+enum event_lane
+{
+    EVENT_LANE_FOCUS,
+    EVENT_LANE_LIFECYCLE,
+    EVENT_LANE_GEOMETRY,
+
+    EVENT_LANE_COUNT
+};
+
+static const char *event_lane_str[] =
+{
+    [EVENT_LANE_FOCUS]     = "focus",
+    [EVENT_LANE_LIFECYCLE] = "lifecycle",
+    [EVENT_LANE_GEOMETRY]  = "geometry",
+
+    [EVENT_LANE_COUNT]     = "lane_count"
+};
+
+static const enum event_lane event_lane[] =
+{
+    [EVENT_TYPE_UNKNOWN]             = EVENT_LANE_LIFECYCLE,
+
+    [APPLICATION_LAUNCHED]           = EVENT_LANE_LIFECYCLE,
+    [APPLICATION_TERMINATED]         = EVENT_LANE_LIFECYCLE,
+    [APPLICATION_FRONT_SWITCHED]     = EVENT_LANE_FOCUS,
+    [APPLICATION_ACTIVATED]          = EVENT_LANE_FOCUS,
+    [APPLICATION_DEACTIVATED]        = EVENT_LANE_FOCUS,
+    [APPLICATION_VISIBLE]            = EVENT_LANE_LIFECYCLE,
+    [APPLICATION_HIDDEN]             = EVENT_LANE_LIFECYCLE,
+    [WINDOW_CREATED]                 = EVENT_LANE_LIFECYCLE,
+    [WINDOW_DESTROYED]               = EVENT_LANE_LIFECYCLE,
+    [WINDOW_FOCUSED]                 = EVENT_LANE_FOCUS,
+    [WINDOW_MOVED]                   = EVENT_LANE_GEOMETRY,
+    [WINDOW_RESIZED]                 = EVENT_LANE_GEOMETRY,
+    [WINDOW_MINIMIZED]               = EVENT_LANE_LIFECYCLE,
+    [WINDOW_DEMINIMIZED]             = EVENT_LANE_LIFECYCLE,
+    [SPACE_CHANGED]                  = EVENT_LANE_LIFECYCLE,
+    [DISPLAY_CHANGED]                = EVENT_LANE_LIFECYCLE,
+    [MISSION_CONTROL_ENTER]          = EVENT_LANE_LIFECYCLE,
+    [MISSION_CONTROL_CHECK_FOR_EXIT] = EVENT_LANE_LIFECYCLE,
+    [MISSION_CONTROL_EXIT]           = EVENT_LANE_LIFECYCLE,
+    [SYSTEM_WOKE]                    = EVENT_LANE_FOCUS,
+    [DAEMON_MESSAGE]                 = EVENT_LANE_LIFECYCLE,
+    [DAEMON_MESSAGE_TIMEOUT]         = EVENT_LANE_LIFECYCLE,
+    [DAEMON_STARTED]                 = EVENT_LANE_FOCUS,
+
+    [EVENT_TYPE_COUNT]               = EVENT_LANE_LIFECYCLE
+};
+
 static event_callback *event_handler[] =
 {
     [APPLICATION_LAUNCHED]           = EVENT_HANDLER_APPLICATION_LAUNCHED,
@@ -116,18 +175,49 @@ static event_callback *event_handler[] =
     [MISSION_CONTROL_EXIT]           = EVENT_HANDLER_MISSION_CONTROL_EXIT,
     [SYSTEM_WOKE]                    = EVENT_HANDLER_SYSTEM_WOKE,
     [DAEMON_MESSAGE]                 = EVENT_HANDLER_DAEMON_MESSAGE,
+    [DAEMON_MESSAGE_TIMEOUT]         = EVENT_HANDLER_DAEMON_MESSAGE_TIMEOUT,
+    [DAEMON_STARTED]                 = EVENT_HANDLER_DAEMON_STARTED,
+};
+
+//
+// NOTE(koekeishiya): State that the producer of an event already has, or can get without asking
+// the application over AX, travels with the event. WINDOW_MOVED and WINDOW_RESIZED carry the
+// frame of the window as the window server reported it when the notification arrived. An event
+// that another event of the same window was merged into while it was pending has its payload
+// cleared before the handler runs, because the payload would describe an older state; handlers
+// then have to fetch the state themselves.
+//
+
+enum event_payload_type
+{
+    EVENT_PAYLOAD_NONE,
+    EVENT_PAYLOAD_FRAME
+};
+
+struct event_payload
+{
+    enum event_payload_type type;
+    union {
+        CGRect frame;
+    };
 };
 
 struct event
 {
     void *context;
     volatile uint32_t *info;
+    uint64_t timestamp;
     enum event_type type;
     int param1;
+    bool coalesce_owner;
+    struct event_payload payload;
 };
 
-struct event *event_create(struct event_loop *event_loop, enum event_type type, void *context);
-struct event *event_create_p1(struct event_loop *event_loop, enum event_type type, void *context, int param1);
+struct event event_create(enum event_type type, void *context);
+struct event event_create_p1(enum event_type type, void *context, int param1);
+uint32_t event_trace_id(struct event *event);
+pid_t event_trace_pid(enum event_type type, uint32_t id);
+struct event_loop;
 void event_destroy(struct event_loop *event_loop, struct event *event);
 
 #endif
@@ -1,88 +1,1201 @@
 #include "event_loop.h"
 
-static bool queue_init(struct queue *queue)
+//
+// NOTE(koekeishiya): Bounded multi-producer single-consumer ring. Every cell carries a
+// sequence number: a producer may claim the cell at position 'pos' when its sequence equals
+// 'pos', and publishes the event by setting it to 'pos + 1'. The consumer takes the cell once
+// its sequence is 'pos + 1' and hands it back to the producers as 'pos + size'. Head and tail
+// live on separate cache lines, so that producers and the consumer do not share a line.
+// Apple Silicon uses 128 byte cache lines, hence QUEUE_ALIGNMENT.
+//
+
+static bool queue_init(struct queue *queue, uint64_t size)
+{
+    queue->cells = malloc(size * sizeof(struct queue_cell));
+    if (!queue->cells) return false;
+
+    for (uint64_t i = 0; i < size; ++i) {
+        queue->cells[i].sequence = i;
+    }
+
+    queue->mask = size - 1;
+    queue->head = 0;
+    queue->tail = 0;
+    queue->overflow = 0;
+    queue->depth_high_water = 0;
+    queue->spill = NULL;
+    queue->spill_mark = 0;
+    queue->spill_head = 0;
+    queue->spill_count = 0;
+    queue->spill_capacity = 0;
+    return true;
+}
+
+static inline void queue_record_depth(struct queue *queue, uint64_t depth)
+{
+    uint64_t high_water = queue->depth_high_water;
+    while (depth > high_water && !__sync_bool_compare_and_swap(&queue->depth_high_water, high_water, depth)) {
+        high_water = queue->depth_high_water;
+    }
+}
+
+static bool queue_push(struct queue *queue, struct event *event)
+{
+    struct queue_cell *cell;
+    uint64_t pos = queue->tail;
+
+    for (;;) {
+        cell = &queue->cells[pos & queue->mask];
+        int64_t diff = (int64_t) cell->sequence - (int64_t) pos;
+
+        if (diff == 0) {
+            if (__sync_bool_compare_and_swap(&queue->tail, pos, pos + 1)) break;
+        } else if (diff < 0) {
+            return false;
+        }
+
+        pos = queue->tail;
+    }
+
+    cell->event = *event;
+    __sync_synchronize();
+    cell->sequence = pos + 1;
+
+    uint64_t head = queue->head;
+    queue_record_depth(queue, pos + 1 > head ? pos + 1 - head : 0);
+
+    return true;
+}
+
+//
+// NOTE(koekeishiya): Geometry events are collapsed per window, and a few global events are
+// collapsed per type. Posting claims a slot keyed by the window id (or the event type); if the
+// slot is already claimed an identical event is still pending and the new one is dropped. The
+// consumer releases the slot before it runs the handler, so anything that happens while the
+// handler is running gets posted again. Handlers read the current state of the window or
+// display, so the pending event observes the latest geometry by the time it is handled.
+// A hash collision between two windows simply means that the event is not collapsed.
+//
+// When an event is dropped, the slot is marked with COALESCE_MERGED. Releasing a marked slot
+// tells the consumer that the payload of the pending event is older than the latest event
+// for that window, so that it is not used.
+//
+// Only the event that claimed the slot may release it; coalesce_owner is set when it does.
+// Otherwise an older event of the same window, queued while another window held the slot, or
+// an event sent through event_loop_post_and_wait, would clear the slot of the pending event
+// and take its COALESCE_MERGED mark, and the pending event would run with a stale payload.
+//
+
+static volatile uint32_t *coalesce_slot(struct coalesce *coalesce, struct event *event, uint32_t *key)
+{
+    switch (event->type) {
+    default: return NULL;
+
+    case WINDOW_MOVED:
+    case WINDOW_RESIZED: {
+        uint32_t window_id = (uint32_t)(uintptr_t) event->context;
+        if (!window_id) return NULL;
+
+        uint32_t index = (window_id * 0x9e3779b1) >> 22;
+        *key = window_id;
+        return event->type == WINDOW_MOVED ? &coalesce->window_moved[index] : &coalesce->window_resized[index];
+    } break;
+    case SPACE_CHANGED:
+    case DISPLAY_CHANGED: {
+        *key = 1;
+        return &coalesce->global[event->type];
+    } break;
+    }
+}
+
+static bool coalesce_acquire(struct coalesce *coalesce, struct event *event)
+{
+    uint32_t key;
+    volatile uint32_t *slot = coalesce_slot(coalesce, event, &key);
+    if (!slot) return true;
+
+    for (;;) {
+        uint32_t value = *slot;
+        if (!value) {
+            if (!__sync_bool_compare_and_swap(slot, 0, key)) continue;
+            event->coalesce_owner = true;
+            return true;
+        }
+
+        if ((value & ~COALESCE_MERGED) != key) return true;
+        if (__sync_bool_compare_and_swap(slot, value, key | COALESCE_MERGED)) break;
+    }
+
+    __sync_fetch_and_add(&coalesce->merged[event->type], 1);
+    return false;
+}
+
+static bool coalesce_release(struct coalesce *coalesce, struct event *event)
+{
+    if (!event->coalesce_owner) return true;
+    event->coalesce_owner = false;
+
+    uint32_t key;
+    volatile uint32_t *slot = coalesce_slot(coalesce, event, &key);
+    if (!slot) return true;
+
+    for (;;) {
+        uint32_t value = *slot;
+        if ((value & ~COALESCE_MERGED) != key) return true;
+        if (__sync_bool_compare_and_swap(slot, value, 0)) return !(value & COALESCE_MERGED);
+    }
+}
+
+//
+// NOTE(koekeishiya): A ring has a single consumer, which must never wait for room in its own
+// ring; nobody else would ever make any. Events it posts to itself while the ring is full are
+// kept in a separate buffer instead. We remember where the tail of the ring was when
+// the buffer was started, and drain the buffer once everything before that point has been handled.
+//
+
+static void queue_spill(struct queue *queue, struct event *event)
+{
+    if (!queue->spill_count) {
+        queue->spill_mark = queue->tail;
+    }
+
+    if (queue->spill_count == queue->spill_capacity) {
+        queue->spill_capacity = queue->spill_capacity ? queue->spill_capacity * 2 : 64;
+        queue->spill = realloc(queue->spill, queue->spill_capacity * sizeof(struct event));
+    }
+
+    queue->spill[queue->spill_count++] = *event;
+    queue_record_depth(queue, queue->tail - queue->head + queue->spill_count - queue->spill_head);
+}
+
+static inline bool queue_ready(struct queue *queue)
+{
+    uint64_t pos = queue->head;
+    if (queue->spill_count && pos >= queue->spill_mark) return true;
+    return queue->cells[pos & queue->mask].sequence == pos + 1;
+}
+
+static bool queue_pop(struct queue *queue, struct event *event)
 {
-    if (!memory_pool_init(&queue->pool, QUEUE_POOL_SIZE)) return false;
-    queue->head = memory_pool_push(&queue->pool, struct queue_item);
-    queue->head->data = NULL;
-    queue->head->next = NULL;
-    queue->tail = queue->head;
+    uint64_t pos = queue->head;
+
+    if (queue->spill_count && pos >= queue->spill_mark) {
+        *event = queue->spill[queue->spill_head++];
+        if (queue->spill_head == queue->spill_count) {
+            queue->spill_head = 0;
+            queue->spill_count = 0;
+        }
+        return true;
+    }
+
+    struct queue_cell *cell = &queue->cells[pos & queue->mask];
+    if (cell->sequence != pos + 1) return false;
+
+    __sync_synchronize();
+    *event = cell->event;
+    queue->head = pos + 1;
+    __sync_synchronize();
+    cell->sequence = pos + queue->mask + 1;
+
     return true;
 }
 
-static void queue_push(struct queue *queue, struct event *event)
+//
+// NOTE(koekeishiya): Delayed events are kept in a timer wheel that is only ever touched by the
+// event loop thread, so scheduling and cancelling a timer does not need any synchronization.
+// Timers are stored in chunks that are never moved, because the wheel links them together.
+// The wheel ticks once per millisecond and deadlines are rounded up, so a delayed event is never
+// handled early. A timer id holds the index of the timer in the lower half and its generation in
+// the upper half; the generation is bumped when the timer is released, so that a stale id can't
+// cancel a timer that has been reused.
+//
+
+static inline uint64_t event_loop_now(void)
+{
+    return time_monotonic_ns() / EVENT_TIMER_TICK_NS;
+}
+
+static inline struct event_timer *event_loop_timer(struct event_loop *event_loop, uint32_t index)
+{
+    return &event_loop->timer_chunk[index / EVENT_TIMER_CHUNK_SIZE][index % EVENT_TIMER_CHUNK_SIZE];
+}
+
+static struct event_timer *event_loop_timer_alloc(struct event_loop *event_loop)
+{
+    if (event_loop->timer_free == UINT32_MAX) {
+        struct event_timer *chunk = malloc(EVENT_TIMER_CHUNK_SIZE * sizeof(struct event_timer));
+        if (!chunk) return NULL;
+
+        event_loop->timer_chunk = realloc(event_loop->timer_chunk, (event_loop->timer_chunk_count + 1) * sizeof(struct event_timer *));
+        event_loop->timer_chunk[event_loop->timer_chunk_count] = chunk;
+
+        uint32_t base = event_loop->timer_chunk_count++ * EVENT_TIMER_CHUNK_SIZE;
+        for (uint32_t i = 0; i < EVENT_TIMER_CHUNK_SIZE; ++i) {
+            chunk[i].index = base + i;
+            chunk[i].generation = 1;
+            chunk[i].next_free = i + 1 < EVENT_TIMER_CHUNK_SIZE ? base + i + 1 : UINT32_MAX;
+        }
+
+        event_loop->timer_free = base;
+    }
+
+    struct event_timer *timer = event_loop_timer(event_loop, event_loop->timer_free);
+    event_loop->timer_free = timer->next_free;
+
+    return timer;
+}
+
+static void event_loop_timer_free(struct event_loop *event_loop, struct event_timer *timer)
+{
+    if (++timer->generation == 0) timer->generation = 1;
+    timer->next_free = event_loop->timer_free;
+    event_loop->timer_free = timer->index;
+}
+
+static uint64_t event_loop_timer_schedule(struct event_loop *event_loop, struct event *event, uint64_t deadline)
+{
+    struct event_timer *timer = event_loop_timer_alloc(event_loop);
+    if (!timer) return 0;
+
+    timer->event = *event;
+    timer_wheel_insert(&event_loop->timer_wheel, &timer->node, (deadline + EVENT_TIMER_TICK_NS - 1) / EVENT_TIMER_TICK_NS);
+
+    return ((uint64_t) timer->generation << 32) | timer->index;
+}
+
+static bool event_loop_timer_pop(struct event_loop *event_loop, struct event *event)
+{
+    struct timer_node *node = timer_wheel_pop_expired(&event_loop->timer_wheel);
+    if (!node) return false;
+
+    struct event_timer *timer = (struct event_timer *) node;
+    *event = timer->event;
+    event->timestamp = timer->node.deadline * EVENT_TIMER_TICK_NS;
+    event_loop_timer_free(event_loop, timer);
+
+    return true;
+}
+
+//
+// NOTE(koekeishiya): When worker_count is set, geometry events are not handled by the event loop
+// thread but by one of the worker threads. The worker is picked by hashing the window id, so the
+// events of a window are still handled in the order they were posted, and a window that belongs
+// to an application that is slow to answer AX requests only holds up the windows that share its
+// worker. Every other event stays on the event loop thread, which owns all global state.
+//
+
+static inline struct event_worker *event_loop_worker(struct event_loop *event_loop, struct event *event)
+{
+    if (!event_loop->worker_count || event_lane[event->type] != EVENT_LANE_GEOMETRY) return NULL;
+
+    uint32_t hash = (uint32_t)(uintptr_t) event->context * 0x9e3779b1;
+    return &event_loop->worker[((uint64_t) hash * event_loop->worker_count) >> 32];
+}
+
+//
+// NOTE(koekeishiya): The event loop thread parks in its poller rather than on the futex, so that
+// it also wakes up for watched file descriptors (see event_loop_poll).
+//
+
+static inline void event_loop_signal(struct event_loop *event_loop)
+{
+    if (eventcount_notify(&event_loop->eventcount)) {
+        poller_wake(&event_loop->poller);
+    }
+}
+
+//
+// NOTE(koekeishiya): The info word of an event belongs to whoever posted it. A thread blocked in
+// event_loop_post_and_wait marks it EVENT_WAITING before it sleeps, so that we only make a wake-up
+// syscall when somebody is actually waiting. A waiter that times out marks it EVENT_ABANDONED
+// and leaves the word to us, so we free it instead of writing the result.
+//
+
+static void event_loop_complete(volatile uint32_t *info, uint32_t value)
+{
+    for (;;) {
+        uint32_t state = *info;
+        if (state == EVENT_ABANDONED) {
+            free((void *) info);
+            return;
+        }
+
+        if (__sync_bool_compare_and_swap(info, state, value)) {
+            if (state == EVENT_WAITING) eventcount_futex_wake(info);
+            return;
+        }
+    }
+}
+
+//
+// NOTE(koekeishiya): The event loop thread must never wait for room in the ring of a worker either;
+// the worker could be waiting for the event loop itself, e.g. in event_loop_continue_after, or be
+// stuck in a slow AX call while every other event piles up behind it. Events the event loop
+// routes to a worker whose ring is full are kept in a backlog for that worker, which is owned by
+// the event loop thread and handed over as soon as the ring has room again. Once a backlog has
+// been started, every event the event loop routes to that worker goes through it, so that they
+// stay in order. A worker that finishes a batch while its backlog is not empty wakes the event
+// loop, which then moves as many events as fit from the backlog into the ring.
+//
+
+static inline bool queue_has_room(struct queue *queue)
+{
+    uint64_t pos = queue->tail;
+    return queue->cells[pos & queue->mask].sequence == pos;
+}
+
+static void event_worker_backlog(struct event_loop *event_loop, struct event_worker *worker, struct event *event)
+{
+    if (worker->backlog_count == worker->backlog_capacity) {
+        int capacity = worker->backlog_capacity ? worker->backlog_capacity * 2 : 64;
+        struct event *backlog = realloc(worker->backlog, capacity * sizeof(struct event));
+
+        if (!backlog) {
+            coalesce_release(&event_loop->coalesce, event);
+            if (event->info) event_loop_complete(event->info, (EVENT_FAILURE << 0x1) | EVENT_PROCESSED);
+            event_destroy(event_loop, event);
+            return;
+        }
+
+        worker->backlog = backlog;
+        worker->backlog_capacity = capacity;
+    }
+
+    worker->backlog[worker->backlog_count++] = *event;
+    queue_record_depth(&worker->queue, worker->queue.tail - worker->queue.head + worker->backlog_count - worker->backlog_head);
+}
+
+static bool event_loop_backlog_ready(struct event_loop *event_loop)
+{
+    for (int i = 0; i < event_loop->worker_count; ++i) {
+        struct event_worker *worker = &event_loop->worker[i];
+        if (worker->backlog_count && queue_has_room(&worker->queue)) return true;
+    }
+
+    return false;
+}
+
+static void event_loop_flush_backlog(struct event_loop *event_loop)
+{
+    for (int i = 0; i < event_loop->worker_count; ++i) {
+        struct event_worker *worker = &event_loop->worker[i];
+        if (!worker->backlog_count) continue;
+
+        int head = worker->backlog_head;
+        while (head < worker->backlog_count && queue_push(&worker->queue, &worker->backlog[head])) ++head;
+        if (head == worker->backlog_head) continue;
+
+        if (head == worker->backlog_count) {
+            worker->backlog_head = 0;
+            worker->backlog_count = 0;
+        } else {
+            worker->backlog_head = head;
+        }
+
+        eventcount_signal(&worker->eventcount);
+    }
+}
+
+static void event_loop_route(struct event_loop *event_loop, struct event *event)
+{
+    struct event_worker *worker = event_loop_worker(event_loop, event);
+    struct queue *queue = worker ? &worker->queue : &event_loop->queue[event_lane[event->type]];
+    pthread_t consumer = worker ? worker->thread : event_loop->thread;
+
+    if (worker && pthread_equal(pthread_self(), event_loop->thread)) {
+        if (worker->backlog_count || !queue_push(queue, event)) {
+            __sync_fetch_and_add(&queue->overflow, 1);
+            event_worker_backlog(event_loop, worker, event);
+        }
+
+        eventcount_signal(&worker->eventcount);
+        return;
+    }
+
+    if (pthread_equal(pthread_self(), consumer)) {
+        if (queue->spill_count || !queue_push(queue, event)) {
+            __sync_fetch_and_add(&queue->overflow, 1);
+            queue_spill(queue, event);
+        }
+        return;
+    }
+
+    while (!queue_push(queue, event)) {
+        __sync_fetch_and_add(&queue->overflow, 1);
+        sched_yield();
+    }
+
+    if (worker) {
+        eventcount_signal(&worker->eventcount);
+    } else {
+        event_loop_signal(event_loop);
+    }
+}
+
+//
+// NOTE(koekeishiya): Every event type belongs to a lane (see event_lane in event.h), and lanes
+// are drained in strict priority order: focus changes first, then lifecycle events and finally
+// geometry updates. Events within a lane are handled in the order they were posted. An event
+// in a lower lane can be overtaken by one posted later in a higher lane; handlers already deal
+// with that through the lost focused and lost front switched events. Delayed events whose
+// deadline has passed are handled before any of the lanes, or handed to their worker. They are
+// merged with an identical event that is still pending, the same way posted events are.
+//
+
+static bool event_loop_ready(struct event_loop *event_loop)
 {
-    bool success;
-    struct queue_item *tail, *new_tail;
+    if (queue_ready(&event_loop->continuation)) return true;
 
-    new_tail = memory_pool_push(&queue->pool, struct queue_item);
-    new_tail->data = event;
-    new_tail->next = NULL;
-    __asm__ __volatile__ ("" ::: "memory");
+    for (int lane = 0; lane < EVENT_LANE_COUNT; ++lane) {
+        if (queue_ready(&event_loop->queue[lane])) return true;
+    }
 
-    do {
-        tail = queue->tail;
-        success = __sync_bool_compare_and_swap(&tail->next, NULL, new_tail);
-        if (!success) __sync_bool_compare_and_swap(&queue->tail, tail, tail->next);
-    } while (!success);
-    __sync_bool_compare_and_swap(&queue->tail, tail, new_tail);
+    return false;
 }
 
-static struct event *queue_pop(struct queue *queue)
+static bool event_loop_pop(struct event_loop *event_loop, struct event *event)
 {
-    struct queue_item *head;
+    while (event_loop_timer_pop(event_loop, event)) {
+        if (!coalesce_acquire(&event_loop->coalesce, event)) continue;
+        if (!event_loop_worker(event_loop, event)) return true;
+        event_loop_route(event_loop, event);
+    }
+
+    for (int lane = 0; lane < EVENT_LANE_COUNT; ++lane) {
+        if (queue_pop(&event_loop->queue[lane], event)) return true;
+    }
+
+    return false;
+}
+
+//
+// NOTE(koekeishiya): A worker may be using a window that the event loop thread has just removed
+// from the window table, so objects that workers can reach are retired instead of destroyed.
+// Every retired object is tagged with the current epoch, which is then bumped. A worker copies
+// the epoch before it handles a batch and resets its copy to 0 once the batch is done; after
+// that it can no longer reach anything that was removed before it started. An object is
+// destroyed once every worker is either idle or has started a batch in a later epoch. Workers
+// wake up the event loop thread when they go idle while objects are waiting to be destroyed.
+//
 
-    do {
-        head = queue->head;
-        if (!head->next) return NULL;
-    } while (!__sync_bool_compare_and_swap(&queue->head, head, head->next));
+void event_loop_retire(struct event_loop *event_loop, event_loop_retire_callback *destroy, void *object)
+{
+    if (!event_loop->worker_count || !event_loop->is_running) {
+        destroy(object);
+        return;
+    }
+
+    assert(pthread_equal(pthread_self(), event_loop->thread));
+
+    if (event_loop->retired_count == event_loop->retired_capacity) {
+        event_loop->retired_capacity = event_loop->retired_capacity ? event_loop->retired_capacity * 2 : 64;
+        event_loop->retired = realloc(event_loop->retired, event_loop->retired_capacity * sizeof(struct event_retired));
+    }
+
+    event_loop->retired[event_loop->retired_count] = (struct event_retired) {
+        .destroy = destroy,
+        .object  = object,
+        .epoch   = __sync_fetch_and_add(&event_loop->epoch, 1)
+    };
+
+    __sync_fetch_and_add(&event_loop->retired_count, 1);
+}
+
+static uint64_t event_loop_oldest_epoch(struct event_loop *event_loop)
+{
+    __sync_synchronize();
+
+    uint64_t oldest = UINT64_MAX;
+    for (int i = 0; i < event_loop->worker_count; ++i) {
+        uint64_t epoch = event_loop->worker[i].epoch;
+        if (epoch && epoch < oldest) oldest = epoch;
+    }
 
-    return head->next->data;
+    return oldest;
+}
+
+static inline bool event_loop_reclaimable(struct event_loop *event_loop)
+{
+    return event_loop->retired_count && event_loop->retired[0].epoch < event_loop_oldest_epoch(event_loop);
+}
+
+static void event_loop_reclaim(struct event_loop *event_loop)
+{
+    uint64_t oldest = event_loop_oldest_epoch(event_loop);
+
+    int count = 0;
+    while (count < event_loop->retired_count && event_loop->retired[count].epoch < oldest) {
+        event_loop->retired[count].destroy(event_loop->retired[count].object);
+        ++count;
+    }
+
+    if (!count) return;
+
+    memmove(event_loop->retired, event_loop->retired + count, (event_loop->retired_count - count) * sizeof(struct event_retired));
+    __sync_fetch_and_sub(&event_loop->retired_count, count);
+}
+
+//
+// NOTE(koekeishiya): Every thread that handles events publishes the event it is running in its
+// event_running slot, and the watchdog thread reports handlers that run for longer than
+// watchdog_budget_ms. A single hung AX call (or a sleep in a handler) stops every border that
+// is handled on the same thread from updating, so each stall is counted per event type and per
+// application. 'sequence' is bumped before 'begin' is set, so that the watchdog can tell one
+// long handler from a series of short ones, and reports every stall once.
+//
+// The watchdog only sleeps with a timeout while a handler it has not yet reported is running.
+// Otherwise it sets watchdog_idle and waits until a thread that starts a handler clears the flag
+// and signals it, so an idle daemon does not wake up every budget period. A stall of an
+// application beyond the first EVENT_WATCHDOG_PID_MAX is only counted in stall_pid_overflow.
+//
+// The stalled thread is asked for its backtrace with EVENT_WATCHDOG_SIGNAL. The signal handler
+// only records return addresses; they are symbolicated and logged by the watchdog. The handler
+// may already have returned by the time the signal arrives, in which case the backtrace shows
+// whatever the thread is doing by then.
+//
+
+#define EVENT_WATCHDOG_SIGNAL SIGUSR2
+
+static __thread struct event_running *event_loop_running;
+
+static void event_watchdog_signal_handler(int signo)
+{
+    struct event_running *running = event_loop_running;
+    if (running) running->frame_count = backtrace(running->frame, EVENT_WATCHDOG_FRAME_MAX);
+}
+
+static void event_loop_record_stall(struct event_loop *event_loop, uint32_t type, pid_t pid)
+{
+    ++event_loop->stall_count;
+    ++event_loop->stall_type[type];
+    if (!pid) return;
+
+    for (int i = 0; i < event_loop->stall_pid_count; ++i) {
+        if (event_loop->stall[i].pid == pid) {
+            ++event_loop->stall[i].count;
+            return;
+        }
+    }
+
+    if (event_loop->stall_pid_count < EVENT_WATCHDOG_PID_MAX) {
+        event_loop->stall[event_loop->stall_pid_count++] = (struct event_stall) { pid, 1 };
+    } else {
+        ++event_loop->stall_pid_overflow;
+    }
+}
+
+static uint64_t event_watchdog_check(struct event_loop *event_loop, struct event_running *running, uint64_t budget, uint64_t now)
+{
+    uint32_t sequence = running->sequence;
+    __sync_synchronize();
+    uint64_t begin = running->begin;
+    uint32_t type = running->type;
+    uint32_t id = running->id;
+    __sync_synchronize();
+
+    if (!begin || begin != running->begin || sequence != running->sequence) return UINT64_MAX;
+    if (now < begin + budget) return begin + budget - now;
+    if (running->reported == sequence) return UINT64_MAX;
+
+    running->reported = sequence;
+    pid_t pid = event_trace_pid(type, id);
+    event_loop_record_stall(event_loop, type, pid);
+    warn("event_loop: %s handler (id %u, pid %d) has been running for %" PRIu64 "ms\n", event_type_str[type], id, pid, (now - begin) / 1000000ULL);
+
+    running->frame_count = -1;
+    __sync_synchronize();
+
+    if (pthread_kill(running->thread, EVENT_WATCHDOG_SIGNAL) == 0) {
+        for (int i = 0; i < 100 && running->frame_count == -1; ++i) usleep(1000);
+        if (running->frame_count > 0) backtrace_symbols_fd(running->frame, running->frame_count, STDERR_FILENO);
+    }
+
+    return UINT64_MAX;
+}
+
+static void *event_watchdog_run(void *context)
+{
+    struct event_loop *event_loop = (struct event_loop *) context;
+
+    //
+    // NOTE(koekeishiya): The first call to backtrace may have to load the unwinder, which is not
+    // safe to do in a signal handler, so we make sure that has happened before any is sent.
+    //
+
+    void *frame[1];
+    backtrace(frame, 1);
+
+    while (event_loop->is_running) {
+        uint32_t key = eventcount_prepare(&event_loop->watchdog_eventcount);
+        uint64_t budget = (uint64_t) event_loop->watchdog_budget_ms * 1000000ULL;
+
+        if (!event_loop->is_running) {
+            eventcount_cancel(&event_loop->watchdog_eventcount);
+        } else if (!budget) {
+            eventcount_wait(&event_loop->watchdog_eventcount, key);
+        } else {
+            uint64_t now = time_monotonic_ns();
+            uint64_t timeout = event_watchdog_check(event_loop, &event_loop->running, budget, now);
+
+            for (int i = 0; i < event_loop->worker_count; ++i) {
+                uint64_t worker_timeout = event_watchdog_check(event_loop, &event_loop->worker[i].running, budget, now);
+                if (worker_timeout < timeout) timeout = worker_timeout;
+            }
+
+            //
+            // NOTE(koekeishiya): A handler may have started after we looked at its slot, but before
+            // it could see watchdog_idle. So after setting the flag we look at every slot once more
+            // before we wait without a timeout.
+            //
+
+            if (timeout != UINT64_MAX) {
+                event_loop->watchdog_idle = 0;
+                eventcount_wait_timeout(&event_loop->watchdog_eventcount, key, timeout);
+            } else if (!event_loop->watchdog_idle) {
+                event_loop->watchdog_idle = 1;
+                __sync_synchronize();
+                eventcount_cancel(&event_loop->watchdog_eventcount);
+            } else {
+                eventcount_wait(&event_loop->watchdog_eventcount, key);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+void event_loop_set_watchdog_budget(struct event_loop *event_loop, uint32_t budget_ms)
+{
+    event_loop->watchdog_budget_ms = budget_ms;
+    eventcount_signal(&event_loop->watchdog_eventcount);
+}
+
+//
+// NOTE(koekeishiya): Handlers get their scratch memory from the arena of the thread that runs
+// them. Threads other than the workers, including the event loop thread, use the event loop arena.
+// The main thread may only do so before event_loop_begin, which resets the arena it used.
+//
+
+static __thread struct memory_arena *event_loop_scratch_arena;
+
+struct memory_arena *event_loop_scratch(struct event_loop *event_loop)
+{
+    return event_loop_scratch_arena ? event_loop_scratch_arena : &event_loop->scratch;
+}
+
+//
+// NOTE(koekeishiya): Every event is stamped when it is posted (or, for a delayed event, with its
+// deadline). We record the time it spent waiting in the queue, the time spent in the handler and
+// the sum of the two, per event type. Every worker has its own set of histograms, so that each
+// set is only written by a single thread, and the query handler merges them. The cost is two
+// clock reads and a few increments per event. When tracing is enabled, the post and the
+// completion of every event are also written to the trace ring of the calling thread.
+//
+
+static void event_loop_dispatch(struct event_loop *event_loop, struct event_stats *stats, struct memory_arena *scratch, struct event_running *running, struct event *event)
+{
+    if (!coalesce_release(&event_loop->coalesce, event)) {
+        event->payload.type = EVENT_PAYLOAD_NONE;
+    }
+
+    bool trace = event_loop->trace.enabled;
+    uint32_t trace_id = event_trace_id(event);
+
+    uint64_t begin = time_monotonic_ns();
+    ++running->sequence;
+    running->type = event->type;
+    running->id = trace_id;
+    __sync_synchronize();
+    running->begin = begin;
+    __sync_synchronize();
+
+    if (event_loop->watchdog_idle && __sync_bool_compare_and_swap(&event_loop->watchdog_idle, 1, 0)) {
+        eventcount_signal(&event_loop->watchdog_eventcount);
+    }
+
+    uint64_t wait = begin > event->timestamp ? begin - event->timestamp : 0;
+    probe3(event__begin, event_type_str[event->type], trace_id, wait);
+
+    uint64_t ax_calls = g_ax_call_count;
+    uint32_t result = event_handler[event->type](event->context, event->param1, &event->payload);
+
+    running->begin = 0;
+    uint64_t end = time_monotonic_ns();
+    probe4(event__end, event_type_str[event->type], trace_id, end - begin, result);
+
+    if (trace) trace_write(&event_loop->trace, TRACE_HANDLED, event->type, trace_id, result, end, end - begin);
+
+    if (event->info) event_loop_complete(event->info, (result << 0x1) | EVENT_PROCESSED);
+
+    stats += event->type;
+    stats->ax_calls += g_ax_call_count - ax_calls;
+    histogram_record(&stats->wait, wait);
+    histogram_record(&stats->handler, end - begin);
+    histogram_record(&stats->total, wait + end - begin);
+
+    event_destroy(event_loop, event);
+    memory_arena_reset(scratch);
+}
+
+//
+// NOTE(koekeishiya): Events that are already queued when we wake up are handled as a single
+// batch of at most EVENT_BATCH_MAX events, so that the on_batch_begin and on_batch_end hooks can
+// defer work until the end of a burst. The cap makes sure deferred work is never postponed for
+// long while events keep arriving. batch_size[i] counts batches of size [2^i, 2^(i+1)).
+//
+
+//
+// NOTE(koekeishiya): Besides its queues and timers, the event loop thread waits for file
+// descriptors registered with event_loop_watch to become readable, and then calls their callback
+// on the event loop thread. This is how the IPC socket is served without an accept thread. A
+// callback may watch and unwatch descriptors itself, including its own; the watch list can move
+// while callbacks run, so every entry is looked up again by descriptor.
+//
+
+static struct event_watch *event_loop_watch_find(struct event_loop *event_loop, int fd)
+{
+    for (int i = 0; i < event_loop->watch_count; ++i) {
+        if (event_loop->watch[i].fd == fd) return &event_loop->watch[i];
+    }
+
+    return NULL;
+}
+
+bool event_loop_watch(struct event_loop *event_loop, int fd, event_loop_watch_callback *callback, void *context)
+{
+    assert(!event_loop->is_running || pthread_equal(pthread_self(), event_loop->thread));
+
+    if (event_loop->watch_count == event_loop->watch_capacity) {
+        int capacity = event_loop->watch_capacity ? event_loop->watch_capacity * 2 : 8;
+        struct event_watch *watch = realloc(event_loop->watch, capacity * sizeof(struct event_watch));
+        if (!watch) return false;
+
+        event_loop->watch = watch;
+        event_loop->watch_capacity = capacity;
+    }
+
+    if (!poller_add(&event_loop->poller, fd, (uintptr_t) fd)) return false;
+
+    event_loop->watch[event_loop->watch_count++] = (struct event_watch) { fd, callback, context };
+    return true;
+}
+
+void event_loop_unwatch(struct event_loop *event_loop, int fd)
+{
+    assert(!event_loop->is_running || pthread_equal(pthread_self(), event_loop->thread));
+
+    struct event_watch *watch = event_loop_watch_find(event_loop, fd);
+    if (!watch) return;
+
+    poller_remove(&event_loop->poller, fd);
+    *watch = event_loop->watch[--event_loop->watch_count];
+}
+
+static void event_loop_poll(struct event_loop *event_loop, int64_t timeout_ns)
+{
+    uintptr_t ready[POLLER_EVENT_MAX];
+    int ready_count = poller_wait(&event_loop->poller, ready, POLLER_EVENT_MAX, timeout_ns);
+
+    for (int i = 0; i < ready_count; ++i) {
+        struct event_watch *watch = event_loop_watch_find(event_loop, (int) ready[i]);
+        if (!watch) continue;
+
+        struct event_watch copy = *watch;
+        copy.callback(copy.fd, copy.context);
+    }
 }
 
 static void *event_loop_run(void *context)
 {
     struct event_loop *event_loop = (struct event_loop *) context;
-    struct queue *queue = (struct queue *) &event_loop->queue;
+    event_loop->running.thread = pthread_self();
+    event_loop_running = &event_loop->running;
 
     while (event_loop->is_running) {
-        struct event *event = queue_pop(queue);
-        if (event) {
-            uint32_t result = event_handler[event->type](event->context, event->param1);
+        if (event_loop->retired_count) event_loop_reclaim(event_loop);
+        if (event_loop->worker_count) event_loop_flush_backlog(event_loop);
 
-            if (event->info) *event->info = (result << 0x1) | EVENT_PROCESSED;
+        struct event event;
+        while (queue_pop(&event_loop->continuation, &event)) {
+            event_loop_timer_schedule(event_loop, &event, event.timestamp);
+        }
 
-            event_destroy(event_loop, event);
+        timer_wheel_advance(&event_loop->timer_wheel, event_loop_now());
+
+        if (event_loop_pop(event_loop, &event)) {
+            if (event_loop->on_batch_begin) event_loop->on_batch_begin();
+
+            int batch_size = 0;
+            do {
+                event_loop_dispatch(event_loop, event_loop->stats, &event_loop->scratch, &event_loop->running, &event);
+            } while (++batch_size < EVENT_BATCH_MAX && event_loop_pop(event_loop, &event));
+
+            if (event_loop->on_batch_end) event_loop->on_batch_end();
+            ++event_loop->batch_size[31 - __builtin_clz(batch_size)];
+
+            if (event_loop->watch_count) event_loop_poll(event_loop, 0);
         } else {
-            sem_wait(event_loop->semaphore);
+            for (int i = 0; i < EVENTCOUNT_SPIN_COUNT; ++i) {
+                if (event_loop_ready(event_loop)) break;
+                cpu_relax();
+            }
+
+            eventcount_prepare(&event_loop->eventcount);
+            uint64_t deadline = timer_wheel_next_deadline(&event_loop->timer_wheel);
+            int64_t timeout = -1;
+
+            if (event_loop_ready(event_loop) || event_loop_reclaimable(event_loop) || event_loop_backlog_ready(event_loop) || !event_loop->is_running) {
+                timeout = 0;
+            } else if (deadline != UINT64_MAX) {
+                uint64_t now = time_monotonic_ns();
+                uint64_t wakeup = deadline * EVENT_TIMER_TICK_NS;
+                timeout = wakeup > now ? wakeup - now : 0;
+            }
+
+            if (timeout || event_loop->watch_count) event_loop_poll(event_loop, timeout);
+            eventcount_cancel(&event_loop->eventcount);
         }
     }
 
     return NULL;
 }
 
+static void *event_worker_run(void *context)
+{
+    struct event_worker *worker = (struct event_worker *) context;
+    struct event_loop *event_loop = worker->event_loop;
+    event_loop_scratch_arena = &worker->scratch;
+    worker->running.thread = pthread_self();
+    event_loop_running = &worker->running;
+
+    while (event_loop->is_running) {
+        struct event event;
+        if (queue_pop(&worker->queue, &event)) {
+            worker->epoch = event_loop->epoch;
+            __sync_synchronize();
+
+            if (event_loop->on_batch_begin) event_loop->on_batch_begin();
+
+            int batch_size = 0;
+            do {
+                event_loop_dispatch(event_loop, worker->stats, &worker->scratch, &worker->running, &event);
+            } while (++batch_size < EVENT_BATCH_MAX && queue_pop(&worker->queue, &event));
+
+            if (event_loop->on_batch_end) event_loop->on_batch_end();
+
+            __sync_synchronize();
+            worker->epoch = 0;
+            __sync_synchronize();
+
+            if (event_loop->retired_count || worker->backlog_count) event_loop_signal(event_loop);
+        } else {
+            for (int i = 0; i < EVENTCOUNT_SPIN_COUNT; ++i) {
+                if (queue_ready(&worker->queue)) break;
+                cpu_relax();
+            }
+
+            uint32_t key = eventcount_prepare(&worker->eventcount);
+            if (queue_ready(&worker->queue) || !event_loop->is_running) {
+                eventcount_cancel(&worker->eventcount);
+            } else {
+                eventcount_wait(&worker->eventcount, key);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static void event_loop_enqueue(struct event_loop *event_loop, struct event *event)
+{
+    event->timestamp = time_monotonic_ns();
+    if (event_loop->trace.enabled) trace_write(&event_loop->trace, TRACE_POSTED, event->type, event_trace_id(event), 0, event->timestamp, 0);
+    probe2(event__post, event_type_str[event->type], event->context);
+
+    event_loop_route(event_loop, event);
+}
+
 void event_loop_post(struct event_loop *event_loop, struct event *event)
 {
     assert(event_loop->is_running);
-    queue_push(&event_loop->queue, event);
-    sem_post(event_loop->semaphore);
+    if (!coalesce_acquire(&event_loop->coalesce, event)) return;
+
+    event_loop_enqueue(event_loop, event);
+}
+
+//
+// NOTE(koekeishiya): Post an event and block until it has been handled. Returns the info word of
+// the event, (result << 1) | EVENT_PROCESSED, which can be inspected with event_status and
+// event_result. If timeout_ms is non-zero and the event has not been handled in time, the event
+// stays queued and EVENT_ABANDONED is returned; the context of the event then still belongs to
+// the handler. The event is never collapsed with a pending event, since the caller needs its
+// result. This must not be called from the event loop thread, which would wait for itself.
+//
+
+uint32_t event_loop_post_and_wait(struct event_loop *event_loop, struct event *event, uint64_t timeout_ms)
+{
+    assert(event_loop->is_running);
+    assert(!pthread_equal(pthread_self(), event_loop->thread));
+
+    //
+    // NOTE(koekeishiya): A waiter that gives up returns while the event is still queued, so its
+    // info word cannot live on the stack. In that case the word is allocated here and freed by
+    // whichever side is done with it last: the event loop if the wait was abandoned, otherwise us.
+    //
+
+    volatile uint32_t local;
+    volatile uint32_t *info = timeout_ms ? malloc(sizeof(uint32_t)) : &local;
+    if (!info) info = &local;
+
+    uint64_t deadline = info != &local ? time_monotonic_ns() + timeout_ms * 1000000ULL : 0;
+
+    *info = EVENT_QUEUED;
+    event->info = info;
+    event_loop_enqueue(event_loop, event);
+
+    if (__sync_bool_compare_and_swap(info, EVENT_QUEUED, EVENT_WAITING)) {
+        for (;;) {
+            uint64_t timeout = 0;
+
+            if (deadline) {
+                uint64_t now = time_monotonic_ns();
+                if (now >= deadline) {
+                    if (__sync_bool_compare_and_swap(info, EVENT_WAITING, EVENT_ABANDONED)) return EVENT_ABANDONED;
+                    break;
+                }
+                timeout = deadline - now;
+            }
+
+            eventcount_futex_wait(info, EVENT_WAITING, timeout);
+            if (*info != EVENT_WAITING) break;
+        }
+    }
+
+    uint32_t result = *info;
+    if (info != &local) free((void *) info);
+    return result;
+}
+
+//
+// NOTE(koekeishiya): Only the event loop thread may schedule or cancel a delayed event. The event
+// is handled by the event loop once the delay has passed, unless it is cancelled first; in that
+// case it is destroyed without being handled. Returns 0 if the timer could not be allocated.
+//
+
+uint64_t event_loop_post_after(struct event_loop *event_loop, struct event *event, uint64_t delay_ms)
+{
+    assert(pthread_equal(pthread_self(), event_loop->thread));
+    return event_loop_timer_schedule(event_loop, event, time_monotonic_ns() + delay_ms * 1000000ULL);
+}
+
+//
+// NOTE(koekeishiya): A continuation lets a handler that has to wait for something (such as a
+// display that is still animating) check again later, instead of blocking the thread it runs on.
+// Unlike event_loop_post_after this may be called from an event loop worker; the timer wheel is
+// owned by the event loop thread, so the request is handed over through the continuation ring,
+// with the deadline in the timestamp field, and is scheduled on the next iteration of the loop.
+// Continuations can not be cancelled; the handler has to check whether it still applies.
+//
+
+void event_loop_continue_after(struct event_loop *event_loop, struct event *event, uint64_t delay_ms)
+{
+    if (pthread_equal(pthread_self(), event_loop->thread)) {
+        event_loop_post_after(event_loop, event, delay_ms);
+        return;
+    }
+
+    struct event request = *event;
+    request.timestamp = time_monotonic_ns() + delay_ms * 1000000ULL;
+
+    while (!queue_push(&event_loop->continuation, &request)) {
+        __sync_fetch_and_add(&event_loop->continuation.overflow, 1);
+        sched_yield();
+    }
+
+    event_loop_signal(event_loop);
+}
+
+bool event_loop_cancel(struct event_loop *event_loop, uint64_t timer_id)
+{
+    assert(pthread_equal(pthread_self(), event_loop->thread));
+
+    uint32_t index = (uint32_t) timer_id;
+    uint32_t generation = (uint32_t)(timer_id >> 32);
+    if (!generation || index >= event_loop->timer_chunk_count * EVENT_TIMER_CHUNK_SIZE) return false;
+
+    struct event_timer *timer = event_loop_timer(event_loop, index);
+    if (timer->generation != generation) return false;
+
+    timer_wheel_remove(&event_loop->timer_wheel, &timer->node);
+    event_destroy(event_loop, &timer->event);
+    event_loop_timer_free(event_loop, timer);
+
+    return true;
+}
+
+static void event_loop_serialize_histogram(FILE *rsp, const char *type, const char *name, struct histogram *histogram)
+{
+    fprintf(rsp, "%s_%s_p50_ns: %" PRIu64 "\n", type, name, histogram_percentile(histogram, 50.0));
+    fprintf(rsp, "%s_%s_p90_ns: %" PRIu64 "\n", type, name, histogram_percentile(histogram, 90.0));
+    fprintf(rsp, "%s_%s_p99_ns: %" PRIu64 "\n", type, name, histogram_percentile(histogram, 99.0));
+    fprintf(rsp, "%s_%s_max_ns: %" PRIu64 "\n", type, name, histogram->max);
+}
+
+void event_loop_serialize(FILE *rsp, struct event_loop *event_loop)
+{
+    uint64_t overflow = 0;
+    for (int lane = 0; lane < EVENT_LANE_COUNT; ++lane) {
+        overflow += event_loop->queue[lane].overflow;
+    }
+
+    for (int i = 0; i < event_loop->worker_count; ++i) {
+        overflow += event_loop->worker[i].queue.overflow;
+    }
+
+    fprintf(rsp, "queue_overflow: %" PRIu64 "\n", overflow);
+    for (int i = EVENT_TYPE_UNKNOWN + 1; i < EVENT_TYPE_COUNT; ++i) {
+        if (!event_loop->coalesce.merged[i]) continue;
+        fprintf(rsp, "%s_merged: %" PRIu64 "\n", event_type_str[i], event_loop->coalesce.merged[i]);
+    }
+
+    for (int i = 0; i < EVENT_BATCH_BUCKET_COUNT; ++i) {
+        if (!event_loop->batch_size[i]) continue;
+        int max = (1 << (i + 1)) - 1;
+        fprintf(rsp, "batch_size_%d-%d: %" PRIu64 "\n", 1 << i, max < EVENT_BATCH_MAX ? max : EVENT_BATCH_MAX, event_loop->batch_size[i]);
+    }
+
+    for (int lane = 0; lane < EVENT_LANE_COUNT; ++lane) {
+        fprintf(rsp, "%s_queue_depth_max: %" PRIu64 "\n", event_lane_str[lane], event_loop->queue[lane].depth_high_water);
+    }
+
+    for (int i = 0; i < event_loop->worker_count; ++i) {
+        fprintf(rsp, "worker_%d_queue_depth_max: %" PRIu64 "\n", i, event_loop->worker[i].queue.depth_high_water);
+    }
+
+    fprintf(rsp, "handler_stalls: %" PRIu64 "\n", event_loop->stall_count);
+    for (int i = EVENT_TYPE_UNKNOWN + 1; i < EVENT_TYPE_COUNT; ++i) {
+        if (!event_loop->stall_type[i]) continue;
+        fprintf(rsp, "%s_stalls: %" PRIu64 "\n", event_type_str[i], event_loop->stall_type[i]);
+    }
+
+    for (int i = 0; i < event_loop->stall_pid_count; ++i) {
+        fprintf(rsp, "pid_%d_stalls: %" PRIu64 "\n", event_loop->stall[i].pid, event_loop->stall[i].count);
+    }
+
+    fprintf(rsp, "pid_stalls_overflow: %" PRIu64 "\n", event_loop->stall_pid_overflow);
+
+    struct event_stats *stats = memory_arena_push(event_loop_scratch(event_loop), struct event_stats, 1);
+    if (!stats) return;
+
+    for (int i = EVENT_TYPE_UNKNOWN + 1; i < EVENT_TYPE_COUNT; ++i) {
+        *stats = event_loop->stats[i];
+        for (int j = 0; j < event_loop->worker_count; ++j) {
+            histogram_merge(&stats->wait, &event_loop->worker[j].stats[i].wait);
+            histogram_merge(&stats->handler, &event_loop->worker[j].stats[i].handler);
+            histogram_merge(&stats->total, &event_loop->worker[j].stats[i].total);
+            stats->ax_calls += event_loop->worker[j].stats[i].ax_calls;
+        }
+
+        if (!stats->total.count) continue;
+
+        fprintf(rsp, "%s_count: %" PRIu64 "\n", event_type_str[i], stats->total.count);
+        fprintf(rsp, "%s_ax_calls: %" PRIu64 "\n", event_type_str[i], stats->ax_calls);
+        event_loop_serialize_histogram(rsp, event_type_str[i], "wait", &stats->wait);
+        event_loop_serialize_histogram(rsp, event_type_str[i], "handler", &stats->handler);
+        event_loop_serialize_histogram(rsp, event_type_str[i], "total", &stats->total);
+    }
+}
+
+bool event_loop_dump_trace(struct event_loop *event_loop, const char *path)
+{
+    return trace_dump(&event_loop->trace, path, event_type_str, EVENT_TYPE_COUNT);
 }
 
 bool event_loop_init(struct event_loop *event_loop)
 {
-    if (!queue_init(&event_loop->queue)) return false;
-    if (!memory_pool_init(&event_loop->pool, EVENT_POOL_SIZE)) return false;
+    for (int lane = 0; lane < EVENT_LANE_COUNT; ++lane) {
+        if (!queue_init(&event_loop->queue[lane], EVENT_QUEUE_SIZE)) return false;
+    }
+
+    if (!queue_init(&event_loop->continuation, EVENT_CONTINUATION_QUEUE_SIZE)) return false;
+
+    memset(&event_loop->coalesce, 0, sizeof(struct coalesce));
+    memset(event_loop->stats, 0, sizeof(event_loop->stats));
+    memset(&event_loop->trace, 0, sizeof(struct trace));
+    memset(event_loop->batch_size, 0, sizeof(event_loop->batch_size));
+    event_loop->on_batch_begin = NULL;
+    event_loop->on_batch_end = NULL;
+    if (!memory_arena_init(&event_loop->scratch, SCRATCH_POOL_SIZE)) return false;
+    timer_wheel_init(&event_loop->timer_wheel, event_loop_now());
+    event_loop->timer_chunk = NULL;
+    event_loop->timer_chunk_count = 0;
+    event_loop->timer_free = UINT32_MAX;
+    event_loop->worker_count = 0;
+    event_loop->worker = NULL;
+    event_loop->epoch = 1;
+    event_loop->retired = NULL;
+    event_loop->retired_count = 0;
+    event_loop->retired_capacity = 0;
+    memset(&event_loop->running, 0, sizeof(struct event_running));
+    eventcount_init(&event_loop->watchdog_eventcount);
+    event_loop->watchdog_budget_ms = EVENT_WATCHDOG_BUDGET_MS;
+    event_loop->stall_count = 0;
+    memset(event_loop->stall_type, 0, sizeof(event_loop->stall_type));
+    event_loop->stall_pid_count = 0;
+    event_loop->stall_pid_overflow = 0;
+    event_loop->watchdog_idle = 0;
+    event_loop->watch = NULL;
+    event_loop->watch_count = 0;
+    event_loop->watch_capacity = 0;
     event_loop->is_running = false;
-    event_loop->semaphore = sem_open("yabai_event_loop_semaphore", O_CREAT, 0600, 0);
-    sem_unlink("yabai_event_loop_semaphore");
-    return event_loop->semaphore != SEM_FAILED;
+    eventcount_init(&event_loop->eventcount);
+    return poller_init(&event_loop->poller);
+}
+
+static bool event_loop_worker_init(struct event_loop *event_loop)
+{
+    if (event_loop->worker_count > EVENT_WORKER_MAX) event_loop->worker_count = EVENT_WORKER_MAX;
+    if (posix_memalign((void **) &event_loop->worker, QUEUE_ALIGNMENT, event_loop->worker_count * sizeof(struct event_worker))) return false;
+
+    for (int i = 0; i < event_loop->worker_count; ++i) {
+        struct event_worker *worker = &event_loop->worker[i];
+        worker->event_loop = event_loop;
+        worker->epoch = 0;
+        worker->backlog = NULL;
+        worker->backlog_head = 0;
+        worker->backlog_count = 0;
+        worker->backlog_capacity = 0;
+        worker->stats = malloc(EVENT_TYPE_COUNT * sizeof(struct event_stats));
+        if (!worker->stats) return false;
+
+        memset(worker->stats, 0, EVENT_TYPE_COUNT * sizeof(struct event_stats));
+        memset(&worker->running, 0, sizeof(struct event_running));
+        if (!queue_init(&worker->queue, EVENT_QUEUE_SIZE)) return false;
+        if (!memory_arena_init(&worker->scratch, SCRATCH_POOL_SIZE)) return false;
+        eventcount_init(&worker->eventcount);
+    }
+
+    return true;
 }
 
 bool event_loop_begin(struct event_loop *event_loop)
 {
     if (event_loop->is_running) return false;
+    if (event_loop->worker_count && !event_loop->worker && !event_loop_worker_init(event_loop)) return false;
+
+    memory_arena_reset(&event_loop->scratch);
     event_loop->is_running = true;
     pthread_create(&event_loop->thread, NULL, &event_loop_run, event_loop);
+
+    for (int i = 0; i < event_loop->worker_count; ++i) {
+        pthread_create(&event_loop->worker[i].thread, NULL, &event_worker_run, &event_loop->worker[i]);
+    }
+
+    struct sigaction action = { .sa_handler = event_watchdog_signal_handler, .sa_flags = SA_RESTART };
+    sigemptyset(&action.sa_mask);
+    sigaction(EVENT_WATCHDOG_SIGNAL, &action, NULL);
+    pthread_create(&event_loop->watchdog, NULL, &event_watchdog_run, event_loop);
+
     return true;
 }
 
@@ -90,6 +1203,16 @@ bool event_loop_end(struct event_loop *event_loop)
 {
     if (!event_loop->is_running) return false;
     event_loop->is_running = false;
+    event_loop_signal(event_loop);
     pthread_join(event_loop->thread, NULL);
+
+    for (int i = 0; i < event_loop->worker_count; ++i) {
+        eventcount_signal(&event_loop->worker[i].eventcount);
+        pthread_join(event_loop->worker[i].thread, NULL);
+    }
+
+    eventcount_signal(&event_loop->watchdog_eventcount);
+    pthread_join(event_loop->watchdog, NULL);
+
     return true;
 }
@@ -1,37 +1,178 @@
 #ifndef EVENT_LOOP_H
 #define EVENT_LOOP_H
 
-#define EVENT_POOL_SIZE KILOBYTES(36)
-#define EVENT_MAX_COUNT ((EVENT_POOL_SIZE) / (sizeof(struct event)))
+#define EVENT_QUEUE_SIZE 4096
+#define QUEUE_ALIGNMENT 128
+#define SCRATCH_POOL_SIZE KILOBYTES(256)
+#define COALESCE_SLOT_COUNT 1024
+#define COALESCE_MERGED     0x80000000
+#define EVENT_BATCH_MAX 64
+#define EVENT_BATCH_BUCKET_COUNT 7
+#define EVENT_TIMER_CHUNK_SIZE 256
+#define EVENT_TIMER_TICK_NS 1000000ULL
+#define EVENT_CONTINUATION_QUEUE_SIZE 256
+#define EVENT_WORKER_MAX 16
+#define EVENT_WATCHDOG_BUDGET_MS 500
+#define EVENT_WATCHDOG_FRAME_MAX 32
+#define EVENT_WATCHDOG_PID_MAX 64
 
-#define QUEUE_POOL_SIZE KILOBYTES(16)
-#define QUEUE_MAX_COUNT ((QUEUE_POOL_SIZE) / (sizeof(struct queue_item)))
+#define EVENT_LOOP_BATCH_CALLBACK(name) void name(void)
+typedef EVENT_LOOP_BATCH_CALLBACK(event_loop_batch_callback);
 
-struct queue_item
+#define EVENT_LOOP_RETIRE_CALLBACK(name) void name(void *object)
+typedef EVENT_LOOP_RETIRE_CALLBACK(event_loop_retire_callback);
+
+#define EVENT_LOOP_WATCH_CALLBACK(name) void name(int fd, void *context)
+typedef EVENT_LOOP_WATCH_CALLBACK(event_loop_watch_callback);
+
+struct queue_cell
 {
-    struct event *data;
-    struct queue_item *next;
+    volatile uint64_t sequence;
+    struct event event;
 };
 
 struct queue
 {
-    struct memory_pool pool;
-    struct queue_item *head;
-    struct queue_item *tail;
+    struct queue_cell *cells;
+    uint64_t mask;
+    volatile uint64_t head __attribute__((aligned(QUEUE_ALIGNMENT)));
+    struct event *spill;
+    uint64_t spill_mark;
+    int spill_head;
+    int spill_count;
+    int spill_capacity;
+    volatile uint64_t tail __attribute__((aligned(QUEUE_ALIGNMENT)));
+    volatile uint64_t overflow;
+    volatile uint64_t depth_high_water;
+};
+
+struct coalesce
+{
+    volatile uint32_t window_moved[COALESCE_SLOT_COUNT];
+    volatile uint32_t window_resized[COALESCE_SLOT_COUNT];
+    volatile uint32_t global[EVENT_TYPE_COUNT];
+    volatile uint64_t merged[EVENT_TYPE_COUNT];
+};
+
+struct event_stats
+{
+    struct histogram wait;
+    struct histogram handler;
+    struct histogram total;
+    uint64_t ax_calls;
+};
+
+struct event_timer
+{
+    struct timer_node node;
+    uint32_t index;
+    uint32_t generation;
+    uint32_t next_free;
+    struct event event;
+};
+
+struct event_running
+{
+    pthread_t thread;
+    volatile uint64_t begin;
+    volatile uint32_t sequence;
+    volatile uint32_t type;
+    volatile uint32_t id;
+    uint32_t reported;
+    volatile int frame_count;
+    void *frame[EVENT_WATCHDOG_FRAME_MAX];
+};
+
+struct event_stall
+{
+    pid_t pid;
+    uint64_t count;
+};
+
+struct event_worker
+{
+    struct event_loop *event_loop;
+    pthread_t thread;
+    volatile uint64_t epoch;
+    struct eventcount eventcount;
+    struct memory_arena scratch;
+    struct event_stats *stats;
+    struct event_running running;
+    struct event *backlog;
+    int backlog_head;
+    volatile int backlog_count;
+    int backlog_capacity;
+    struct queue queue;
+};
+
+struct event_retired
+{
+    event_loop_retire_callback *destroy;
+    void *object;
+    uint64_t epoch;
+};
+
+struct event_watch
+{
+    int fd;
+    event_loop_watch_callback *callback;
+    void *context;
 };
 
 struct event_loop
 {
     bool is_running;
     pthread_t thread;
-    sem_t *semaphore;
-    struct queue queue;
-    struct memory_pool pool;
+    struct eventcount eventcount;
+    struct poller poller;
+    struct event_watch *watch;
+    int watch_count;
+    int watch_capacity;
+    event_loop_batch_callback *on_batch_begin;
+    event_loop_batch_callback *on_batch_end;
+    uint64_t batch_size[EVENT_BATCH_BUCKET_COUNT];
+    struct memory_arena scratch;
+    struct coalesce coalesce;
+    struct event_stats stats[EVENT_TYPE_COUNT];
+    struct trace trace;
+    struct timer_wheel timer_wheel;
+    struct event_timer **timer_chunk;
+    uint32_t timer_chunk_count;
+    uint32_t timer_free;
+    int worker_count;
+    struct event_worker *worker;
+    volatile uint64_t epoch;
+    struct event_retired *retired;
+    volatile int retired_count;
+    int retired_capacity;
+    struct event_running running;
+    pthread_t watchdog;
+    struct eventcount watchdog_eventcount;
+    volatile uint32_t watchdog_budget_ms;
+    volatile uint32_t watchdog_idle;
+    uint64_t stall_count;
+    uint64_t stall_type[EVENT_TYPE_COUNT];
+    struct event_stall stall[EVENT_WATCHDOG_PID_MAX];
+    int stall_pid_count;
+    uint64_t stall_pid_overflow;
+    struct queue continuation;
+    struct queue queue[EVENT_LANE_COUNT];
 };
 
 bool event_loop_init(struct event_loop *event_loop);
 bool event_loop_begin(struct event_loop *event_loop);
 bool event_loop_end(struct event_loop *event_loop);
 void event_loop_post(struct event_loop *event_loop, struct event *event);
+uint32_t event_loop_post_and_wait(struct event_loop *event_loop, struct event *event, uint64_t timeout_ms);
+uint64_t event_loop_post_after(struct event_loop *event_loop, struct event *event, uint64_t delay_ms);
+void event_loop_continue_after(struct event_loop *event_loop, struct event *event, uint64_t delay_ms);
+bool event_loop_cancel(struct event_loop *event_loop, uint64_t timer_id);
+bool event_loop_watch(struct event_loop *event_loop, int fd, event_loop_watch_callback *callback, void *context);
+void event_loop_unwatch(struct event_loop *event_loop, int fd);
+void event_loop_retire(struct event_loop *event_loop, event_loop_retire_callback *destroy, void *object);
+struct memory_arena *event_loop_scratch(struct event_loop *event_loop);
+void event_loop_set_watchdog_budget(struct event_loop *event_loop, uint32_t budget_ms);
+void event_loop_serialize(FILE *rsp, struct event_loop *event_loop);
+bool event_loop_dump_trace(struct event_loop *event_loop, const char *path);
 
 #endif
@@ -10,11 +10,15 @@
 #define VERSION_OPT_SHRT        "-v"
 #define CONFIG_OPT_LONG         "--config"
 #define CONFIG_OPT_SHRT         "-c"
+#define WORKERS_OPT_LONG        "--workers"
+#define WORKERS_OPT_SHRT        "-w"
 
 #define MAJOR 0
 #define MINOR 0
 #define PATCH 1
 
+#define DAEMON_STARTED_TIMEOUT_MS 1000
+
 #define CONNECTION_CALLBACK(name) void name(uint32_t type, void *data, size_t data_length, void *context, int cid)
 typedef CONNECTION_CALLBACK(connection_callback);
 extern CGError SLSRegisterConnectionNotifyProc(int cid, connection_callback *handler, uint32_t event, void *context);
@@ -31,6 +35,7 @@ char g_socket_file[MAXLEN];
 char g_config_file[4096];
 char g_lock_file[MAXLEN];
 bool g_verbose;
+int g_worker_count;
 
 static int client_send_message(int argc, char **argv)
 {
@@ -189,8 +194,8 @@ static inline void init_misc_settings(void)
 
 static CONNECTION_CALLBACK(connection_handler)
 {
-    struct event *event = event_create(&g_event_loop, MISSION_CONTROL_ENTER, NULL);
-    event_loop_post(&g_event_loop, event);
+    struct event event = event_create(MISSION_CONTROL_ENTER, NULL);
+    event_loop_post(&g_event_loop, &event);
 }
 
 static void parse_arguments(int argc, char **argv)
@@ -217,6 +222,12 @@ static void parse_arguments(int argc, char **argv)
             char *val = i < argc - 1 ? argv[++i] : NULL;
             if (!val) error("limelight: option '%s|%s' requires an argument!\n", CONFIG_OPT_LONG, CONFIG_OPT_SHRT);
             snprintf(g_config_file, sizeof(g_config_file), "%s", val);
+        } else if ((string_equals(opt, WORKERS_OPT_LONG)) ||
+                   (string_equals(opt, WORKERS_OPT_SHRT))) {
+            char *val = i < argc - 1 ? argv[++i] : NULL;
+            if (!val) error("limelight: option '%s|%s' requires an argument!\n", WORKERS_OPT_LONG, WORKERS_OPT_SHRT);
+            g_worker_count = atoi(val);
+            if (g_worker_count < 0 || g_worker_count > EVENT_WORKER_MAX) error("limelight: option '%s|%s' must be between 0 and %d!\n", WORKERS_OPT_LONG, WORKERS_OPT_SHRT, EVENT_WORKER_MAX);
         } else {
             error("limelight: '%s' is not a valid option!\n", opt);
         }
@@ -248,16 +259,46 @@ int main(int argc, char **argv)
     workspace_event_handler_init(&g_workspace_context);
     window_manager_init(&g_window_manager);
 
-    event_loop_begin(&g_event_loop);
+    //
+    // NOTE(koekeishiya): window_manager_begin runs on the main thread and takes its scratch memory
+    // from the event loop arena (see event_loop_scratch). This is only safe while the event loop
+    // thread is not running, so it has to happen before event_loop_begin, which resets the arena
+    // before it starts the thread.
+    //
+
     window_manager_begin(&g_window_manager);
-    process_manager_begin(&g_process_manager);
-    workspace_event_handler_begin(&g_workspace_context);
-    SLSRegisterConnectionNotifyProc(g_connection, connection_handler, 1204, NULL);
+    g_event_loop.on_batch_begin = border_batch_begin;
+    g_event_loop.on_batch_end = border_batch_end;
+    g_event_loop.worker_count = g_worker_count;
 
-    if (!socket_daemon_begin_un(&g_daemon, g_socket_file, message_handler)) {
+    if (!socket_daemon_listen_un(&g_daemon, g_socket_file, message_handler) ||
+        !event_loop_watch(&g_event_loop, g_daemon.sockfd, message_connection_accept, &g_daemon)) {
         error("limelight: could not initialize daemon! abort..\n");
     }
 
+    event_loop_begin(&g_event_loop);
+
+    //
+    // NOTE(koekeishiya): The focused window is looked up by the event loop thread, which owns the
+    // focus state from here on. We wait for it before we subscribe to process and workspace
+    // notifications and run the config file, so that neither can observe the daemon before it
+    // knows which window is focused. A focused application that does not answer AX requests must
+    // not keep the daemon from starting, so the wait is bounded; the event is still handled
+    // whenever the application gets around to answering.
+    //
+
+    struct event event = event_create(DAEMON_STARTED, NULL);
+    uint32_t info = event_loop_post_and_wait(&g_event_loop, &event, DAEMON_STARTED_TIMEOUT_MS);
+    if (info == EVENT_ABANDONED) {
+        debug("limelight: the focused window was not found within %dms, continuing..\n", DAEMON_STARTED_TIMEOUT_MS);
+    } else if (event_status(info) == EVENT_FAILURE) {
+        debug("limelight: could not find the focused window..\n");
+    }
+
+    process_manager_begin(&g_process_manager);
+    workspace_event_handler_begin(&g_workspace_context);
+    SLSRegisterConnectionNotifyProc(g_connection, connection_handler, 1204, NULL);
+
     exec_config_file();
     CFRunLoopRun();
     return 0;
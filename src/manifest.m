@@ -7,6 +7,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <string.h>
 #include <dirent.h>
 #include <stdbool.h>
@@ -18,22 +19,28 @@
 #include <unistd.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
-#include <semaphore.h>
 #include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <os/lock.h>
 
 #include "misc/macros.h"
+#include "misc/probe.h"
 #include "misc/notify.h"
 #include "misc/log.h"
 #include "misc/helpers.h"
 #include "misc/memory_pool.h"
-#define HASHTABLE_IMPLEMENTATION
+#include "misc/eventcount.h"
+#include "misc/poller.h"
+#include "misc/timer_wheel.h"
+#include "misc/histogram.h"
+#include "misc/trace.h"
 #include "misc/hashtable.h"
-#undef HASHTABLE_IMPLEMENTATION
 #include "misc/socket.h"
 #include "misc/socket.c"
 
-#include "event_loop.h"
 #include "event.h"
+#include "event_loop.h"
 #include "workspace.h"
 #include "message.h"
 #include "border.h"
@@ -2,9 +2,11 @@
 
 extern struct event_loop g_event_loop;
 extern struct window_manager g_window_manager;
+extern struct process_manager g_process_manager;
 extern bool g_verbose;
 
 #define DOMAIN_CONFIG  "config"
+#define DOMAIN_QUERY   "query"
 
 /* --------------------------------DOMAIN CONFIG-------------------------------- */
 #define COMMAND_CONFIG_DEBUG_OUTPUT          "debug_output"
@@ -13,12 +15,19 @@ extern bool g_verbose;
 #define COMMAND_CONFIG_BORDER_ACTIVE_COLOR   "active_color"
 #define COMMAND_CONFIG_BORDER_NORMAL_COLOR   "normal_color"
 #define COMMAND_CONFIG_BORDER_PLACEMENT      "placement"
+#define COMMAND_CONFIG_TRACE                 "trace"
+#define COMMAND_CONFIG_WATCHDOG              "watchdog"
 
 #define ARGUMENT_CONFIG_BORDER_PLACEMENT_EXT "exterior"
 #define ARGUMENT_CONFIG_BORDER_PLACEMENT_INT "interior"
 #define ARGUMENT_CONFIG_BORDER_PLACEMENT_IS  "inset"
 /* ----------------------------------------------------------------------------- */
 
+/* --------------------------------DOMAIN QUERY--------------------------------- */
+#define COMMAND_QUERY_STATS                  "stats"
+#define COMMAND_QUERY_TRACE                  "trace"
+/* ----------------------------------------------------------------------------- */
+
 /* --------------------------------COMMON ARGUMENTS----------------------------- */
 #define ARGUMENT_COMMON_VAL_ON     "on"
 #define ARGUMENT_COMMON_VAL_OFF    "off"
@@ -187,6 +196,62 @@ static void handle_domain_config(FILE *rsp, struct token domain, char *message)
         } else {
             daemon_fail(rsp, "unknown value '%.*s' given to command '%.*s' for domain '%.*s'\n", value.length, value.text, command.length, command.text, domain.length, domain.text);
         }
+    } else if (token_equals(command, COMMAND_CONFIG_TRACE)) {
+        struct token value = get_token(&message);
+        if (!token_is_valid(value)) {
+            fprintf(rsp, "%s\n", bool_str[g_event_loop.trace.enabled]);
+        } else if (token_equals(value, ARGUMENT_COMMON_VAL_OFF)) {
+            g_event_loop.trace.enabled = false;
+        } else if (token_equals(value, ARGUMENT_COMMON_VAL_ON)) {
+            g_event_loop.trace.enabled = true;
+        } else {
+            daemon_fail(rsp, "unknown value '%.*s' given to command '%.*s' for domain '%.*s'\n", value.length, value.text, command.length, command.text, domain.length, domain.text);
+        }
+    } else if (token_equals(command, COMMAND_CONFIG_WATCHDOG)) {
+        struct token value = get_token(&message);
+        if (!token_is_valid(value)) {
+            fprintf(rsp, "%d\n", g_event_loop.watchdog_budget_ms);
+        } else if (token_equals(value, ARGUMENT_COMMON_VAL_OFF)) {
+            event_loop_set_watchdog_budget(&g_event_loop, 0);
+        } else {
+            int budget = 0;
+            if (token_to_int(value, &budget) && budget > 0) {
+                event_loop_set_watchdog_budget(&g_event_loop, budget);
+            } else {
+                daemon_fail(rsp, "unknown value '%.*s' given to command '%.*s' for domain '%.*s'\n", value.length, value.text, command.length, command.text, domain.length, domain.text);
+            }
+        }
+    } else {
+        daemon_fail(rsp, "unknown command '%.*s' for domain '%.*s'\n", command.length, command.text, domain.length, domain.text);
+    }
+}
+
+static void serialize_slab(FILE *rsp, const char *name, struct memory_slab *slab)
+{
+    fprintf(rsp, "%s_slab_live: %" PRIu64 "\n", name, slab->live);
+    fprintf(rsp, "%s_slab_live_max: %" PRIu64 "\n", name, slab->high_water);
+    fprintf(rsp, "%s_slab_overflow: %" PRIu64 "\n", name, slab->overflow);
+}
+
+static void handle_domain_query(FILE *rsp, struct token domain, char *message)
+{
+    struct token command = get_token(&message);
+    if (token_equals(command, COMMAND_QUERY_STATS)) {
+        event_loop_serialize(rsp, &g_event_loop);
+        serialize_slab(rsp, "process", &g_process_manager.process_slab);
+        serialize_slab(rsp, "application", &g_window_manager.application_slab);
+        serialize_slab(rsp, "window", &g_window_manager.window_slab);
+    } else if (token_equals(command, COMMAND_QUERY_TRACE)) {
+        struct token value = get_token(&message);
+        if (!token_is_valid(value)) {
+            daemon_fail(rsp, "command '%.*s' for domain '%.*s' requires a file path\n", command.length, command.text, domain.length, domain.text);
+        } else {
+            char *path = token_to_string(value);
+            if (!event_loop_dump_trace(&g_event_loop, path)) {
+                daemon_fail(rsp, "could not write trace to '%s'\n", path);
+            }
+            free(path);
+        }
     } else {
         daemon_fail(rsp, "unknown command '%.*s' for domain '%.*s'\n", command.length, command.text, domain.length, domain.text);
     }
@@ -197,6 +262,8 @@ void handle_message(FILE *rsp, char *message)
     struct token domain = get_token(&message);
     if (token_equals(domain, DOMAIN_CONFIG)) {
         handle_domain_config(rsp, domain, message);
+    } else if (token_equals(domain, DOMAIN_QUERY)) {
+        handle_domain_query(rsp, domain, message);
     } else {
         daemon_fail(rsp, "unknown domain '%.*s'\n", domain.length, domain.text);
     }
@@ -204,6 +271,92 @@ void handle_message(FILE *rsp, char *message)
 
 static SOCKET_DAEMON_HANDLER(message_handler)
 {
-    struct event *event = event_create_p1(&g_event_loop, DAEMON_MESSAGE, message, sockfd);
-    event_loop_post(&g_event_loop, event);
+    struct event event = event_create_p1(DAEMON_MESSAGE, message, sockfd);
+    event_loop_post(&g_event_loop, &event);
+}
+
+//
+// NOTE(koekeishiya): The daemon socket is served by the event loop thread itself, which watches
+// the listening socket and every client that has not finished sending its message yet. Clients
+// are read without blocking, so a client that is slow to send its message (or never does) does
+// not hold up other clients or events. A complete message is handed to the daemon handler.
+//
+// A connection is always unwatched before its descriptor is closed, so that the poller is never
+// asked to remove a descriptor that is closed, or has already been reused for another client.
+//
+// Every connection gets a deadline of SOCKET_CONNECTION_TIMEOUT_MS to send its message, after
+// which DAEMON_MESSAGE_TIMEOUT closes it, so that a stalled client can not keep its descriptor
+// and buffer forever. At most SOCKET_CONNECTION_MAX clients are read at once; further clients
+// are closed right away until one of them is done.
+//
+
+static int g_connection_count;
+
+static void message_connection_close(struct socket_connection *connection)
+{
+    event_loop_unwatch(&g_event_loop, connection->sockfd);
+    --g_connection_count;
+    free(connection);
+}
+
+void message_connection_expire(struct socket_connection *connection)
+{
+    debug("%s: connection %d did not send a message in time, closing..\n", __FUNCTION__, connection->sockfd);
+
+    int sockfd = connection->sockfd;
+    if (connection->message) free(connection->message);
+    message_connection_close(connection);
+    socket_close(sockfd);
+}
+
+static EVENT_LOOP_WATCH_CALLBACK(message_connection_read)
+{
+    struct socket_connection *connection = context;
+    if (!socket_connection_read(connection)) return;
+
+    event_loop_cancel(&g_event_loop, connection->timer);
+
+    char *message = connection->message;
+    int length = connection->length;
+    message_connection_close(connection);
+
+    if (message) {
+        g_daemon.handler(message, length, fd);
+    } else {
+        socket_close(fd);
+    }
+}
+
+static EVENT_LOOP_WATCH_CALLBACK(message_connection_accept)
+{
+    struct daemon *daemon = context;
+
+    int sockfd;
+    while ((sockfd = socket_daemon_accept(daemon)) != -1) {
+        if (g_connection_count == SOCKET_CONNECTION_MAX) goto err;
+
+        struct socket_connection *connection = malloc(sizeof(struct socket_connection));
+        if (!connection) goto err;
+
+        memset(connection, 0, sizeof(struct socket_connection));
+        connection->sockfd = sockfd;
+
+        if (!event_loop_watch(&g_event_loop, sockfd, message_connection_read, connection)) {
+            free(connection);
+            goto err;
+        }
+
+        ++g_connection_count;
+
+        struct event event = event_create(DAEMON_MESSAGE_TIMEOUT, connection);
+        connection->timer = event_loop_post_after(&g_event_loop, &event, SOCKET_CONNECTION_TIMEOUT_MS);
+        if (!connection->timer) {
+            message_connection_close(connection);
+            goto err;
+        }
+
+        continue;
+err:
+        socket_close(sockfd);
+    }
 }
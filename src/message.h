@@ -8,6 +8,8 @@ struct token
 };
 
 static SOCKET_DAEMON_HANDLER(message_handler);
+static EVENT_LOOP_WATCH_CALLBACK(message_connection_accept);
+void message_connection_expire(struct socket_connection *connection);
 void handle_message(FILE *rsp, char *message);
 
 #endif
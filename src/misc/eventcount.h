@@ -0,0 +1,121 @@
+#ifndef EVENTCOUNT_H
+#define EVENTCOUNT_H
+
+#ifdef __APPLE__
+#define UL_COMPARE_AND_WAIT 1
+#define ULF_NO_ERRNO        0x01000000
+extern int __ulock_wait(uint32_t operation, void *addr, uint64_t value, uint32_t timeout);
+extern int __ulock_wake(uint32_t operation, void *addr, uint64_t wake_value);
+#elif defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __asm__ __volatile__ ("pause" ::: "memory")
+#elif defined(__aarch64__) || defined(__arm__)
+#define cpu_relax() __asm__ __volatile__ ("yield" ::: "memory")
+#else
+#define cpu_relax() __asm__ __volatile__ ("" ::: "memory")
+#endif
+
+#define EVENTCOUNT_SPIN_COUNT 256
+#define EVENTCOUNT_PARKED     0x1
+
+//
+// NOTE(koekeishiya): Parking primitive for a single consumer. The low bit of 'state' is set while
+// the consumer is parked (or about to park), and the remaining bits form an epoch that a producer
+// bumps when it wakes the consumer. Producers only make a syscall when they observe the parked
+// bit, so a burst of posts costs a single wake-up instead of one syscall per post.
+//
+// Consumer:                                        Producer:
+//     key = eventcount_prepare(ec);                    publish work;
+//     if (work is available) eventcount_cancel(ec);    eventcount_signal(ec);
+//     else eventcount_wait(ec, key);
+//
+// eventcount_wait_timeout gives up after the given number of nanoseconds, and always leaves the
+// parked bit cleared, whether it was woken up or not.
+//
+
+struct eventcount
+{
+    volatile uint32_t state;
+};
+
+static inline void eventcount_init(struct eventcount *ec)
+{
+    ec->state = 0;
+}
+
+static inline void eventcount_futex_wait(volatile uint32_t *addr, uint32_t value, uint64_t timeout_ns)
+{
+#ifdef __APPLE__
+    uint64_t timeout_us = (timeout_ns + 999) / 1000;
+    if (timeout_us > UINT32_MAX) timeout_us = UINT32_MAX;
+    __ulock_wait(UL_COMPARE_AND_WAIT | ULF_NO_ERRNO, (void *) addr, value, (uint32_t) timeout_us);
+#elif defined(__linux__)
+    struct timespec timeout = { .tv_sec = timeout_ns / 1000000000, .tv_nsec = timeout_ns % 1000000000 };
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, value, timeout_ns ? &timeout : NULL, NULL, 0);
+#endif
+}
+
+static inline void eventcount_futex_wake(volatile uint32_t *addr)
+{
+#ifdef __APPLE__
+    __ulock_wake(UL_COMPARE_AND_WAIT | ULF_NO_ERRNO, (void *) addr, 0);
+#elif defined(__linux__)
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#endif
+}
+
+static inline uint32_t eventcount_prepare(struct eventcount *ec)
+{
+    return __sync_fetch_and_or(&ec->state, EVENTCOUNT_PARKED) | EVENTCOUNT_PARKED;
+}
+
+static inline void eventcount_cancel(struct eventcount *ec)
+{
+    __sync_fetch_and_and(&ec->state, ~EVENTCOUNT_PARKED);
+}
+
+static inline void eventcount_wait(struct eventcount *ec, uint32_t key)
+{
+    while (ec->state == key) {
+        eventcount_futex_wait(&ec->state, key, 0);
+    }
+}
+
+static inline void eventcount_wait_timeout(struct eventcount *ec, uint32_t key, uint64_t timeout_ns)
+{
+    if (ec->state == key) {
+        eventcount_futex_wait(&ec->state, key, timeout_ns);
+    }
+
+    eventcount_cancel(ec);
+}
+
+//
+// NOTE(koekeishiya): eventcount_notify does the bookkeeping of eventcount_signal, and returns true
+// if the consumer has to be woken up. A consumer that parks somewhere other than the eventcount
+// itself (such as in a poller) uses this, and wakes itself through that instead.
+//
+
+static inline bool eventcount_notify(struct eventcount *ec)
+{
+    __sync_synchronize();
+
+    uint32_t state = ec->state;
+    if (!(state & EVENTCOUNT_PARKED)) return false;
+
+    return __sync_bool_compare_and_swap(&ec->state, state, (state + 2) & ~EVENTCOUNT_PARKED);
+}
+
+static inline void eventcount_signal(struct eventcount *ec)
+{
+    if (eventcount_notify(ec)) {
+        eventcount_futex_wake(&ec->state);
+    }
+}
+
+#endif
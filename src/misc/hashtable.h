@@ -1,147 +1,337 @@
 #ifndef HASHTABLE_H
 #define HASHTABLE_H
 
-#define TABLE_HASH_FUNC(name) unsigned long name(void *key)
-typedef TABLE_HASH_FUNC(table_hash_func);
+#define TABLE_REHASH_STEP 4
 
-#define TABLE_COMPARE_FUNC(name) int name(void *key_a, void *key_b)
-typedef TABLE_COMPARE_FUNC(table_compare_func);
-
-struct bucket
-{
-    void *key;
-    void *value;
-    struct bucket *next;
-};
-struct table
+static inline uint32_t table_hash_integer(uint64_t key)
 {
-    int count;
-    int capacity;
-    float max_load;
-    table_hash_func *hash;
-    table_compare_func *cmp;
-    struct bucket **buckets;
-};
-
-void table_init(struct table *table, int capacity, table_hash_func hash, table_compare_func cmp);
-void table_free(struct table *table);
-
-#define table_add(table, key, value) _table_add(table, key, sizeof(*key), value)
-void _table_add(struct table *table, void *key, int key_size, void *value);
-void table_remove(struct table *table, void *key);
-void *table_find(struct table *table, void *key);
-
-#endif
-
-#ifdef HASHTABLE_IMPLEMENTATION
-void table_init(struct table *table, int capacity, table_hash_func hash, table_compare_func cmp)
-{
-    table->count = 0;
-    table->capacity = capacity;
-    table->max_load = 0.75f;
-    table->hash = hash;
-    table->cmp = cmp;
-    table->buckets = malloc(sizeof(struct bucket *) * capacity);
-    memset(table->buckets, 0, sizeof(struct bucket *) * capacity);
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (uint32_t) key;
 }
 
-void table_free(struct table *table)
-{
-    for (int i = 0; i < table->capacity; ++i) {
-        struct bucket *next, *bucket = table->buckets[i];
-        while (bucket) {
-            next = bucket->next;
-            free(bucket->key);
-            free(bucket);
-            bucket = next;
-        }
-    }
+//
+// NOTE(koekeishiya): Hashtables for integer keys, using open addressing with robin hood probing.
+// The slot capacity is always a power of two. A slot with a distance of 0 is empty, otherwise it
+// is the probe length + 1. Removal uses backward shift deletion; every following entry that is
+// not already in its home slot is pulled one step closer, so that we never need tombstones.
+// Keys are stored by value and the hash and compare are inlined at the call-site.
+//
+// Growing the slot array is incremental; the previous array is kept around and a bounded number
+// of entries are migrated on every add and remove, so that a single insertion never pays for
+// re-inserting the entire table. Lookups check the new array first and then the old one. Every
+// slot below rehash_index in the old array is empty, because we only advance past a slot once it
+// has been emptied, and a backward shift can never wrap around into a slot that we have already
+// visited. Entries can therefore be migrated in any number of steps.
+//
+// The entries are kept in a dense array in insertion order, and the robin hood slots only map a
+// key to its index in that array, so that a sweep over the whole table with table_foreach touches
+// count entries of sequential memory. Removing an entry moves the last entry into its place, so
+// the table must not be modified while it is being iterated.
+//
+// Growing the entries array is incremental as well; a new array is allocated but not filled, and
+// the entries below old_entry_count that have not yet been copied are still read from the previous
+// array. Entries are copied in order, a few at a time on every add and remove, so an index is in
+// the old array when it is at or above migrate_index and below old_entry_count. Entries must be
+// accessed through table_entry for that reason. The migration is done long before the next grow,
+// because the table has to gain old_entry_count entries first.
+//
+// An add that needs to grow either array returns false if the allocation fails, and leaves the
+// table as it was. The slots are allowed to go past their load factor when only the slot array
+// could not be grown, for as long as there is room; a later add will try again.
+//
+// TABLE_DEFINE(window_table, uint32_t, struct window *) generates struct window_table,
+// struct window_table_entry and window_table_init, window_table_free, window_table_reserve,
+// window_table_find, window_table_add and window_table_remove.
+//
 
-    if (table->buckets) {
-        free(table->buckets);
-        table->buckets = NULL;
-    }
-}
+#define table_entry(table, index) \
+    ((index) >= (table)->migrate_index && (index) < (table)->old_entry_count \
+     ? (table)->old_entries + (index) : (table)->entries + (index))
 
-static struct bucket **
-table_get_bucket(struct table *table, void *key)
-{
-    struct bucket **bucket = table->buckets + (table->hash(key) % table->capacity);
-    while (*bucket) {
-        if (table->cmp((*bucket)->key, key)) {
-            break;
-        }
-        bucket = &(*bucket)->next;
-    }
-    return bucket;
-}
+#define table_foreach(entry, table) \
+    for (int table__index = 0; table__index < (table)->count && ((entry) = table_entry(table, table__index)); ++table__index)
 
-static void
-table_rehash(struct table *table)
-{
-    struct bucket **old_buckets = table->buckets;
-    int old_capacity = table->capacity;
-
-    table->count = 0;
-    table->capacity = 2 * table->capacity;
-    table->buckets = malloc(sizeof(struct bucket *) * table->capacity);
-    memset(table->buckets, 0, sizeof(struct bucket *) * table->capacity);
-
-    for (int i = 0; i < old_capacity; ++i) {
-        struct bucket *next_bucket, *old_bucket = old_buckets[i];
-        while (old_bucket) {
-            struct bucket **new_bucket = table_get_bucket(table, old_bucket->key);
-            *new_bucket = malloc(sizeof(struct bucket));
-            (*new_bucket)->key = old_bucket->key;
-            (*new_bucket)->value = old_bucket->value;
-            (*new_bucket)->next = NULL;
-            ++table->count;
-            next_bucket = old_bucket->next;
-            free(old_bucket);
-            old_bucket = next_bucket;
-        }
-    }
-
-    free(old_buckets);
-}
-
-void _table_add(struct table *table, void *key, int key_size, void *value)
-{
-    struct bucket **bucket = table_get_bucket(table, key);
-    if (*bucket) {
-        if (!(*bucket)->value) {
-            (*bucket)->value = value;
-        }
-    } else {
-        *bucket = malloc(sizeof(struct bucket));
-        (*bucket)->key = malloc(key_size);
-        (*bucket)->value = value;
-        memcpy((*bucket)->key, key, key_size);
-        (*bucket)->next = NULL;
-        ++table->count;
-
-        float load = (1.0f * table->count) / table->capacity;
-        if (load > table->max_load) {
-            table_rehash(table);
-        }
-    }
-}
-
-void table_remove(struct table *table, void *key)
-{
-    struct bucket *next, **bucket = table_get_bucket(table, key);
-    if (*bucket) {
-        free((*bucket)->key);
-        next = (*bucket)->next;
-        free(*bucket);
-        *bucket = next;
-        --table->count;
-    }
+#define TABLE_DEFINE(name, key_type, value_type)                                                     \
+struct name##_entry                                                                                  \
+{                                                                                                    \
+    key_type key;                                                                                    \
+    value_type value;                                                                                \
+};                                                                                                   \
+struct name##_slot                                                                                   \
+{                                                                                                    \
+    uint32_t distance;                                                                               \
+    int index;                                                                                       \
+    key_type key;                                                                                    \
+};                                                                                                   \
+struct name                                                                                          \
+{                                                                                                    \
+    int count;                                                                                       \
+    int capacity;                                                                                    \
+    struct name##_entry *entries;                                                                    \
+    int old_entry_count;                                                                             \
+    struct name##_entry *old_entries;                                                                \
+    int migrate_index;                                                                               \
+    int slot_capacity;                                                                               \
+    struct name##_slot *slots;                                                                       \
+    int old_slot_capacity;                                                                           \
+    struct name##_slot *old_slots;                                                                   \
+    int rehash_index;                                                                                \
+};                                                                                                   \
+                                                                                                     \
+static inline void name##_init(struct name *table, int capacity)                                     \
+{                                                                                                    \
+    table->count = 0;                                                                                \
+    table->capacity = capacity > 8 ? capacity : 8;                                                   \
+    table->entries = malloc(sizeof(struct name##_entry) * table->capacity);                          \
+    table->old_entry_count = 0;                                                                      \
+    table->old_entries = NULL;                                                                       \
+    table->migrate_index = 0;                                                                        \
+    table->slot_capacity = 8;                                                                        \
+    while (4 * table->capacity >= 3 * table->slot_capacity) table->slot_capacity <<= 1;              \
+    table->slots = calloc(table->slot_capacity, sizeof(struct name##_slot));                         \
+    table->old_slot_capacity = 0;                                                                    \
+    table->old_slots = NULL;                                                                         \
+    table->rehash_index = 0;                                                                         \
+}                                                                                                    \
+                                                                                                     \
+static inline void name##_free(struct name *table)                                                   \
+{                                                                                                    \
+    if (table->entries) {                                                                            \
+        free(table->entries);                                                                        \
+        table->entries = NULL;                                                                       \
+    }                                                                                                \
+                                                                                                     \
+    if (table->old_entries) {                                                                        \
+        free(table->old_entries);                                                                    \
+        table->old_entries = NULL;                                                                   \
+        table->old_entry_count = 0;                                                                  \
+    }                                                                                                \
+                                                                                                     \
+    if (table->slots) {                                                                              \
+        free(table->slots);                                                                          \
+        table->slots = NULL;                                                                         \
+    }                                                                                                \
+                                                                                                     \
+    if (table->old_slots) {                                                                          \
+        free(table->old_slots);                                                                      \
+        table->old_slots = NULL;                                                                     \
+    }                                                                                                \
+}                                                                                                    \
+                                                                                                     \
+static inline struct name##_slot *                                                                   \
+name##_probe(struct name##_slot *slots, int capacity, key_type key)                                  \
+{                                                                                                    \
+    int mask = capacity - 1;                                                                         \
+    uint32_t distance = 1;                                                                           \
+                                                                                                     \
+    for (int index = table_hash_integer(key) & mask;; index = (index + 1) & mask, ++distance) {      \
+        struct name##_slot *slot = slots + index;                                                    \
+        if (slot->distance < distance) return NULL;                                                  \
+        if (slot->key == key) return slot;                                                           \
+    }                                                                                                \
+}                                                                                                    \
+                                                                                                     \
+static inline struct name##_slot *name##_get_slot(struct name *table, key_type key)                  \
+{                                                                                                    \
+    struct name##_slot *slot = name##_probe(table->slots, table->slot_capacity, key);                \
+    if (!slot && table->old_slots) {                                                                 \
+        slot = name##_probe(table->old_slots, table->old_slot_capacity, key);                        \
+    }                                                                                                \
+    return slot;                                                                                     \
+}                                                                                                    \
+                                                                                                     \
+static inline void name##_insert_slot(struct name *table, struct name##_slot entry)                  \
+{                                                                                                    \
+    int mask = table->slot_capacity - 1;                                                             \
+    entry.distance = 1;                                                                              \
+                                                                                                     \
+    for (int index = table_hash_integer(entry.key) & mask;; index = (index + 1) & mask, ++entry.distance) { \
+        struct name##_slot *slot = table->slots + index;                                             \
+                                                                                                     \
+        if (!slot->distance) {                                                                       \
+            *slot = entry;                                                                           \
+            return;                                                                                  \
+        }                                                                                            \
+                                                                                                     \
+        if (slot->distance < entry.distance) {                                                       \
+            struct name##_slot temp = *slot;                                                         \
+            *slot = entry;                                                                           \
+            entry = temp;                                                                            \
+        }                                                                                            \
+    }                                                                                                \
+}                                                                                                    \
+                                                                                                     \
+static inline void name##_delete_slot(struct name##_slot *slots, int capacity, int index)            \
+{                                                                                                    \
+    int mask = capacity - 1;                                                                         \
+                                                                                                     \
+    for (;;) {                                                                                       \
+        struct name##_slot *next = slots + ((index + 1) & mask);                                     \
+        if (next->distance <= 1) break;                                                              \
+                                                                                                     \
+        slots[index] = *next;                                                                        \
+        --slots[index].distance;                                                                     \
+        index = (index + 1) & mask;                                                                  \
+    }                                                                                                \
+                                                                                                     \
+    memset(slots + index, 0, sizeof(struct name##_slot));                                            \
+}                                                                                                    \
+                                                                                                     \
+static inline void name##_rehash_step(struct name *table, int count)                                 \
+{                                                                                                    \
+    if (!table->old_slots) return;                                                                   \
+                                                                                                     \
+    int visits = 4 * count;                                                                          \
+    while (count > 0 && visits-- > 0 && table->rehash_index < table->old_slot_capacity) {            \
+        struct name##_slot *slot = table->old_slots + table->rehash_index;                           \
+        if (slot->distance) {                                                                        \
+            name##_insert_slot(table, *slot);                                                        \
+            name##_delete_slot(table->old_slots, table->old_slot_capacity, table->rehash_index);     \
+            --count;                                                                                 \
+        } else {                                                                                     \
+            ++table->rehash_index;                                                                   \
+        }                                                                                            \
+    }                                                                                                \
+                                                                                                     \
+    if (table->rehash_index == table->old_slot_capacity) {                                           \
+        free(table->old_slots);                                                                      \
+        table->old_slots = NULL;                                                                     \
+        table->old_slot_capacity = 0;                                                                \
+        table->rehash_index = 0;                                                                     \
+    }                                                                                                \
+}                                                                                                    \
+                                                                                                     \
+static inline bool name##_rehash(struct name *table, int capacity)                                   \
+{                                                                                                    \
+    struct name##_slot *slots = calloc(capacity, sizeof(struct name##_slot));                        \
+    if (!slots) return false;                                                                        \
+                                                                                                     \
+    while (table->old_slots) name##_rehash_step(table, table->count + 1);                            \
+                                                                                                     \
+    table->old_slots = table->slots;                                                                 \
+    table->old_slot_capacity = table->slot_capacity;                                                 \
+    table->rehash_index = 0;                                                                         \
+                                                                                                     \
+    table->slot_capacity = capacity;                                                                 \
+    table->slots = slots;                                                                            \
+    return true;                                                                                     \
+}                                                                                                    \
+                                                                                                     \
+static inline void name##_migrate_step(struct name *table, int count)                                \
+{                                                                                                    \
+    if (!table->old_entries) return;                                                                 \
+                                                                                                     \
+    int end = table->migrate_index + count;                                                          \
+    if (end > table->old_entry_count) end = table->old_entry_count;                                  \
+                                                                                                     \
+    int live = end < table->count ? end : table->count;                                              \
+    if (live > table->migrate_index) {                                                               \
+        memcpy(table->entries + table->migrate_index,                                                \
+               table->old_entries + table->migrate_index,                                            \
+               sizeof(struct name##_entry) * (live - table->migrate_index));                         \
+    }                                                                                                \
+    table->migrate_index = end;                                                                      \
+                                                                                                     \
+    if (table->migrate_index == table->old_entry_count) {                                            \
+        free(table->old_entries);                                                                    \
+        table->old_entries = NULL;                                                                   \
+        table->old_entry_count = 0;                                                                  \
+        table->migrate_index = 0;                                                                    \
+    }                                                                                                \
+}                                                                                                    \
+                                                                                                     \
+static inline bool name##_grow(struct name *table, int capacity)                                     \
+{                                                                                                    \
+    struct name##_entry *entries = malloc(sizeof(struct name##_entry) * capacity);                   \
+    if (!entries) return false;                                                                      \
+                                                                                                     \
+    while (table->old_entries) name##_migrate_step(table, table->old_entry_count);                   \
+                                                                                                     \
+    table->old_entries = table->entries;                                                             \
+    table->old_entry_count = table->count;                                                           \
+    table->migrate_index = 0;                                                                        \
+                                                                                                     \
+    table->capacity = capacity;                                                                      \
+    table->entries = entries;                                                                        \
+    return true;                                                                                     \
+}                                                                                                    \
+                                                                                                     \
+static inline bool name##_reserve(struct name *table, int count)                                     \
+{                                                                                                    \
+    if (count > table->capacity && !name##_grow(table, count)) return false;                         \
+    while (table->old_entries) name##_migrate_step(table, table->old_entry_count);                   \
+                                                                                                     \
+    int capacity = table->slot_capacity;                                                             \
+    while (4 * count >= 3 * capacity) capacity <<= 1;                                                \
+    if (capacity == table->slot_capacity) return true;                                               \
+                                                                                                     \
+    if (!name##_rehash(table, capacity)) return false;                                               \
+    while (table->old_slots) name##_rehash_step(table, table->count + 1);                            \
+    return true;                                                                                     \
+}                                                                                                    \
+                                                                                                     \
+static inline value_type name##_find(struct name *table, key_type key)                               \
+{                                                                                                    \
+    struct name##_slot *slot = name##_get_slot(table, key);                                          \
+    return slot ? table_entry(table, slot->index)->value : (value_type) 0;                                \
+}                                                                                                    \
+                                                                                                     \
+static inline bool name##_add(struct name *table, key_type key, value_type value)                    \
+{                                                                                                    \
+    name##_rehash_step(table, TABLE_REHASH_STEP);                                                    \
+    name##_migrate_step(table, TABLE_REHASH_STEP);                                                   \
+                                                                                                     \
+    struct name##_slot *slot = name##_get_slot(table, key);                                          \
+    if (slot) {                                                                                      \
+        struct name##_entry *entry = table_entry(table, slot->index);                                \
+        if (!entry->value) entry->value = value;                                                     \
+        return true;                                                                                 \
+    }                                                                                                \
+                                                                                                     \
+    if (table->count == table->capacity && !name##_grow(table, 2 * table->capacity)) {               \
+        return false;                                                                                \
+    }                                                                                                \
+                                                                                                     \
+    if (4 * (table->count + 1) > 3 * table->slot_capacity &&                                         \
+        !name##_rehash(table, 2 * table->slot_capacity) &&                                           \
+        table->count + 1 >= table->slot_capacity) {                                                  \
+        return false;                                                                                \
+    }                                                                                                \
+                                                                                                     \
+    struct name##_slot entry = { .index = table->count, .key = key };                                \
+    name##_insert_slot(table, entry);                                                                \
+                                                                                                     \
+    table_entry(table, table->count)->key = key;                                                     \
+    table_entry(table, table->count)->value = value;                                                 \
+    ++table->count;                                                                                  \
+    return true;                                                                                     \
+}                                                                                                    \
+                                                                                                     \
+static inline void name##_remove(struct name *table, key_type key)                                   \
+{                                                                                                    \
+    name##_rehash_step(table, TABLE_REHASH_STEP);                                                    \
+    name##_migrate_step(table, TABLE_REHASH_STEP);                                                   \
+                                                                                                     \
+    int index;                                                                                       \
+    struct name##_slot *slot = name##_probe(table->slots, table->slot_capacity, key);                \
+                                                                                                     \
+    if (slot) {                                                                                      \
+        index = slot->index;                                                                         \
+        name##_delete_slot(table->slots, table->slot_capacity, slot - table->slots);                 \
+    } else if (table->old_slots && (slot = name##_probe(table->old_slots, table->old_slot_capacity, key))) { \
+        index = slot->index;                                                                         \
+        name##_delete_slot(table->old_slots, table->old_slot_capacity, slot - table->old_slots);     \
+    } else {                                                                                         \
+        return;                                                                                      \
+    }                                                                                                \
+                                                                                                     \
+    if (index != --table->count) {                                                                   \
+        struct name##_entry *last = table_entry(table, table->count);                                \
+        *table_entry(table, index) = *last;                                                          \
+        name##_get_slot(table, last->key)->index = index;                                            \
+    }                                                                                                \
 }
 
-void *table_find(struct table *table, void *key)
-{
-    struct bucket *bucket = *table_get_bucket(table, key);
-    return bucket ? bucket->value : NULL;
-}
 #endif
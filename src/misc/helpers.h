@@ -25,6 +25,34 @@ struct rgba_color rgba_color_from_hex(uint32_t color)
     return result;
 }
 
+static inline uint64_t time_monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+//
+// NOTE(koekeishiya): AX reads go through here so that the ax__begin and ax__end probes can time
+// them; the probe argument is the name of the attribute constant, e.g. "kAXSizeAttribute".
+// g_ax_call_count counts the reads made by the calling thread; the event loop attributes them
+// to the type of the event whose handler made them.
+//
+
+static __thread uint64_t g_ax_call_count;
+
+#define ax_copy_attribute_value(element, attribute, value) \
+    ax_copy_attribute_value_(element, attribute, #attribute, value)
+
+static inline AXError ax_copy_attribute_value_(AXUIElementRef element, CFStringRef attribute, const char *name, CFTypeRef *value)
+{
+    ++g_ax_call_count;
+    probe1(ax__begin, name);
+    AXError result = AXUIElementCopyAttributeValue(element, attribute, value);
+    probe2(ax__end, name, result);
+    return result;
+}
+
 static inline bool is_root(void)
 {
     return getuid() == 0 || geteuid() == 0;
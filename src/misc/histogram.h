@@ -0,0 +1,90 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#define HISTOGRAM_SUB_BITS     3
+#define HISTOGRAM_SUB_COUNT    (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_MAX_EXPONENT 40
+#define HISTOGRAM_BUCKET_COUNT ((HISTOGRAM_MAX_EXPONENT - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_COUNT + 1)
+
+//
+// NOTE(koekeishiya): Log-linear histogram in the style of HdrHistogram. Values below
+// HISTOGRAM_SUB_COUNT get a bucket each; every power of two above that is split into
+// HISTOGRAM_SUB_COUNT linear buckets, so a bucket is never wider than 1/8th of the values it
+// holds. Values of 2^HISTOGRAM_MAX_EXPONENT and above share the last bucket. Recording is a
+// couple of instructions and never allocates. A histogram has a single writer; readers on other
+// threads may observe a sample that is only partially recorded, which is fine for statistics.
+//
+
+struct histogram
+{
+    uint64_t count;
+    uint64_t max;
+    uint64_t bucket[HISTOGRAM_BUCKET_COUNT];
+};
+
+static inline int histogram_bucket(uint64_t value)
+{
+    if (value < HISTOGRAM_SUB_COUNT) return (int) value;
+
+    int exponent = 63 - __builtin_clzll(value);
+    if (exponent >= HISTOGRAM_MAX_EXPONENT) return HISTOGRAM_BUCKET_COUNT - 1;
+
+    int sub = (int)(value >> (exponent - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_COUNT - 1);
+    return (exponent - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_COUNT + sub;
+}
+
+static inline uint64_t histogram_bucket_max(int bucket)
+{
+    if (bucket < HISTOGRAM_SUB_COUNT) return (uint64_t) bucket;
+    if (bucket == HISTOGRAM_BUCKET_COUNT - 1) return UINT64_MAX;
+
+    int exponent = bucket / HISTOGRAM_SUB_COUNT + HISTOGRAM_SUB_BITS - 1;
+    uint64_t sub = bucket % HISTOGRAM_SUB_COUNT;
+    uint64_t width = 1ULL << (exponent - HISTOGRAM_SUB_BITS);
+    return (1ULL << exponent) + (sub + 1) * width - 1;
+}
+
+static inline void histogram_record(struct histogram *histogram, uint64_t value)
+{
+    ++histogram->bucket[histogram_bucket(value)];
+    ++histogram->count;
+    if (value > histogram->max) histogram->max = value;
+}
+
+static void histogram_merge(struct histogram *histogram, struct histogram *other)
+{
+    for (int i = 0; i < HISTOGRAM_BUCKET_COUNT; ++i) {
+        histogram->bucket[i] += other->bucket[i];
+    }
+
+    histogram->count += other->count;
+    if (other->max > histogram->max) histogram->max = other->max;
+}
+
+//
+// NOTE(koekeishiya): Returns the upper bound of the bucket that holds the given percentile,
+// clamped to the largest value recorded.
+//
+
+static uint64_t histogram_percentile(struct histogram *histogram, double percentile)
+{
+    uint64_t count = histogram->count;
+    if (!count) return 0;
+
+    uint64_t rank = (uint64_t)(percentile / 100.0 * count + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > count) rank = count;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKET_COUNT; ++i) {
+        seen += histogram->bucket[i];
+        if (seen >= rank) {
+            uint64_t value = histogram_bucket_max(i);
+            return value < histogram->max ? value : histogram->max;
+        }
+    }
+
+    return histogram->max;
+}
+
+#endif
@@ -17,26 +17,138 @@ bool memory_pool_init(struct memory_pool *pool, uint64_t size)
     pool->used = 0;
     pool->size = size;
     pool->memory = mmap(0, size, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
-    return pool->memory != NULL;
+    return pool->memory != MAP_FAILED;
 }
 
-#define memory_pool_push(p, t) memory_pool_push_size(p, sizeof(t))
-void *memory_pool_push_size(struct memory_pool *pool, uint64_t size)
-{
-    for (;;) {
-        uint64_t used = pool->used;
-        uint64_t new_used = used + size;
-
-        if (new_used < pool->size) {
-            if (__sync_bool_compare_and_swap(&pool->used, used, new_used)) {
-                return pool->memory + used;
-            }
-        } else {
-            if (__sync_bool_compare_and_swap(&pool->used, used, size)) {
-                return pool->memory;
-            }
+//
+// NOTE(koekeishiya): Per-type object allocator. Objects are rounded up to a whole number
+// of cache lines and carved out of an mmap'd memory_pool. Freed objects are kept on a
+// free list and handed out again before we take more memory from the pool, so memory is
+// never reused while an object is still live. Once the pool is used up we map another one
+// of the same size and count it as an overflow; the old one is never unmapped because
+// objects on the free list may still point into it. Objects are returned zeroed.
+//
+
+#define CACHE_LINE_SIZE 64
+
+struct memory_slab
+{
+    struct memory_pool pool;
+    uint64_t object_size;
+    void *free_list;
+    volatile uint32_t lock;
+    volatile uint64_t live;
+    volatile uint64_t high_water;
+    volatile uint64_t overflow;
+};
+
+bool memory_slab_init(struct memory_slab *slab, uint64_t object_size, uint64_t size)
+{
+    slab->object_size = (object_size + CACHE_LINE_SIZE - 1) & ~(uint64_t)(CACHE_LINE_SIZE - 1);
+    slab->free_list = NULL;
+    slab->lock = 0;
+    slab->live = 0;
+    slab->high_water = 0;
+    slab->overflow = 0;
+
+    //
+    // NOTE(koekeishiya): If the first mapping fails we mark the pool as used up, so that
+    // memory_slab_alloc tries to map a new one instead of handing out MAP_FAILED.
+    //
+
+    if (memory_pool_init(&slab->pool, size)) return true;
+    slab->pool.used = slab->pool.size;
+    return false;
+}
+
+void *memory_slab_alloc(struct memory_slab *slab)
+{
+    void *memory = NULL;
+    while (__sync_lock_test_and_set(&slab->lock, 1));
+
+    if (slab->free_list) {
+        memory = slab->free_list;
+        slab->free_list = *(void **) memory;
+    } else {
+        if (slab->pool.used + slab->object_size > slab->pool.size) {
+            struct memory_pool pool;
+            if (!memory_pool_init(&pool, slab->pool.size)) goto out;
+            slab->pool = pool;
+            ++slab->overflow;
         }
+
+        memory = slab->pool.memory + slab->pool.used;
+        slab->pool.used += slab->object_size;
     }
+
+    if (++slab->live > slab->high_water) slab->high_water = slab->live;
+
+out:
+    __sync_lock_release(&slab->lock);
+    if (memory) memset(memory, 0, slab->object_size);
+    return memory;
+}
+
+void memory_slab_free(struct memory_slab *slab, void *memory)
+{
+    while (__sync_lock_test_and_set(&slab->lock, 1));
+    *(void **) memory = slab->free_list;
+    slab->free_list = memory;
+    --slab->live;
+    __sync_lock_release(&slab->lock);
+}
+
+//
+// NOTE(koekeishiya): Bump allocator for memory that only has to live until the owner calls
+// memory_arena_reset. Requests that do not fit in the pool fall back to malloc, and are
+// chained together so that the next reset can free them; we never wrap around and hand out
+// memory that is still in use. If malloc fails we return NULL, like malloc would.
+// The arena is not thread-safe and belongs to a single thread.
+//
+
+struct memory_arena
+{
+    struct memory_pool pool;
+    void *overflow;
+    uint64_t overflow_count;
+};
+
+bool memory_arena_init(struct memory_arena *arena, uint64_t size)
+{
+    arena->overflow = NULL;
+    arena->overflow_count = 0;
+    return memory_pool_init(&arena->pool, size);
+}
+
+#define memory_arena_push(a, t, n) memory_arena_push_size(a, sizeof(t) * (n))
+void *memory_arena_push_size(struct memory_arena *arena, uint64_t size)
+{
+    size = (size + 15) & ~15ULL;
+
+    uint64_t used = arena->pool.used;
+    if (used + size <= arena->pool.size) {
+        arena->pool.used = used + size;
+        return arena->pool.memory + used;
+    }
+
+    void **memory = malloc(16 + size);
+    if (!memory) return NULL;
+
+    *memory = arena->overflow;
+    arena->overflow = memory;
+    ++arena->overflow_count;
+    return (void *) memory + 16;
+}
+
+void memory_arena_reset(struct memory_arena *arena)
+{
+    while (arena->overflow) {
+        void *next = *(void **) arena->overflow;
+        free(arena->overflow);
+        arena->overflow = next;
+    }
+
+    arena->pool.used = 0;
 }
 
 #endif
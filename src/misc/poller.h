@@ -0,0 +1,126 @@
+#ifndef POLLER_H
+#define POLLER_H
+
+#ifdef __APPLE__
+#include <sys/event.h>
+#elif defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+#define POLLER_EVENT_MAX 32
+#define POLLER_WAKE      UINTPTR_MAX
+
+//
+// NOTE(koekeishiya): Readiness multiplexer: kqueue on macOS and epoll on Linux. Every file
+// descriptor is registered for read readiness together with a value of the caller's choosing,
+// which poller_wait hands back once the descriptor is readable. Registrations are level-triggered,
+// so a descriptor that still has data left is reported again by the next wait. poller_wake may be
+// called from any thread, and makes a concurrent (or the next) poller_wait return; it uses an
+// EVFILT_USER event on macOS and an eventfd on Linux, and is never reported to the caller.
+//
+
+struct poller
+{
+    int fd;
+#ifdef __linux__
+    int wake_fd;
+#endif
+};
+
+static bool poller_init(struct poller *poller)
+{
+#ifdef __APPLE__
+    poller->fd = kqueue();
+    if (poller->fd == -1) return false;
+
+    struct kevent event;
+    EV_SET(&event, 0, EVFILT_USER, EV_ADD | EV_CLEAR, 0, 0, NULL);
+    return kevent(poller->fd, &event, 1, NULL, 0, NULL) != -1;
+#elif defined(__linux__)
+    poller->fd = epoll_create1(EPOLL_CLOEXEC);
+    if (poller->fd == -1) return false;
+
+    poller->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (poller->wake_fd == -1) return false;
+
+    struct epoll_event event = { .events = EPOLLIN, .data.u64 = POLLER_WAKE };
+    return epoll_ctl(poller->fd, EPOLL_CTL_ADD, poller->wake_fd, &event) != -1;
+#endif
+}
+
+static bool poller_add(struct poller *poller, int fd, uintptr_t udata)
+{
+#ifdef __APPLE__
+    struct kevent event;
+    EV_SET(&event, fd, EVFILT_READ, EV_ADD, 0, 0, (void *) udata);
+    return kevent(poller->fd, &event, 1, NULL, 0, NULL) != -1;
+#elif defined(__linux__)
+    struct epoll_event event = { .events = EPOLLIN, .data.u64 = udata };
+    return epoll_ctl(poller->fd, EPOLL_CTL_ADD, fd, &event) != -1;
+#endif
+}
+
+static void poller_remove(struct poller *poller, int fd)
+{
+#ifdef __APPLE__
+    struct kevent event;
+    EV_SET(&event, fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+    kevent(poller->fd, &event, 1, NULL, 0, NULL);
+#elif defined(__linux__)
+    epoll_ctl(poller->fd, EPOLL_CTL_DEL, fd, NULL);
+#endif
+}
+
+static inline void poller_wake(struct poller *poller)
+{
+#ifdef __APPLE__
+    struct kevent event;
+    EV_SET(&event, 0, EVFILT_USER, 0, NOTE_TRIGGER, 0, NULL);
+    kevent(poller->fd, &event, 1, NULL, 0, NULL);
+#elif defined(__linux__)
+    uint64_t value = 1;
+    write(poller->wake_fd, &value, sizeof(value));
+#endif
+}
+
+//
+// NOTE(koekeishiya): Waits until a registered descriptor is readable, poller_wake is called, or
+// 'timeout_ns' nanoseconds have passed; a negative timeout waits forever and zero only checks.
+// Stores the values of at most 'count' readable descriptors in 'ready' and returns how many.
+// epoll only takes milliseconds, so on Linux the timeout is rounded up.
+//
+
+static int poller_wait(struct poller *poller, uintptr_t *ready, int count, int64_t timeout_ns)
+{
+    int result = 0;
+
+#ifdef __APPLE__
+    struct kevent event[POLLER_EVENT_MAX];
+    struct timespec timeout = { .tv_sec = timeout_ns / 1000000000, .tv_nsec = timeout_ns % 1000000000 };
+    int event_count = kevent(poller->fd, NULL, 0, event, count < POLLER_EVENT_MAX ? count : POLLER_EVENT_MAX, timeout_ns < 0 ? NULL : &timeout);
+
+    for (int i = 0; i < event_count; ++i) {
+        if (event[i].filter == EVFILT_USER) continue;
+        ready[result++] = (uintptr_t) event[i].udata;
+    }
+#elif defined(__linux__)
+    struct epoll_event event[POLLER_EVENT_MAX];
+    int timeout_ms = timeout_ns < 0 ? -1 : timeout_ns > INT32_MAX * 1000000LL ? INT32_MAX : (int)((timeout_ns + 999999) / 1000000);
+    int event_count = epoll_wait(poller->fd, event, count < POLLER_EVENT_MAX ? count : POLLER_EVENT_MAX, timeout_ms);
+
+    for (int i = 0; i < event_count; ++i) {
+        if (event[i].data.u64 == POLLER_WAKE) {
+            uint64_t value;
+            read(poller->wake_fd, &value, sizeof(value));
+            continue;
+        }
+
+        ready[result++] = (uintptr_t) event[i].data.u64;
+    }
+#endif
+
+    return result;
+}
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef PROBE_H
+#define PROBE_H
+
+//
+// NOTE(koekeishiya): Static tracepoints for the 'limelight' provider. <sys/sdt.h> turns them into
+// DTrace USDT probes on macOS and SystemTap SDT notes on Linux (bpftrace, perf), so they can be
+// attached to a running daemon. A probe that nobody is attached to is a single nop; its arguments
+// are always values that are already at hand, and strings are literals or static tables, so that
+// having the probes compiled in costs nothing measurable. Without <sys/sdt.h> they compile to
+// nothing. The probes and their arguments are documented in doc/limelight.asciidoc.
+//
+// The name of a probe is written with a double underscore here, which DTrace shows as a dash:
+// event__post is 'limelight*:::event-post' in DTrace and 'usdt:<binary>:limelight:event__post'
+// in bpftrace.
+//
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>) && !defined(LIMELIGHT_NO_PROBES)
+#include <sys/sdt.h>
+#define PROBES_ENABLED
+#endif
+#endif
+
+#ifdef PROBES_ENABLED
+#define probe1(name, a)             DTRACE_PROBE1(limelight, name, a)
+#define probe2(name, a, b)          DTRACE_PROBE2(limelight, name, a, b)
+#define probe3(name, a, b, c)       DTRACE_PROBE3(limelight, name, a, b, c)
+#define probe4(name, a, b, c, d)    DTRACE_PROBE4(limelight, name, a, b, c, d)
+#else
+#define probe1(name, a)             ((void) 0)
+#define probe2(name, a, b)          ((void) 0)
+#define probe3(name, a, b, c)       ((void) 0)
+#define probe4(name, a, b, c, d)    ((void) 0)
+#endif
+
+#endif
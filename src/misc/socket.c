@@ -1,32 +1,42 @@
 #include "socket.h"
 
-char *socket_read(int sockfd, int *len)
+//
+// NOTE(koekeishiya): Reads the message of a client for a daemon that is driven by a readiness
+// loop instead of an accept thread. Appends whatever can be read without blocking, and
+// returns true once the client has shut down its end of the connection, or reading failed. The
+// message is then either complete and NUL-terminated, or NULL, and the socket has been switched
+// back to blocking mode, so that the response can be written with stdio.
+//
+
+bool socket_connection_read(struct socket_connection *connection)
 {
-    int cursor = 0;
-    int bytes_read = 0;
-    char *result = NULL;
+    ssize_t bytes_read = 0;
     char buffer[BUFSIZ];
 
-    while ((bytes_read = read(sockfd, buffer, sizeof(buffer)-1)) > 0) {
-        char *temp = realloc(result, cursor+bytes_read+1);
+    while ((bytes_read = read(connection->sockfd, buffer, sizeof(buffer)-1)) > 0) {
+        char *temp = realloc(connection->message, connection->length+bytes_read+1);
         if (!temp) goto err;
 
-        result = temp;
-        memcpy(result+cursor, buffer, bytes_read);
-        cursor += bytes_read;
+        connection->message = temp;
+        memcpy(connection->message+connection->length, buffer, bytes_read);
+        connection->length += bytes_read;
     }
 
-    if (result && bytes_read != -1) {
-        result[cursor] = '\0';
-        *len = cursor;
+    if (bytes_read == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return false;
+    }
+
+    if (connection->message && bytes_read != -1) {
+        connection->message[connection->length] = '\0';
     } else {
 err:
-        if (result) free(result);
-        result = NULL;
-        *len = 0;
+        if (connection->message) free(connection->message);
+        connection->message = NULL;
+        connection->length = 0;
     }
 
-    return result;
+    fcntl(connection->sockfd, F_SETFL, fcntl(connection->sockfd, F_GETFL) & ~O_NONBLOCK);
+    return true;
 }
 
 bool socket_write_bytes(int sockfd, char *message, int len)
@@ -90,35 +100,14 @@ void socket_close(int sockfd)
     close(sockfd);
 }
 
-static void *socket_connection_handler(void *context)
-{
-    struct daemon *daemon = context;
-
-    while (daemon->is_running) {
-        int sockfd = accept(daemon->sockfd, NULL, 0);
-        if (sockfd == -1) continue;
-
-        int length;
-        char *message = socket_read(sockfd, &length);
-        if (message) {
-            daemon->handler(message, length, sockfd);
-        } else {
-            socket_close(sockfd);
-        }
-    }
-
-    return NULL;
-}
-
-bool socket_daemon_begin_in(struct daemon *daemon, int port, socket_daemon_handler *handler)
+static bool socket_daemon_bind_un(struct daemon *daemon, char *socket_path)
 {
-    struct sockaddr_in socket_address;
-    socket_address.sin_family = AF_INET;
-    socket_address.sin_port = htons(port);
-    socket_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
-    memset(&socket_address.sin_zero, '\0', 8);
+    struct sockaddr_un socket_address;
+    socket_address.sun_family = AF_UNIX;
+    snprintf(socket_address.sun_path, sizeof(socket_address.sun_path), "%s", socket_path);
+    unlink(socket_path);
 
-    if ((daemon->sockfd = socket(PF_INET, SOCK_STREAM, 0)) == -1) {
+    if ((daemon->sockfd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
         return false;
     }
 
@@ -126,50 +115,46 @@ bool socket_daemon_begin_in(struct daemon *daemon, int port, socket_daemon_handl
         return false;
     }
 
-    if (listen(daemon->sockfd, SOMAXCONN) == -1) {
+    if (chmod(socket_path, 0600) != 0) {
         return false;
     }
 
-    daemon->handler = handler;
-    daemon->is_running = true;
-    pthread_create(&daemon->thread, NULL, &socket_connection_handler, daemon);
+    if (listen(daemon->sockfd, SOMAXCONN) == -1) {
+        return false;
+    }
 
     return true;
 }
 
-bool socket_daemon_begin_un(struct daemon *daemon, char *socket_path, socket_daemon_handler *handler)
-{
-    struct sockaddr_un socket_address;
-    socket_address.sun_family = AF_UNIX;
-    snprintf(socket_address.sun_path, sizeof(socket_address.sun_path), "%s", socket_path);
-    unlink(socket_path);
-
-    if ((daemon->sockfd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
-        return false;
-    }
+//
+// NOTE(koekeishiya): There is no accept thread. The listening socket is non-blocking; the owner
+// waits for it to become readable, and then calls socket_daemon_accept until it returns -1.
+// Accepted sockets are non-blocking as well, and are read with socket_connection_read.
+//
 
-    if (bind(daemon->sockfd, (struct sockaddr *) &socket_address, sizeof(socket_address)) == -1) {
+bool socket_daemon_listen_un(struct daemon *daemon, char *socket_path, socket_daemon_handler *handler)
+{
+    if (!socket_daemon_bind_un(daemon, socket_path)) {
         return false;
     }
 
-    if (chmod(socket_path, 0600) != 0) {
-        return false;
-    }
-
-    if (listen(daemon->sockfd, SOMAXCONN) == -1) {
+    if (fcntl(daemon->sockfd, F_SETFL, fcntl(daemon->sockfd, F_GETFL) | O_NONBLOCK) == -1) {
         return false;
     }
 
     daemon->handler = handler;
-    daemon->is_running = true;
-    pthread_create(&daemon->thread, NULL, &socket_connection_handler, daemon);
-
     return true;
 }
 
-void socket_daemon_end(struct daemon *daemon)
+int socket_daemon_accept(struct daemon *daemon)
 {
-    daemon->is_running = false;
-    pthread_join(daemon->thread, NULL);
-    socket_close(daemon->sockfd);
+    int sockfd = accept(daemon->sockfd, NULL, 0);
+    if (sockfd == -1) return -1;
+
+    if (fcntl(sockfd, F_SETFL, fcntl(sockfd, F_GETFL) | O_NONBLOCK) == -1) {
+        socket_close(sockfd);
+        return -1;
+    }
+
+    return sockfd;
 }
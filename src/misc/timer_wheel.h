@@ -0,0 +1,180 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_BITS   6
+#define TIMER_WHEEL_SLOTS  (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK   (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_RANGE  (1ULL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))
+
+//
+// NOTE(koekeishiya): Hierarchical timer wheel. Time is measured in ticks and is always passed in
+// by the caller, the wheel never reads a clock itself. Level 0 has one slot per tick, and every
+// slot in level n covers a full revolution of level n-1. When the lower level wraps around we
+// cascade the matching slot of the level above, re-inserting its timers closer to level 0.
+// Deadlines further out than TIMER_WHEEL_RANGE ticks are parked in the top level and re-inserted
+// whenever they cascade.
+//
+// Timers are intrusive; the wheel never allocates. All lists are circular and have a sentinel
+// head, so that a timer can be unlinked without knowing which list it is in. A timer that has
+// expired is moved to the 'expired' list, where it stays until the owner pops it.
+//
+
+struct timer_node
+{
+    struct timer_node *next;
+    struct timer_node *prev;
+    uint64_t deadline;
+};
+
+struct timer_wheel
+{
+    uint64_t now;
+    uint32_t count;
+    struct timer_node expired;
+    struct timer_node slot[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+};
+
+static inline void timer_list_init(struct timer_node *list)
+{
+    list->next = list;
+    list->prev = list;
+}
+
+static inline bool timer_list_is_empty(struct timer_node *list)
+{
+    return list->next == list;
+}
+
+static inline void timer_list_append(struct timer_node *list, struct timer_node *node)
+{
+    node->prev = list->prev;
+    node->next = list;
+    list->prev->next = node;
+    list->prev = node;
+}
+
+static inline void timer_list_unlink(struct timer_node *node)
+{
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->next = node;
+    node->prev = node;
+}
+
+void timer_wheel_init(struct timer_wheel *wheel, uint64_t now)
+{
+    wheel->now = now;
+    wheel->count = 0;
+    timer_list_init(&wheel->expired);
+
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; ++level) {
+        for (int slot = 0; slot < TIMER_WHEEL_SLOTS; ++slot) {
+            timer_list_init(&wheel->slot[level][slot]);
+        }
+    }
+}
+
+static void timer_wheel_place(struct timer_wheel *wheel, struct timer_node *node)
+{
+    if (node->deadline <= wheel->now) {
+        timer_list_append(&wheel->expired, node);
+        return;
+    }
+
+    uint64_t delta = node->deadline - wheel->now;
+    uint64_t deadline = delta < TIMER_WHEEL_RANGE ? node->deadline : wheel->now + TIMER_WHEEL_RANGE - 1;
+
+    int level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (1ULL << (TIMER_WHEEL_BITS * (level + 1)))) {
+        ++level;
+    }
+
+    int slot = (deadline >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+    timer_list_append(&wheel->slot[level][slot], node);
+}
+
+void timer_wheel_insert(struct timer_wheel *wheel, struct timer_node *node, uint64_t deadline)
+{
+    node->deadline = deadline;
+    timer_wheel_place(wheel, node);
+    ++wheel->count;
+}
+
+void timer_wheel_remove(struct timer_wheel *wheel, struct timer_node *node)
+{
+    timer_list_unlink(node);
+    --wheel->count;
+}
+
+struct timer_node *timer_wheel_pop_expired(struct timer_wheel *wheel)
+{
+    if (timer_list_is_empty(&wheel->expired)) return NULL;
+
+    struct timer_node *node = wheel->expired.next;
+    timer_list_unlink(node);
+    --wheel->count;
+
+    return node;
+}
+
+static void timer_wheel_cascade(struct timer_wheel *wheel, int level)
+{
+    struct timer_node *list = &wheel->slot[level][(wheel->now >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK];
+
+    while (!timer_list_is_empty(list)) {
+        struct timer_node *node = list->next;
+        timer_list_unlink(node);
+        timer_wheel_place(wheel, node);
+    }
+}
+
+void timer_wheel_advance(struct timer_wheel *wheel, uint64_t now)
+{
+    while (wheel->now < now) {
+        if (wheel->count == 0) {
+            wheel->now = now;
+            break;
+        }
+
+        ++wheel->now;
+
+        for (int level = 1; level < TIMER_WHEEL_LEVELS; ++level) {
+            if (wheel->now & ((1ULL << (TIMER_WHEEL_BITS * level)) - 1)) break;
+            timer_wheel_cascade(wheel, level);
+        }
+
+        timer_wheel_cascade(wheel, 0);
+    }
+}
+
+//
+// NOTE(koekeishiya): Returns the tick at which the caller has to call timer_wheel_advance again,
+// or UINT64_MAX if there are no timers. For level 0 this is the exact deadline of the first timer,
+// for the levels above it is the tick at which the first non-empty slot is cascaded, which may be
+// earlier than the deadline of the timers in that slot.
+//
+
+uint64_t timer_wheel_next_deadline(struct timer_wheel *wheel)
+{
+    if (!timer_list_is_empty(&wheel->expired)) return wheel->now;
+    if (wheel->count == 0) return UINT64_MAX;
+
+    uint64_t result = UINT64_MAX;
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; ++level) {
+        int shift = TIMER_WHEEL_BITS * level;
+        uint64_t base = wheel->now >> shift;
+
+        for (uint64_t i = 1; i <= TIMER_WHEEL_SLOTS; ++i) {
+            if (!timer_list_is_empty(&wheel->slot[level][(base + i) & TIMER_WHEEL_MASK])) {
+                uint64_t tick = (base + i) << shift;
+                if (tick < result) result = tick;
+                break;
+            }
+        }
+    }
+
+    return result;
+}
+
+#endif
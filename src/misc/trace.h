@@ -0,0 +1,175 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#define TRACE_MAGIC       "LLTRACE"
+#define TRACE_VERSION     1
+#define TRACE_BYTE_ORDER  0x01020304
+#define TRACE_RING_SIZE   4096
+#define TRACE_NAME_LENGTH 32
+
+enum trace_kind
+{
+    TRACE_POSTED  = 1,
+    TRACE_HANDLED = 2,
+};
+
+//
+// NOTE(koekeishiya): The on-disk format is shared with tools/limelight-trace.c, so every field has
+// a fixed width and the structs contain no implicit padding. A trace file starts with a
+// trace_header, followed by 'name_count' event type names of TRACE_NAME_LENGTH bytes each, followed
+// by 'record_count' trace_records. Records are written in host byte order; 'byte_order' lets the
+// reader detect a file written on a machine of the other endianness.
+//
+
+struct trace_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t record_size;
+    uint32_t name_count;
+    uint64_t record_count;
+};
+
+struct trace_record
+{
+    uint64_t timestamp;
+    uint64_t duration;
+    uint32_t id;
+    uint32_t thread;
+    uint16_t event_type;
+    uint8_t kind;
+    uint8_t result;
+    uint32_t reserved;
+};
+
+//
+// NOTE(koekeishiya): Every thread that records an event gets its own ring the first time it does
+// so, which means that writing a record never contends with another thread. A ring is a flight
+// recorder: the oldest records are overwritten once it is full. The writer fills the slot and
+// then publishes it by bumping 'head' with a release store; the slot is not fenced against the
+// reader. A reader copies the ring and then reads 'head' again, discarding every slot that the
+// writer may have started to overwrite in the meantime. Rings are never freed, because the
+// thread may record again at any point.
+//
+
+struct trace_ring
+{
+    struct trace_ring *next;
+    uint32_t thread;
+    volatile uint64_t head;
+    struct trace_record record[TRACE_RING_SIZE];
+};
+
+struct trace
+{
+    volatile bool enabled;
+    struct trace_ring *volatile ring_list;
+    volatile uint32_t ring_count;
+};
+
+static __thread struct trace_ring *trace_ring_current;
+
+struct trace_ring *trace_ring_create(struct trace *trace)
+{
+    struct trace_ring *ring = malloc(sizeof(struct trace_ring));
+    if (!ring) return NULL;
+
+    ring->head = 0;
+    ring->thread = __sync_fetch_and_add(&trace->ring_count, 1);
+
+    do {
+        ring->next = trace->ring_list;
+    } while (!__sync_bool_compare_and_swap(&trace->ring_list, ring->next, ring));
+
+    trace_ring_current = ring;
+    return ring;
+}
+
+static inline void trace_write(struct trace *trace, enum trace_kind kind, uint16_t event_type, uint32_t id, uint8_t result, uint64_t timestamp, uint64_t duration)
+{
+    struct trace_ring *ring = trace_ring_current;
+    if (!ring && !(ring = trace_ring_create(trace))) return;
+
+    uint64_t head = ring->head;
+    struct trace_record *record = &ring->record[head & (TRACE_RING_SIZE - 1)];
+    record->timestamp = timestamp;
+    record->duration = duration;
+    record->id = id;
+    record->thread = ring->thread;
+    record->event_type = event_type;
+    record->kind = kind;
+    record->result = result;
+    record->reserved = 0;
+
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+uint64_t trace_ring_copy(struct trace_ring *ring, struct trace_record *buffer)
+{
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+
+    for (uint64_t i = first; i < head; ++i) {
+        buffer[i - first] = ring->record[i & (TRACE_RING_SIZE - 1)];
+    }
+
+    __sync_synchronize();
+
+    //
+    // NOTE(koekeishiya): While the writer is at 'head', it may be overwriting slot
+    // 'head - TRACE_RING_SIZE'. Anything at or below that index could be torn.
+    //
+
+    uint64_t last = ring->head;
+    uint64_t valid = last >= TRACE_RING_SIZE ? last - TRACE_RING_SIZE + 1 : 0;
+    if (valid <= first) return head - first;
+    if (valid >= head) return 0;
+
+    uint64_t skip = valid - first;
+    memmove(buffer, buffer + skip, (head - valid) * sizeof(struct trace_record));
+    return head - valid;
+}
+
+bool trace_dump(struct trace *trace, const char *path, const char **names, uint32_t name_count)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file) return false;
+
+    struct trace_record *buffer = malloc(TRACE_RING_SIZE * sizeof(struct trace_record));
+    if (!buffer) {
+        fclose(file);
+        return false;
+    }
+
+    struct trace_header header = {
+        .magic        = TRACE_MAGIC,
+        .version      = TRACE_VERSION,
+        .byte_order   = TRACE_BYTE_ORDER,
+        .record_size  = sizeof(struct trace_record),
+        .name_count   = name_count,
+        .record_count = 0
+    };
+
+    fwrite(&header, sizeof(header), 1, file);
+
+    for (uint32_t i = 0; i < name_count; ++i) {
+        char name[TRACE_NAME_LENGTH] = { 0 };
+        if (names[i]) strncpy(name, names[i], TRACE_NAME_LENGTH - 1);
+        fwrite(name, TRACE_NAME_LENGTH, 1, file);
+    }
+
+    for (struct trace_ring *ring = trace->ring_list; ring; ring = ring->next) {
+        uint64_t count = trace_ring_copy(ring, buffer);
+        fwrite(buffer, sizeof(struct trace_record), count, file);
+        header.record_count += count;
+    }
+
+    fseek(file, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, file);
+
+    free(buffer);
+    return fclose(file) == 0;
+}
+
+#endif
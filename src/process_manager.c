@@ -1,23 +1,15 @@
 #include "process_manager.h"
 
 extern struct event_loop g_event_loop;
+extern struct process_manager g_process_manager;
 extern void *g_workspace_context;
 
-static TABLE_HASH_FUNC(hash_psn)
-{
-    return ((ProcessSerialNumber *) key)->lowLongOfPSN;
-}
-
-static TABLE_COMPARE_FUNC(compare_psn)
-{
-    return psn_equals(key_a, key_b);
-}
-
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wdeprecated-declarations"
 struct process *process_create(ProcessSerialNumber psn)
 {
-    struct process *process = malloc(sizeof(struct process));
+    struct process *process = memory_slab_alloc(&g_process_manager.process_slab);
+    if (!process) return NULL;
 
     CFStringRef process_name_ref;
     if (CopyProcessName(&psn, &process_name_ref) == noErr) {
@@ -32,6 +24,10 @@ struct process *process_create(ProcessSerialNumber psn)
 
     process->psn = psn;
     process->terminated = false;
+    process->launch_stage = PROCESS_LAUNCH_OBSERVABLE;
+    process->launch_attempt = 0;
+    process->launch_application = NULL;
+    process->retry_timer = 0;
     process->xpc = process_info.processType == 'XPC!';
     GetProcessPID(&process->psn, &process->pid);
     process->ns_application = workspace_application_create_running_ns_application(process);
@@ -43,7 +39,7 @@ void process_destroy(struct process *process)
 {
     workspace_application_destroy_running_ns_application(g_workspace_context, process);
     free(process->name);
-    free(process);
+    memory_slab_free(&g_process_manager.process_slab, process);
 }
 
 static bool process_is_observable(struct process *process)
@@ -91,10 +87,9 @@ static PROCESS_EVENT_HANDLER(process_handler)
         struct process *process = process_create(psn);
         if (!process) return noErr;
 
-        if (process_is_observable(process)) {
-            process_manager_add_process(pm, process);
-            struct event *event = event_create(&g_event_loop, APPLICATION_LAUNCHED, process);
-            event_loop_post(&g_event_loop, event);
+        if (process_is_observable(process) && process_manager_add_process(pm, process)) {
+            struct event event = event_create(APPLICATION_LAUNCHED, process);
+            event_loop_post(&g_event_loop, &event);
         } else {
             process_destroy(process);
         }
@@ -106,21 +101,30 @@ static PROCESS_EVENT_HANDLER(process_handler)
         process->terminated = true;
         process_manager_remove_process(pm, &psn);
 
-        struct event *event = event_create(&g_event_loop, APPLICATION_TERMINATED, process);
-        event_loop_post(&g_event_loop, event);
+        struct event event = event_create(APPLICATION_TERMINATED, process);
+        event_loop_post(&g_event_loop, &event);
     } break;
     case kEventAppFrontSwitched: {
         struct process *process = process_manager_find_process(pm, &psn);
         if (!process) return noErr;
 
-        struct event *event = event_create(&g_event_loop, APPLICATION_FRONT_SWITCHED, process);
-        event_loop_post(&g_event_loop, event);
+        struct event event = event_create(APPLICATION_FRONT_SWITCHED, process);
+        event_loop_post(&g_event_loop, &event);
     } break;
     }
 
     return noErr;
 }
 
+static int
+process_manager_running_process_count(void)
+{
+    int count = 0;
+    ProcessSerialNumber psn = { kNoProcess, kNoProcess };
+    while (GetNextProcess(&psn) == noErr) ++count;
+    return count;
+}
+
 static void
 process_manager_add_running_processes(struct process_manager *pm)
 {
@@ -135,7 +139,7 @@ process_manager_add_running_processes(struct process_manager *pm)
                 pm->finder_psn = psn;
             }
 
-            process_manager_add_process(pm, process);
+            if (!process_manager_add_process(pm, process)) process_destroy(process);
         } else {
             process_destroy(process);
         }
@@ -145,17 +149,17 @@ process_manager_add_running_processes(struct process_manager *pm)
 
 struct process *process_manager_find_process(struct process_manager *pm, ProcessSerialNumber *psn)
 {
-    return table_find(&pm->process, psn);
+    return process_table_find(&pm->process, psn_key(psn));
 }
 
 void process_manager_remove_process(struct process_manager *pm, ProcessSerialNumber *psn)
 {
-    table_remove(&pm->process, psn);
+    process_table_remove(&pm->process, psn_key(psn));
 }
 
-void process_manager_add_process(struct process_manager *pm, struct process *process)
+bool process_manager_add_process(struct process_manager *pm, struct process *process)
 {
-    table_add(&pm->process, &process->psn, process);
+    return process_table_add(&pm->process, psn_key(&process->psn), process);
 }
 
 #if 0
@@ -191,7 +195,9 @@ void process_manager_init(struct process_manager *pm)
     pm->type[1].eventKind  = kEventAppTerminated;
     pm->type[2].eventClass = kEventClassApplication;
     pm->type[2].eventKind  = kEventAppFrontSwitched;
-    table_init(&pm->process, 125, hash_psn, compare_psn);
+    memory_slab_init(&pm->process_slab, sizeof(struct process), PROCESS_SLAB_SIZE);
+    process_table_init(&pm->process, 125);
+    process_table_reserve(&pm->process, process_manager_running_process_count());
     process_manager_add_running_processes(pm);
 }
 
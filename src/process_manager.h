@@ -10,6 +10,17 @@ extern CFTypeID _LSASNGetTypeID(void);
 #define PROCESS_EVENT_HANDLER(name) OSStatus name(EventHandlerCallRef ref, EventRef event, void *user_data)
 typedef PROCESS_EVENT_HANDLER(process_event_handler);
 
+#define PROCESS_LAUNCH_RETRY_MIN_MS 20
+#define PROCESS_LAUNCH_RETRY_MAX_MS 100
+
+enum process_launch_stage
+{
+    PROCESS_LAUNCH_OBSERVABLE,
+    PROCESS_LAUNCH_FINISHED_LAUNCHING,
+    PROCESS_LAUNCH_OBSERVE,
+    PROCESS_LAUNCH_DONE
+};
+
 struct process
 {
     ProcessSerialNumber psn;
@@ -17,12 +28,26 @@ struct process
     char *name;
     bool xpc;
     bool volatile terminated;
+    uint8_t launch_stage;
+    uint8_t launch_attempt;
+    struct application *launch_application;
+    uint64_t retry_timer;
     void *ns_application;
 };
 
+#define PROCESS_SLAB_SIZE KILOBYTES(16)
+
+TABLE_DEFINE(process_table, uint64_t, struct process *)
+
+static inline uint64_t psn_key(ProcessSerialNumber *psn)
+{
+    return ((uint64_t) psn->highLongOfPSN << 32) | psn->lowLongOfPSN;
+}
+
 struct process_manager
 {
-    struct table process;
+    struct process_table process;
+    struct memory_slab process_slab;
     EventTargetRef target;
     EventHandlerUPP handler;
     EventTypeSpec type[3];
@@ -35,7 +60,7 @@ void process_destroy(struct process *process);
 struct process *process_create(ProcessSerialNumber psn);
 struct process *process_manager_find_process(struct process_manager *pm, ProcessSerialNumber *psn);
 void process_manager_remove_process(struct process_manager *pm, ProcessSerialNumber *psn);
-void process_manager_add_process(struct process_manager *pm, struct process *process);
+bool process_manager_add_process(struct process_manager *pm, struct process *process);
 // bool process_manager_next_process(ProcessSerialNumber *next_psn);
 void process_manager_init(struct process_manager *pm);
 bool process_manager_begin(struct process_manager *pm);
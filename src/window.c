@@ -1,6 +1,7 @@
 #include "window.h"
 
 extern int g_connection;
+extern struct event_loop g_event_loop;
 extern struct window_manager g_window_manager;
 
 int g_normal_window_level;
@@ -94,7 +95,9 @@ uint64_t *window_space_list(struct window *window, int *count)
     *count = CFArrayGetCount(space_list_ref);
     if (!*count) goto out;
 
-    space_list = malloc(*count * sizeof(uint64_t));
+    space_list = memory_arena_push(event_loop_scratch(&g_event_loop), uint64_t, *count);
+    if (!space_list) goto out;
+
     for (int i = 0; i < *count; ++i) {
         CFNumberRef id_ref = CFArrayGetValueAtIndex(space_list_ref, i);
         CFNumberGetValue(id_ref, CFNumberGetType(id_ref), space_list + i);
@@ -115,7 +118,7 @@ char *window_title(struct window *window)
 #if 0
     SLSCopyWindowProperty(g_connection, window->id, CFSTR("kCGSWindowTitle"), &value);
 #else
-    AXUIElementCopyAttributeValue(window->ref, kAXTitleAttribute, &value);
+    ax_copy_attribute_value(window->ref, kAXTitleAttribute, &value);
 #endif
 
     if (value) {
@@ -132,8 +135,8 @@ CGRect window_ax_frame(struct window *window)
     CFTypeRef position_ref = NULL;
     CFTypeRef size_ref = NULL;
 
-    AXUIElementCopyAttributeValue(window->ref, kAXPositionAttribute, &position_ref);
-    AXUIElementCopyAttributeValue(window->ref, kAXSizeAttribute, &size_ref);
+    ax_copy_attribute_value(window->ref, kAXPositionAttribute, &position_ref);
+    ax_copy_attribute_value(window->ref, kAXSizeAttribute, &size_ref);
 
     if (position_ref != NULL) {
         AXValueGetValue(position_ref, kAXValueTypeCGPoint, &frame.origin);
@@ -195,7 +198,7 @@ bool window_is_minimized(struct window *window)
     Boolean result = 0;
     CFTypeRef value;
 
-    if (AXUIElementCopyAttributeValue(window->ref, kAXMinimizedAttribute, &value) == kAXErrorSuccess) {
+    if (ax_copy_attribute_value(window->ref, kAXMinimizedAttribute, &value) == kAXErrorSuccess) {
         result = CFBooleanGetValue(value);
         CFRelease(value);
     }
@@ -207,7 +210,7 @@ bool window_is_fullscreen(struct window *window)
 {
     Boolean result = 0;
     CFTypeRef value;
-    if (AXUIElementCopyAttributeValue(window->ref, kAXFullscreenAttribute, &value) == kAXErrorSuccess) {
+    if (ax_copy_attribute_value(window->ref, kAXFullscreenAttribute, &value) == kAXErrorSuccess) {
         result = CFBooleanGetValue(value);
         CFRelease(value);
     }
@@ -245,14 +248,14 @@ int window_level(struct window *window)
 CFStringRef window_role(struct window *window)
 {
     const void *role = NULL;
-    AXUIElementCopyAttributeValue(window->ref, kAXRoleAttribute, &role);
+    ax_copy_attribute_value(window->ref, kAXRoleAttribute, &role);
     return role;
 }
 
 CFStringRef window_subrole(struct window *window)
 {
     const void *srole = NULL;
-    AXUIElementCopyAttributeValue(window->ref, kAXSubroleAttribute, &srole);
+    ax_copy_attribute_value(window->ref, kAXSubroleAttribute, &srole);
     return srole;
 }
 
@@ -332,8 +335,11 @@ static bool space_is_fullscreen(uint64_t sid)
 
 struct window *window_create(struct application *application, AXUIElementRef window_ref, uint32_t window_id)
 {
-    struct window *window = malloc(sizeof(struct window));
-    memset(window, 0, sizeof(struct window));
+    struct window *window = memory_slab_alloc(&g_window_manager.window_slab);
+    if (!window) {
+        CFRelease(window_ref);
+        return NULL;
+    }
 
     window->application = application;
     window->ref = window_ref;
@@ -341,7 +347,7 @@ struct window *window_create(struct application *application, AXUIElementRef win
     SLSGetWindowOwner(g_connection, window->id, &window->connection);
     window->is_minimized = window_is_minimized(window);
     window->is_fullscreen = window_is_fullscreen(window) || space_is_fullscreen(window_space(window));
-    window->id_ptr = malloc(sizeof(uint32_t *));
+    window->id_ptr = (uint32_t **)(window + 1);
     *window->id_ptr = &window->id;
 
     if ((window_is_standard(window)) || (window_is_dialog(window))) {
@@ -361,6 +367,5 @@ void window_destroy(struct window *window)
 {
     border_window_destroy(window);
     CFRelease(window->ref);
-    free(window->id_ptr);
-    free(window);
+    memory_slab_free(&g_window_manager.window_slab, window);
 }
@@ -40,6 +40,8 @@ static CFStringRef ax_window_notification[] =
 struct window
 {
     struct application *application;
+    struct window *application_next;
+    struct window *application_prev;
     AXUIElementRef ref;
     int connection;
     uint32_t id;
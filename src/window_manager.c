@@ -1,39 +1,22 @@
 #include "window_manager.h"
 
 extern int g_connection;
+extern struct event_loop g_event_loop;
 extern struct process_manager g_process_manager;
 
-static TABLE_HASH_FUNC(hash_wm)
-{
-    return *(uint32_t *) key;
-}
-
-static TABLE_COMPARE_FUNC(compare_wm)
-{
-    return *(uint32_t *) key_a == *(uint32_t *) key_b;
-}
-
 void window_manager_set_border_window_width(struct window_manager *wm, int width)
 {
     wm->window_border_width = width;
-    for (int window_index = 0; window_index < wm->window.capacity; ++window_index) {
-        struct bucket *bucket = wm->window.buckets[window_index];
-        while (bucket) {
-            if (bucket->value) {
-                struct window *window = bucket->value;
-                if (window->border.id) {
-                    window->border.width = width;
-                    CGContextSetLineWidth(window->border.context, width);
-
-                    if ((!window->application->is_hidden) &&
-                        (!window->is_minimized) &&
-                        (!window->is_fullscreen)) {
-                        border_window_refresh(window);
-                    }
-                }
-            }
-
-            bucket = bucket->next;
+    struct window_table_entry *entry;
+    table_foreach(entry, &wm->window) {
+        struct window *window = entry->value;
+        if (window->border.id) {
+            os_unfair_lock_lock(&window->border.lock);
+            window->border.width = width;
+            CGContextSetLineWidth(window->border.context, width);
+            os_unfair_lock_unlock(&window->border.lock);
+
+            if (!window->is_minimized) border_window_refresh(window);
         }
     }
 }
@@ -41,23 +24,15 @@ void window_manager_set_border_window_width(struct window_manager *wm, int width
 void window_manager_set_border_window_radius(struct window_manager *wm, float radius)
 {
     wm->window_border_radius = radius;
-    for (int window_index = 0; window_index < wm->window.capacity; ++window_index) {
-        struct bucket *bucket = wm->window.buckets[window_index];
-        while (bucket) {
-            if (bucket->value) {
-                struct window *window = bucket->value;
-                if (window->border.id) {
-                    window->border.radius = radius;
-
-                    if ((!window->application->is_hidden) &&
-                        (!window->is_minimized) &&
-                        (!window->is_fullscreen)) {
-                        border_window_refresh(window);
-                    }
-                }
-            }
-
-            bucket = bucket->next;
+    struct window_table_entry *entry;
+    table_foreach(entry, &wm->window) {
+        struct window *window = entry->value;
+        if (window->border.id) {
+            os_unfair_lock_lock(&window->border.lock);
+            window->border.radius = radius;
+            os_unfair_lock_unlock(&window->border.lock);
+
+            if (!window->is_minimized) border_window_refresh(window);
         }
     }
 }
@@ -72,21 +47,11 @@ void window_manager_set_active_border_window_color(struct window_manager *wm, ui
 void window_manager_set_normal_border_window_color(struct window_manager *wm, uint32_t color)
 {
     wm->normal_window_border_color = color;
-    for (int window_index = 0; window_index < wm->window.capacity; ++window_index) {
-        struct bucket *bucket = wm->window.buckets[window_index];
-        while (bucket) {
-            if (bucket->value) {
-                struct window *window = bucket->value;
-                if (window->id != wm->focused_window_id) {
-                    if ((!window->application->is_hidden) &&
-                        (!window->is_minimized) &&
-                        (!window->is_fullscreen)) {
-                        border_window_deactivate(window);
-                    }
-                }
-            }
-
-            bucket = bucket->next;
+    struct window_table_entry *entry;
+    table_foreach(entry, &wm->window) {
+        struct window *window = entry->value;
+        if (window->id != wm->focused_window_id) {
+            if (!window->is_minimized) border_window_deactivate(window);
         }
     }
 }
@@ -116,93 +81,123 @@ struct window *window_manager_focused_window(struct window_manager *wm)
 
 bool window_manager_find_lost_front_switched_event(struct window_manager *wm, pid_t pid)
 {
-    return table_find(&wm->application_lost_front_switched_event, &pid) != NULL;
+    return id_table_find(&wm->application_lost_front_switched_event, pid);
 }
 
 void window_manager_remove_lost_front_switched_event(struct window_manager *wm, pid_t pid)
 {
-    table_remove(&wm->application_lost_front_switched_event, &pid);
+    id_table_remove(&wm->application_lost_front_switched_event, pid);
 }
 
 void window_manager_add_lost_front_switched_event(struct window_manager *wm, pid_t pid)
 {
-    table_add(&wm->application_lost_front_switched_event, &pid, (void *)(intptr_t) 1);
+    id_table_add(&wm->application_lost_front_switched_event, pid, true);
 }
 
 bool window_manager_find_lost_focused_event(struct window_manager *wm, uint32_t window_id)
 {
-    return table_find(&wm->window_lost_focused_event, &window_id) != NULL;
+    return id_table_find(&wm->window_lost_focused_event, window_id);
 }
 
 void window_manager_remove_lost_focused_event(struct window_manager *wm, uint32_t window_id)
 {
-    table_remove(&wm->window_lost_focused_event, &window_id);
+    id_table_remove(&wm->window_lost_focused_event, window_id);
 }
 
 void window_manager_add_lost_focused_event(struct window_manager *wm, uint32_t window_id)
 {
-    table_add(&wm->window_lost_focused_event, &window_id, (void *)(intptr_t) 1);
+    id_table_add(&wm->window_lost_focused_event, window_id, true);
 }
 
+//
+// NOTE(koekeishiya): Geometry events may be handled by worker threads (see event_loop_worker), which
+// look windows up concurrently with the event loop thread. The event loop thread is the only one
+// that changes the window table and the window_list of an application, and does both while
+// holding the lock exclusively. A window that is removed must be released through
+// event_loop_retire, as a worker may still be using it.
+//
+
 struct window *window_manager_find_window(struct window_manager *wm, uint32_t window_id)
 {
-    return table_find(&wm->window, &window_id);
+    pthread_rwlock_rdlock(&wm->window_lock);
+    struct window *window = window_table_find(&wm->window, window_id);
+    pthread_rwlock_unlock(&wm->window_lock);
+    return window;
+}
+
+//
+// NOTE(koekeishiya): A window is removed from the table before it is destroyed, so it is safe to
+// read from while the lock is held, even on a thread that does not handle events. We do not wait
+// for the lock, because the thread that holds it might be the one we are asking about.
+//
+
+pid_t window_manager_find_window_pid(struct window_manager *wm, uint32_t window_id)
+{
+    if (pthread_rwlock_tryrdlock(&wm->window_lock) != 0) return 0;
+
+    struct window *window = window_table_find(&wm->window, window_id);
+    pid_t pid = window ? window->application->pid : 0;
+
+    pthread_rwlock_unlock(&wm->window_lock);
+    return pid;
 }
 
 void window_manager_remove_window(struct window_manager *wm, uint32_t window_id)
 {
-    table_remove(&wm->window, &window_id);
+    pthread_rwlock_wrlock(&wm->window_lock);
+    struct window *window = window_table_find(&wm->window, window_id);
+    if (!window) goto out;
+
+    struct application *application = window->application;
+    if (window->application_prev) {
+        window->application_prev->application_next = window->application_next;
+    } else {
+        application->window_list = window->application_next;
+    }
+
+    if (window->application_next) {
+        window->application_next->application_prev = window->application_prev;
+    }
+
+    window->application_next = NULL;
+    window->application_prev = NULL;
+
+    window_table_remove(&wm->window, window_id);
+
+out:
+    pthread_rwlock_unlock(&wm->window_lock);
 }
 
-void window_manager_add_window(struct window_manager *wm, struct window *window)
+bool window_manager_add_window(struct window_manager *wm, struct window *window)
 {
-    table_add(&wm->window, &window->id, window);
+    pthread_rwlock_wrlock(&wm->window_lock);
+    bool result = window_table_add(&wm->window, window->id, window);
+
+    if (result) {
+        struct application *application = window->application;
+        window->application_prev = NULL;
+        window->application_next = application->window_list;
+        if (application->window_list) application->window_list->application_prev = window;
+        application->window_list = window;
+    }
+
+    pthread_rwlock_unlock(&wm->window_lock);
+    return result;
 }
 
 struct application *window_manager_find_application(struct window_manager *wm, pid_t pid)
 {
-    return table_find(&wm->application, &pid);
+    return application_table_find(&wm->application, pid);
 }
 
 void window_manager_remove_application(struct window_manager *wm, pid_t pid)
 {
-    table_remove(&wm->application, &pid);
+    application_table_remove(&wm->application, pid);
 }
 
-void window_manager_add_application(struct window_manager *wm, struct application *application)
+bool window_manager_add_application(struct window_manager *wm, struct application *application)
 {
-    table_add(&wm->application, &application->pid, application);
-}
-
-struct window **window_manager_find_application_windows(struct window_manager *wm, struct application *application, int *count)
-{
-    int window_count = 0;
-    uint32_t window_list[MAXLEN];
-
-    for (int window_index = 0; window_index < wm->window.capacity; ++window_index) {
-        struct bucket *bucket = wm->window.buckets[window_index];
-        while (bucket) {
-            if (bucket->value) {
-                struct window *window = bucket->value;
-                if (window->application == application) {
-                    window_list[window_count++] = window->id;
-                }
-            }
-
-            bucket = bucket->next;
-        }
-    }
-
-    if (!window_count) return NULL;
-
-    struct window **result = malloc(sizeof(struct window *) * window_count);
-    *count = window_count;
-
-    for (int i = 0; i < window_count; ++i) {
-        result[i] = window_manager_find_window(wm, window_list[i]);
-    }
-
-    return result;
+    return application_table_add(&wm->application, application->pid, application);
 }
 
 void window_manager_add_application_windows(struct window_manager *wm, struct application *application)
@@ -233,30 +228,40 @@ void window_manager_add_application_windows(struct window_manager *wm, struct ap
             continue;
         }
 
+        if (!window_manager_add_window(wm, window)) {
+            debug("%s: could not add %s %d\n", __FUNCTION__, window->application->name, window->id);
+            window_unobserve(window);
+            window_destroy(window);
+            continue;
+        }
+
         debug("%s: %s %d\n", __FUNCTION__, window->application->name, window->id);
-        window_manager_add_window(wm, window);
     }
-
-    free(window_list);
 }
 
 bool window_manager_refresh_application_windows(struct window_manager *wm)
 {
     int window_count = wm->window.count;
-    for (int i = 0; i < wm->application.capacity; ++i) {
-        struct bucket *bucket = wm->application.buckets[i];
-        while (bucket) {
-            if (bucket->value) {
-                struct application *application = bucket->value;
-                window_manager_add_application_windows(wm, application);
-            }
-            bucket = bucket->next;
-        }
+    struct application_table_entry *entry;
+    table_foreach(entry, &wm->application) {
+        struct application *application = entry->value;
+        window_manager_add_application_windows(wm, application);
     }
 
     return window_count != wm->window.count;
 }
 
+static int window_manager_window_count(void)
+{
+    CFArrayRef window_list = CGWindowListCreate(kCGWindowListOptionAll, kCGNullWindowID);
+    if (!window_list) return 0;
+
+    int count = CFArrayGetCount(window_list);
+    CFRelease(window_list);
+
+    return count;
+}
+
 void window_manager_init(struct window_manager *wm)
 {
     wm->system_element = AXUIElementCreateSystemWide();
@@ -268,40 +273,34 @@ void window_manager_init(struct window_manager *wm)
     wm->active_window_border_color = 0xff775759;
     wm->normal_window_border_color = 0xff555555;
 
-    table_init(&wm->application, 150, hash_wm, compare_wm);
-    table_init(&wm->window, 150, hash_wm, compare_wm);
-    table_init(&wm->window_lost_focused_event, 150, hash_wm, compare_wm);
-    table_init(&wm->application_lost_front_switched_event, 150, hash_wm, compare_wm);
+    memory_slab_init(&wm->window_slab, sizeof(struct window) + sizeof(uint32_t *), WINDOW_SLAB_SIZE);
+    memory_slab_init(&wm->application_slab, sizeof(struct application), APPLICATION_SLAB_SIZE);
+
+    application_table_init(&wm->application, 150);
+    window_table_init(&wm->window, 150);
+    pthread_rwlock_init(&wm->window_lock, NULL);
+    id_table_init(&wm->window_lost_focused_event, 150);
+    id_table_init(&wm->application_lost_front_switched_event, 150);
+
+    application_table_reserve(&wm->application, g_process_manager.process.count);
+    window_table_reserve(&wm->window, window_manager_window_count());
 }
 
 void window_manager_begin(struct window_manager *wm)
 {
-    for (int process_index = 0; process_index < g_process_manager.process.capacity; ++process_index) {
-        struct bucket *bucket = g_process_manager.process.buckets[process_index];
-        while (bucket) {
-            if (bucket->value) {
-                struct process *process = bucket->value;
-                struct application *application = application_create(process);
-
-                if (application_observe(application)) {
-                    window_manager_add_application(wm, application);
-                    window_manager_add_application_windows(wm, application);
-                } else {
-                    application_unobserve(application);
-                    application_destroy(application);
-                }
-            }
-
-            bucket = bucket->next;
+    struct process_table_entry *entry;
+    table_foreach(entry, &g_process_manager.process) {
+        struct process *process = entry->value;
+        struct application *application = application_create(process);
+        if (!application) continue;
+
+        if (application_observe(application) && window_manager_add_application(wm, application)) {
+            window_manager_add_application_windows(wm, application);
+        } else {
+            application_unobserve(application);
+            application_destroy(application);
         }
     }
-
-    struct window *window = window_manager_focused_window(wm);
-    if (window) {
-        border_window_activate(window);
-        wm->focused_window_id = window->id;
-        wm->focused_window_psn = window->application->psn;
-    }
 }
 
 bool display_manager_display_is_animating(uint32_t did)
@@ -339,7 +338,8 @@ uint32_t *space_window_list(uint64_t sid, int *count, bool include_minimized)
     *count = CFArrayGetCount(window_list_ref);
     if (!*count) goto out;
 
-    window_list = malloc(*count * sizeof(uint32_t));
+    window_list = memory_arena_push(event_loop_scratch(&g_event_loop), uint32_t, *count);
+    if (!window_list) goto out;
 
     for (int i = 0; i < *count; ++i) {
         CFNumberRef id_ref = CFArrayGetValueAtIndex(window_list_ref, i);
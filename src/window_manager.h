@@ -7,13 +7,23 @@ extern bool SLSManagedDisplayIsAnimating(int cid, CFStringRef uuid);
 extern CFUUIDRef CGDisplayCreateUUIDFromDisplayID(uint32_t did);
 extern CFArrayRef SLSCopyWindowsWithOptionsAndTags(int cid, uint32_t owner, CFArrayRef spaces, uint32_t options, uint64_t *set_tags, uint64_t *clear_tags);
 
+#define WINDOW_SLAB_SIZE      KILOBYTES(64)
+#define APPLICATION_SLAB_SIZE KILOBYTES(16)
+
+TABLE_DEFINE(window_table, uint32_t, struct window *)
+TABLE_DEFINE(application_table, pid_t, struct application *)
+TABLE_DEFINE(id_table, uint32_t, bool)
+
 struct window_manager
 {
     AXUIElementRef system_element;
-    struct table application;
-    struct table window;
-    struct table window_lost_focused_event;
-    struct table application_lost_front_switched_event;
+    struct application_table application;
+    struct window_table window;
+    pthread_rwlock_t window_lock;
+    struct id_table window_lost_focused_event;
+    struct id_table application_lost_front_switched_event;
+    struct memory_slab window_slab;
+    struct memory_slab application_slab;
     uint32_t focused_window_id;
     ProcessSerialNumber focused_window_psn;
     int window_border_width;
@@ -36,12 +46,12 @@ bool window_manager_find_lost_focused_event(struct window_manager *wm, uint32_t
 void window_manager_remove_lost_focused_event(struct window_manager *wm, uint32_t window_id);
 void window_manager_add_lost_focused_event(struct window_manager *wm, uint32_t window_id);
 struct window *window_manager_find_window(struct window_manager *wm, uint32_t window_id);
+pid_t window_manager_find_window_pid(struct window_manager *wm, uint32_t window_id);
 void window_manager_remove_window(struct window_manager *wm, uint32_t window_id);
-void window_manager_add_window(struct window_manager *wm, struct window *window);
+bool window_manager_add_window(struct window_manager *wm, struct window *window);
 struct application *window_manager_find_application(struct window_manager *wm, pid_t pid);
 void window_manager_remove_application(struct window_manager *wm, pid_t pid);
-void window_manager_add_application(struct window_manager *wm, struct application *application);
-struct window **window_manager_find_application_windows(struct window_manager *wm, struct application *application, int *count);
+bool window_manager_add_application(struct window_manager *wm, struct application *application);
 void window_manager_add_application_windows(struct window_manager *wm, struct application *application);
 bool window_manager_refresh_application_windows(struct window_manager *wm);
 void window_manager_begin(struct window_manager *window_manager);
@@ -151,8 +151,8 @@ bool workspace_application_is_finished_launching(struct process *process)
             assert(!process->terminated);
 
             debug("%s: activation policy changed for %s (%d)\n", __FUNCTION__, process->name, process->pid);
-            struct event *event = event_create(&g_event_loop, APPLICATION_LAUNCHED, process);
-            event_loop_post(&g_event_loop, event);
+            struct event event = event_create(APPLICATION_LAUNCHED, process);
+            event_loop_post(&g_event_loop, &event);
 
             //
             // :WorstApiEverMade
@@ -176,8 +176,8 @@ bool workspace_application_is_finished_launching(struct process *process)
             assert(!process->terminated);
 
             debug("%s: %s (%d) finished launching\n", __FUNCTION__, process->name, process->pid);
-            struct event *event = event_create(&g_event_loop, APPLICATION_LAUNCHED, process);
-            event_loop_post(&g_event_loop, event);
+            struct event event = event_create(APPLICATION_LAUNCHED, process);
+            event_loop_post(&g_event_loop, &event);
 
             //
             // :WorstApiEverMade
@@ -197,34 +197,34 @@ bool workspace_application_is_finished_launching(struct process *process)
 
 - (void)didWake:(NSNotification *)notification
 {
-    struct event *event = event_create(&g_event_loop, SYSTEM_WOKE, NULL);
-    event_loop_post(&g_event_loop, event);
+    struct event event = event_create(SYSTEM_WOKE, NULL);
+    event_loop_post(&g_event_loop, &event);
 }
 
 - (void)activeDisplayDidChange:(NSNotification *)notification
 {
-    struct event *event = event_create(&g_event_loop, DISPLAY_CHANGED, NULL);
-    event_loop_post(&g_event_loop, event);
+    struct event event = event_create(DISPLAY_CHANGED, NULL);
+    event_loop_post(&g_event_loop, &event);
 }
 
 - (void)activeSpaceDidChange:(NSNotification *)notification
 {
-    struct event *event = event_create(&g_event_loop, SPACE_CHANGED, NULL);
-    event_loop_post(&g_event_loop, event);
+    struct event event = event_create(SPACE_CHANGED, NULL);
+    event_loop_post(&g_event_loop, &event);
 }
 
 - (void)didHideApplication:(NSNotification *)notification
 {
     pid_t pid = [[notification.userInfo objectForKey:NSWorkspaceApplicationKey] processIdentifier];
-    struct event *event = event_create(&g_event_loop, APPLICATION_HIDDEN, (void *)(intptr_t) pid);
-    event_loop_post(&g_event_loop, event);
+    struct event event = event_create(APPLICATION_HIDDEN, (void *)(intptr_t) pid);
+    event_loop_post(&g_event_loop, &event);
 }
 
 - (void)didUnhideApplication:(NSNotification *)notification
 {
     pid_t pid = [[notification.userInfo objectForKey:NSWorkspaceApplicationKey] processIdentifier];
-    struct event *event = event_create(&g_event_loop, APPLICATION_VISIBLE, (void *)(intptr_t) pid);
-    event_loop_post(&g_event_loop, event);
+    struct event event = event_create(APPLICATION_VISIBLE, (void *)(intptr_t) pid);
+    event_loop_post(&g_event_loop, &event);
 }
 
 @end
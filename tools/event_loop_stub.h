@@ -0,0 +1,105 @@
+#ifndef EVENT_LOOP_STUB_H
+#define EVENT_LOOP_STUB_H
+
+//
+// NOTE(koekeishiya): Compiles the event loop from src/ unchanged into limelight-test and
+// limelight-bench. Every event handler is replaced by a call through g_stub_handler, which a test
+// or benchmark points at its own function before it posts anything; event_destroy counts the
+// events that have been handled. The includer has to define time_monotonic_ns first.
+//
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <signal.h>
+#include <execinfo.h>
+#include <stdarg.h>
+
+static inline void warn(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+typedef struct { struct { double x, y; } origin; struct { double width, height; } size; } CGRect;
+static __thread uint64_t g_ax_call_count;
+
+#include "../src/misc/probe.h"
+#include "../src/misc/eventcount.h"
+#include "../src/misc/poller.h"
+#include "../src/misc/timer_wheel.h"
+#include "../src/misc/histogram.h"
+#include "../src/misc/trace.h"
+
+#include "../src/event.h"
+#include "../src/event_loop.h"
+#include "../src/event_loop.c"
+
+#define STUB_HANDLER(name) uint32_t name(enum event_type type, void *context, int param1, struct event_payload *payload)
+typedef STUB_HANDLER(stub_handler);
+
+static STUB_HANDLER(stub_handler_success)
+{
+    return EVENT_SUCCESS;
+}
+
+static stub_handler *volatile g_stub_handler = stub_handler_success;
+static volatile uint64_t g_stub_handled;
+
+#define STUB_EVENT_HANDLER(type) \
+    static EVENT_CALLBACK(EVENT_HANDLER_##type) { return g_stub_handler(type, context, param1, payload); }
+
+STUB_EVENT_HANDLER(APPLICATION_LAUNCHED)
+STUB_EVENT_HANDLER(APPLICATION_TERMINATED)
+STUB_EVENT_HANDLER(APPLICATION_FRONT_SWITCHED)
+STUB_EVENT_HANDLER(APPLICATION_ACTIVATED)
+STUB_EVENT_HANDLER(APPLICATION_DEACTIVATED)
+STUB_EVENT_HANDLER(APPLICATION_VISIBLE)
+STUB_EVENT_HANDLER(APPLICATION_HIDDEN)
+STUB_EVENT_HANDLER(WINDOW_CREATED)
+STUB_EVENT_HANDLER(WINDOW_DESTROYED)
+STUB_EVENT_HANDLER(WINDOW_FOCUSED)
+STUB_EVENT_HANDLER(WINDOW_MOVED)
+STUB_EVENT_HANDLER(WINDOW_RESIZED)
+STUB_EVENT_HANDLER(WINDOW_MINIMIZED)
+STUB_EVENT_HANDLER(WINDOW_DEMINIMIZED)
+STUB_EVENT_HANDLER(SPACE_CHANGED)
+STUB_EVENT_HANDLER(DISPLAY_CHANGED)
+STUB_EVENT_HANDLER(MISSION_CONTROL_ENTER)
+STUB_EVENT_HANDLER(MISSION_CONTROL_CHECK_FOR_EXIT)
+STUB_EVENT_HANDLER(MISSION_CONTROL_EXIT)
+STUB_EVENT_HANDLER(SYSTEM_WOKE)
+STUB_EVENT_HANDLER(DAEMON_MESSAGE)
+STUB_EVENT_HANDLER(DAEMON_MESSAGE_TIMEOUT)
+STUB_EVENT_HANDLER(DAEMON_STARTED)
+
+struct event event_create(enum event_type type, void *context)
+{
+    return (struct event) { .context = context, .info = 0, .timestamp = 0, .type = type, .param1 = 0, .coalesce_owner = false, .payload = { .type = EVENT_PAYLOAD_NONE } };
+}
+
+struct event event_create_p1(enum event_type type, void *context, int param1)
+{
+    struct event event = event_create(type, context);
+    event.param1 = param1;
+    return event;
+}
+
+uint32_t event_trace_id(struct event *event)
+{
+    return (uint32_t)(uintptr_t) event->context;
+}
+
+pid_t event_trace_pid(enum event_type type, uint32_t id)
+{
+    return 0;
+}
+
+void event_destroy(struct event_loop *event_loop, struct event *event)
+{
+    __sync_fetch_and_add(&g_stub_handled, 1);
+}
+
+#endif
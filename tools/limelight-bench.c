@@ -0,0 +1,787 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <semaphore.h>
+
+//
+// NOTE(koekeishiya): Micro-benchmarks for the event loop and src/misc. Every benchmark
+// compares the code that is compiled into limelight against the implementation it replaced,
+// which is kept here as a reference. Inputs are generated from a fixed seed, so runs only
+// differ in timing. Run them all with 'make bench', or a single one by name.
+//
+
+static inline uint64_t time_monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#include "../src/misc/macros.h"
+#include "../src/misc/memory_pool.h"
+#include "../src/misc/hashtable.h"
+#include "event_loop_stub.h"
+
+static uint64_t g_seed;
+
+static uint32_t bench_random(void)
+{
+    g_seed ^= g_seed << 13;
+    g_seed ^= g_seed >> 7;
+    g_seed ^= g_seed << 17;
+    return (uint32_t) g_seed;
+}
+
+static void bench_shuffle(uint32_t *keys, int count)
+{
+    for (int i = count - 1; i > 0; --i) {
+        int j = bench_random() % (i + 1);
+        uint32_t temp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = temp;
+    }
+}
+
+//
+// NOTE(koekeishiya): Unique window ids, in the range the window server hands out.
+//
+
+static uint32_t *bench_keys(int count)
+{
+    uint32_t *keys = malloc(count * sizeof(uint32_t));
+    for (int i = 0; i < count; ++i) {
+        bool unique;
+        do {
+            keys[i] = 1 + bench_random() % 0xfffff;
+            unique = true;
+            for (int j = 0; j < i && unique; ++j) unique = keys[j] != keys[i];
+        } while (!unique);
+    }
+    return keys;
+}
+
+//
+// NOTE(koekeishiya): The chained table that struct table used to be: one malloc'd node and one
+// malloc'd key copy per entry, hash and compare through function pointers, and a rehash that
+// re-inserts every entry at once.
+//
+
+struct chained_bucket
+{
+    void *key;
+    void *value;
+    struct chained_bucket *next;
+};
+
+struct chained_table
+{
+    int count;
+    int capacity;
+    float max_load;
+    unsigned long (*hash)(void *key);
+    int (*cmp)(void *key_a, void *key_b);
+    struct chained_bucket **buckets;
+};
+
+static void chained_table_init(struct chained_table *table, int capacity, unsigned long (*hash)(void *), int (*cmp)(void *, void *))
+{
+    table->count = 0;
+    table->capacity = capacity;
+    table->max_load = 0.75f;
+    table->hash = hash;
+    table->cmp = cmp;
+    table->buckets = calloc(capacity, sizeof(struct chained_bucket *));
+}
+
+static void chained_table_free(struct chained_table *table)
+{
+    for (int i = 0; i < table->capacity; ++i) {
+        struct chained_bucket *next, *bucket = table->buckets[i];
+        while (bucket) {
+            next = bucket->next;
+            free(bucket->key);
+            free(bucket);
+            bucket = next;
+        }
+    }
+
+    free(table->buckets);
+}
+
+static struct chained_bucket **chained_table_get_bucket(struct chained_table *table, void *key)
+{
+    struct chained_bucket **bucket = table->buckets + (table->hash(key) % table->capacity);
+    while (*bucket) {
+        if (table->cmp((*bucket)->key, key)) break;
+        bucket = &(*bucket)->next;
+    }
+    return bucket;
+}
+
+static void chained_table_rehash(struct chained_table *table)
+{
+    struct chained_bucket **old_buckets = table->buckets;
+    int old_capacity = table->capacity;
+
+    table->capacity = 2 * table->capacity;
+    table->buckets = calloc(table->capacity, sizeof(struct chained_bucket *));
+
+    for (int i = 0; i < old_capacity; ++i) {
+        struct chained_bucket *next, *old_bucket = old_buckets[i];
+        while (old_bucket) {
+            struct chained_bucket **new_bucket = chained_table_get_bucket(table, old_bucket->key);
+            *new_bucket = malloc(sizeof(struct chained_bucket));
+            (*new_bucket)->key = old_bucket->key;
+            (*new_bucket)->value = old_bucket->value;
+            (*new_bucket)->next = NULL;
+            next = old_bucket->next;
+            free(old_bucket);
+            old_bucket = next;
+        }
+    }
+
+    free(old_buckets);
+}
+
+static void chained_table_add(struct chained_table *table, void *key, int key_size, void *value)
+{
+    struct chained_bucket **bucket = chained_table_get_bucket(table, key);
+    if (*bucket) {
+        if (!(*bucket)->value) (*bucket)->value = value;
+    } else {
+        *bucket = malloc(sizeof(struct chained_bucket));
+        (*bucket)->key = malloc(key_size);
+        (*bucket)->value = value;
+        memcpy((*bucket)->key, key, key_size);
+        (*bucket)->next = NULL;
+
+        if ((1.0f * ++table->count) / table->capacity > table->max_load) {
+            chained_table_rehash(table);
+        }
+    }
+}
+
+static void chained_table_remove(struct chained_table *table, void *key)
+{
+    struct chained_bucket *next, **bucket = chained_table_get_bucket(table, key);
+    if (*bucket) {
+        free((*bucket)->key);
+        next = (*bucket)->next;
+        free(*bucket);
+        *bucket = next;
+        --table->count;
+    }
+}
+
+static void *chained_table_find(struct chained_table *table, void *key)
+{
+    struct chained_bucket *bucket = *chained_table_get_bucket(table, key);
+    return bucket ? bucket->value : NULL;
+}
+
+static unsigned long hash_wm(void *key)
+{
+    return *(uint32_t *) key;
+}
+
+static int compare_wm(void *key_a, void *key_b)
+{
+    return *(uint32_t *) key_a == *(uint32_t *) key_b;
+}
+
+TABLE_DEFINE(bench_table, uint32_t, void *)
+
+//
+// NOTE(koekeishiya): Both tables start out with the capacity that the window manager uses, and
+// grow to hold every window. Lookups are made in shuffled order, so that they do not walk the
+// table in insertion order. The figures are ns per operation.
+//
+
+static volatile uintptr_t g_sink;
+
+static void bench_table(void)
+{
+    int sizes[] = { 100, 1000, 10000 };
+    int rounds[] = { 2000, 200, 20 };
+
+    printf("%-8s %8s  %-11s %8s %8s %8s\n", "table", "windows", "", "add", "find", "remove");
+    for (int s = 0; s < (int) array_count(sizes); ++s) {
+        int count = sizes[s];
+        uint32_t *keys = bench_keys(count);
+        uint32_t *order = malloc(count * sizeof(uint32_t));
+        memcpy(order, keys, count * sizeof(uint32_t));
+        bench_shuffle(order, count);
+
+        uint64_t chained[3] = {0};
+        uint64_t open[3] = {0};
+
+        for (int round = 0; round < rounds[s]; ++round) {
+            struct chained_table chained_table;
+            chained_table_init(&chained_table, 150, hash_wm, compare_wm);
+
+            uint64_t t0 = time_monotonic_ns();
+            for (int i = 0; i < count; ++i) chained_table_add(&chained_table, &keys[i], sizeof(uint32_t), &keys[i]);
+            uint64_t t1 = time_monotonic_ns();
+            for (int i = 0; i < count; ++i) g_sink += (uintptr_t) chained_table_find(&chained_table, &order[i]);
+            uint64_t t2 = time_monotonic_ns();
+            for (int i = 0; i < count; ++i) chained_table_remove(&chained_table, &order[i]);
+            uint64_t t3 = time_monotonic_ns();
+
+            assert(chained_table.count == 0);
+            chained_table_free(&chained_table);
+            chained[0] += t1 - t0;
+            chained[1] += t2 - t1;
+            chained[2] += t3 - t2;
+
+            struct bench_table open_table;
+            bench_table_init(&open_table, 150);
+
+            t0 = time_monotonic_ns();
+            for (int i = 0; i < count; ++i) bench_table_add(&open_table, keys[i], &keys[i]);
+            t1 = time_monotonic_ns();
+            for (int i = 0; i < count; ++i) g_sink += (uintptr_t) bench_table_find(&open_table, order[i]);
+            t2 = time_monotonic_ns();
+            for (int i = 0; i < count; ++i) bench_table_remove(&open_table, order[i]);
+            t3 = time_monotonic_ns();
+
+            assert(open_table.count == 0);
+            bench_table_free(&open_table);
+            open[0] += t1 - t0;
+            open[1] += t2 - t1;
+            open[2] += t3 - t2;
+        }
+
+        double ops = (double) count * rounds[s];
+        printf("%-8s %8d  %-11s %8.1f %8.1f %8.1f\n", "table", count, "chained", chained[0] / ops, chained[1] / ops, chained[2] / ops);
+        printf("%-8s %8d  %-11s %8.1f %8.1f %8.1f\n", "table", count, "robin hood", open[0] / ops, open[1] / ops, open[2] / ops);
+
+        free(order);
+        free(keys);
+    }
+}
+
+//
+// NOTE(koekeishiya): The slowest single insertion while a table grows from the window manager's
+// initial capacity. The chained table re-inserts every entry in the insertion that crosses its
+// load factor; the robin hood table migrates TABLE_REHASH_STEP entries per operation instead.
+// Neither table is reserved, so the robin hood table also doubles its entries array on the way,
+// and the insertions that start and run those migrations are part of the maxima; grows is the
+// number of times it did so. Every run builds a fresh table; the figures are the median and the
+// worst of the per-run maxima.
+//
+
+static int bench_compare_u64(const void *a, const void *b)
+{
+    uint64_t ua = *(const uint64_t *) a;
+    uint64_t ub = *(const uint64_t *) b;
+    return ua < ub ? -1 : ua > ub;
+}
+
+static void bench_table_insert(void)
+{
+    int sizes[] = { 1000, 10000, 100000 };
+    enum { RUNS = 20 };
+
+    printf("%-12s %8s  %-11s %12s %12s %6s\n", "table-insert", "windows", "", "median max", "worst max", "grows");
+    for (int s = 0; s < (int) array_count(sizes); ++s) {
+        int count = sizes[s];
+        uint32_t *keys = malloc(count * sizeof(uint32_t));
+        for (int i = 0; i < count; ++i) keys[i] = 1 + i * 7;
+        bench_shuffle(keys, count);
+
+        uint64_t chained[RUNS];
+        uint64_t open[RUNS];
+        int grows = 0;
+
+        for (int run = 0; run < RUNS; ++run) {
+            struct chained_table chained_table;
+            chained_table_init(&chained_table, 150, hash_wm, compare_wm);
+
+            chained[run] = 0;
+            for (int i = 0; i < count; ++i) {
+                uint64_t begin = time_monotonic_ns();
+                chained_table_add(&chained_table, &keys[i], sizeof(uint32_t), &keys[i]);
+                uint64_t elapsed = time_monotonic_ns() - begin;
+                if (elapsed > chained[run]) chained[run] = elapsed;
+            }
+
+            chained_table_free(&chained_table);
+
+            struct bench_table open_table;
+            bench_table_init(&open_table, 150);
+
+            open[run] = 0;
+            for (int i = 0; i < count; ++i) {
+                bool was_migrating = open_table.old_entries != NULL;
+                uint64_t begin = time_monotonic_ns();
+                bench_table_add(&open_table, keys[i], &keys[i]);
+                uint64_t elapsed = time_monotonic_ns() - begin;
+                if (elapsed > open[run]) open[run] = elapsed;
+                if (run == 0 && !was_migrating && open_table.old_entries) ++grows;
+            }
+
+            bench_table_free(&open_table);
+        }
+
+        qsort(chained, RUNS, sizeof(uint64_t), bench_compare_u64);
+        qsort(open, RUNS, sizeof(uint64_t), bench_compare_u64);
+
+        printf("%-12s %8d  %-11s %9.1f us %9.1f us %6s\n", "table-insert", count, "chained", chained[RUNS / 2] / 1e3, chained[RUNS - 1] / 1e3, "");
+        printf("%-12s %8d  %-11s %9.1f us %9.1f us %6d\n", "table-insert", count, "robin hood", open[RUNS / 2] / 1e3, open[RUNS - 1] / 1e3, grows);
+
+        free(keys);
+    }
+}
+
+//
+// NOTE(koekeishiya): A sweep over every window, like hiding and showing the borders of all windows,
+// after churn has left the slot array mostly empty: 2000 windows are created and 1500 of them are
+// destroyed again. Scanning the slot array has to test every slot, and then follow its index;
+// table_foreach walks the dense entries. The figures are ns per sweep.
+//
+
+static void bench_table_sweep(void)
+{
+    enum { CREATED = 2000, DESTROYED = 1500, SWEEPS = 20000 };
+
+    uint32_t *keys = bench_keys(CREATED);
+    struct bench_table table;
+    bench_table_init(&table, 150);
+
+    for (int i = 0; i < CREATED; ++i) bench_table_add(&table, keys[i], &keys[i]);
+    bench_shuffle(keys, CREATED);
+    for (int i = 0; i < DESTROYED; ++i) bench_table_remove(&table, keys[i]);
+    bench_table_reserve(&table, table.count);
+
+    uint64_t begin = time_monotonic_ns();
+    for (int sweep = 0; sweep < SWEEPS; ++sweep) {
+        for (int i = 0; i < table.slot_capacity; ++i) {
+            struct bench_table_slot *slot = table.slots + i;
+            if (slot->distance) g_sink += (uintptr_t) table_entry(&table, slot->index)->value;
+        }
+    }
+    uint64_t slot_scan = time_monotonic_ns() - begin;
+
+    begin = time_monotonic_ns();
+    for (int sweep = 0; sweep < SWEEPS; ++sweep) {
+        struct bench_table_entry *entry;
+        table_foreach(entry, &table) {
+            g_sink += (uintptr_t) entry->value;
+        }
+    }
+    uint64_t foreach = time_monotonic_ns() - begin;
+
+    printf("%-12s %8s  %-14s %8s\n", "table-sweep", "windows", "", "ns/sweep");
+    printf("%-12s %8d  %-14s %8.1f\n", "table-sweep", table.count, "slot scan", (double) slot_scan / SWEEPS);
+    printf("%-12s %8d  %-14s %8.1f\n", "table-sweep", table.count, "table_foreach", (double) foreach / SWEEPS);
+
+    bench_table_free(&table);
+    free(keys);
+}
+
+//
+// NOTE(koekeishiya): Window churn with 1000 live windows: destroy a random window and create a new
+// one in its place. struct window used to be two mallocs, one for the window and one for id_ptr;
+// the slab hands out both in a single zeroed object, from a pool as large as WINDOW_SLAB_SIZE.
+// The object size is about that of struct window on 64-bit. The figures are ns per destroy and create.
+//
+
+#define BENCH_WINDOW_SIZE 120
+
+static void bench_slab(void)
+{
+    enum { LIVE = 1000, CHURN = 2000000 };
+
+    void **live = malloc(LIVE * sizeof(void *));
+    uint32_t *victim = malloc(CHURN * sizeof(uint32_t));
+    for (int i = 0; i < CHURN; ++i) victim[i] = bench_random() % LIVE;
+
+    for (int i = 0; i < LIVE; ++i) {
+        live[i] = malloc(BENCH_WINDOW_SIZE);
+        memset(live[i], 0, BENCH_WINDOW_SIZE);
+        *(void **) live[i] = malloc(sizeof(uint32_t *));
+    }
+
+    uint64_t begin = time_monotonic_ns();
+    for (int i = 0; i < CHURN; ++i) {
+        void *window = live[victim[i]];
+        free(*(void **) window);
+        free(window);
+
+        window = malloc(BENCH_WINDOW_SIZE);
+        memset(window, 0, BENCH_WINDOW_SIZE);
+        *(void **) window = malloc(sizeof(uint32_t *));
+        live[victim[i]] = window;
+    }
+    uint64_t heap = time_monotonic_ns() - begin;
+
+    for (int i = 0; i < LIVE; ++i) {
+        free(*(void **) live[i]);
+        free(live[i]);
+    }
+
+    struct memory_slab slab;
+    memory_slab_init(&slab, BENCH_WINDOW_SIZE + sizeof(uint32_t *), KILOBYTES(64));
+    for (int i = 0; i < LIVE; ++i) live[i] = memory_slab_alloc(&slab);
+
+    begin = time_monotonic_ns();
+    for (int i = 0; i < CHURN; ++i) {
+        memory_slab_free(&slab, live[victim[i]]);
+        void *window = memory_slab_alloc(&slab);
+        *(void **) window = (char *) window + BENCH_WINDOW_SIZE;
+        live[victim[i]] = window;
+    }
+    uint64_t slab_churn = time_monotonic_ns() - begin;
+
+    printf("%-8s %8s  %-11s %8s\n", "slab", "windows", "", "ns/churn");
+    printf("%-8s %8d  %-11s %8.1f\n", "slab", LIVE, "malloc", (double) heap / CHURN);
+    printf("%-8s %8d  %-11s %8.1f\n", "slab", LIVE, "memory_slab", (double) slab_churn / CHURN);
+    printf("%-8s %8d  %-11s %8llu\n", "slab", LIVE, "overflow", (unsigned long long) slab.overflow);
+
+    free(victim);
+    free(live);
+}
+
+//
+// NOTE(koekeishiya): The temporary arrays of one event: the window list of an application with
+// 8 to 39 windows, and the space list of every window, as application_window_list and
+// window_space_list build them. They used to be malloc'd and freed by the caller; they now come
+// from the scratch arena, which the event loop resets after every handler. The figures are ns
+// and mallocs per event.
+//
+
+static void bench_arena(void)
+{
+    enum { EVENTS = 200000 };
+
+    uint8_t *windows = malloc(EVENTS);
+    for (int i = 0; i < EVENTS; ++i) windows[i] = 8 + bench_random() % 32;
+
+    uint64_t heap_mallocs = 0;
+    uint64_t begin = time_monotonic_ns();
+    for (int i = 0; i < EVENTS; ++i) {
+        void **window_list = malloc(windows[i] * sizeof(void *));
+        ++heap_mallocs;
+
+        for (int j = 0; j < windows[i]; ++j) {
+            uint64_t *space_list = malloc(sizeof(uint64_t));
+            ++heap_mallocs;
+            *space_list = j;
+            window_list[j] = space_list;
+        }
+
+        for (int j = 0; j < windows[i]; ++j) {
+            g_sink += *(uint64_t *) window_list[j];
+            free(window_list[j]);
+        }
+
+        free(window_list);
+    }
+    uint64_t heap = time_monotonic_ns() - begin;
+
+    struct memory_arena arena;
+    memory_arena_init(&arena, KILOBYTES(256));
+
+    begin = time_monotonic_ns();
+    for (int i = 0; i < EVENTS; ++i) {
+        void **window_list = memory_arena_push(&arena, void *, windows[i]);
+
+        for (int j = 0; j < windows[i]; ++j) {
+            uint64_t *space_list = memory_arena_push(&arena, uint64_t, 1);
+            *space_list = j;
+            window_list[j] = space_list;
+        }
+
+        for (int j = 0; j < windows[i]; ++j) g_sink += *(uint64_t *) window_list[j];
+        memory_arena_reset(&arena);
+    }
+    uint64_t scratch = time_monotonic_ns() - begin;
+
+    printf("%-8s %-14s %10s %14s\n", "arena", "", "ns/event", "mallocs/event");
+    printf("%-8s %-14s %10.1f %14.2f\n", "arena", "malloc/free", (double) heap / EVENTS, (double) heap_mallocs / EVENTS);
+    printf("%-8s %-14s %10.1f %14.2f\n", "arena", "scratch arena", (double) scratch / EVENTS, (double) arena.overflow_count / EVENTS);
+
+    free(windows);
+}
+
+//
+// NOTE(koekeishiya): The linked queue that the event ring replaced: every post takes a node from a
+// shared bump allocator and links it in with a CAS on the tail, and the consumer follows the
+// links. Nodes come from one preallocated array here, so that neither side pays for malloc.
+//
+
+struct linked_node
+{
+    struct event *event;
+    struct linked_node *volatile next;
+};
+
+struct linked_queue
+{
+    struct linked_node *node;
+    volatile uint64_t node_used;
+    struct linked_node *volatile head;
+    struct linked_node *volatile tail;
+};
+
+static void linked_queue_init(struct linked_queue *queue, uint64_t count)
+{
+    queue->node = malloc((count + 1) * sizeof(struct linked_node));
+    queue->node_used = 1;
+    queue->head = queue->tail = queue->node;
+    queue->node->next = NULL;
+}
+
+static void linked_queue_push(struct linked_queue *queue, struct event *event)
+{
+    struct linked_node *node = queue->node + __sync_fetch_and_add(&queue->node_used, 1);
+    node->event = event;
+    node->next = NULL;
+    __sync_synchronize();
+
+    struct linked_node *tail;
+    bool success;
+    do {
+        tail = queue->tail;
+        success = __sync_bool_compare_and_swap(&tail->next, NULL, node);
+        if (!success) __sync_bool_compare_and_swap(&queue->tail, tail, tail->next);
+    } while (!success);
+    __sync_bool_compare_and_swap(&queue->tail, tail, node);
+}
+
+static struct event *linked_queue_pop(struct linked_queue *queue)
+{
+    struct linked_node *head = queue->head;
+    if (!head->next) return NULL;
+
+    queue->head = head->next;
+    return head->next->event;
+}
+
+//
+// NOTE(koekeishiya): 1 to 8 producers post 2M events in total while a single consumer drains the
+// queue, the way window server notifications from several threads reach the event loop. The
+// linked queue's producers hand over a pointer to an event they allocated; ring producers copy
+// the event into its cell. The figures are millions of events per second from the first post to
+// the last pop, so on a machine with fewer cores than producers they mostly measure scheduling.
+//
+
+#define BENCH_RING_EVENTS 2000000
+
+struct bench_ring_producer
+{
+    struct queue *ring;
+    struct linked_queue *linked;
+    struct event *events;
+    int count;
+    pthread_t thread;
+};
+
+static void *bench_ring_produce(void *context)
+{
+    struct bench_ring_producer *producer = context;
+
+    for (int i = 0; i < producer->count; ++i) {
+        struct event event = event_create(WINDOW_MOVED, (void *)(uintptr_t) i);
+        while (!queue_push(producer->ring, &event)) sched_yield();
+    }
+
+    return NULL;
+}
+
+static void *bench_linked_produce(void *context)
+{
+    struct bench_ring_producer *producer = context;
+
+    for (int i = 0; i < producer->count; ++i) {
+        producer->events[i] = event_create(WINDOW_MOVED, (void *)(uintptr_t) i);
+        linked_queue_push(producer->linked, &producer->events[i]);
+    }
+
+    return NULL;
+}
+
+static double bench_ring_run(int producer_count, bool ring)
+{
+    struct queue queue;
+    struct linked_queue linked;
+    if (ring) queue_init(&queue, EVENT_QUEUE_SIZE);
+    else linked_queue_init(&linked, BENCH_RING_EVENTS);
+
+    struct event *events = ring ? NULL : malloc(BENCH_RING_EVENTS * sizeof(struct event));
+    struct bench_ring_producer producer[8];
+    int count = BENCH_RING_EVENTS / producer_count;
+
+    uint64_t begin = time_monotonic_ns();
+    for (int i = 0; i < producer_count; ++i) {
+        producer[i] = (struct bench_ring_producer) { .ring = &queue, .linked = &linked, .events = events ? events + i * count : NULL, .count = count };
+        pthread_create(&producer[i].thread, NULL, ring ? bench_ring_produce : bench_linked_produce, &producer[i]);
+    }
+
+    for (int received = 0; received < count * producer_count;) {
+        if (ring) {
+            struct event event;
+            if (!queue_pop(&queue, &event)) { sched_yield(); continue; }
+            g_sink += (uintptr_t) event.context;
+        } else {
+            struct event *event = linked_queue_pop(&linked);
+            if (!event) { sched_yield(); continue; }
+            g_sink += (uintptr_t) event->context;
+        }
+        ++received;
+    }
+    uint64_t elapsed = time_monotonic_ns() - begin;
+
+    for (int i = 0; i < producer_count; ++i) pthread_join(producer[i].thread, NULL);
+
+    if (ring) free(queue.cells);
+    else free(linked.node);
+    free(events);
+
+    return (double) count * producer_count / (elapsed / 1e3);
+}
+
+static void bench_ring(void)
+{
+    int producers[] = { 1, 2, 4, 8 };
+
+    printf("%-8s %9s  %10s %10s\n", "ring", "producers", "linked M/s", "ring M/s");
+    for (int i = 0; i < (int) array_count(producers); ++i) {
+        double linked = bench_ring_run(producers[i], false);
+        double ring = bench_ring_run(producers[i], true);
+        printf("%-8s %9d  %10.2f %10.2f\n", "ring", producers[i], linked, ring);
+    }
+}
+
+//
+// NOTE(koekeishiya): The event loop used to park on a named semaphore, and on macOS every
+// sem_post is a syscall. glibc only makes one when a thread is waiting, so the semaphore here is
+// kinder than the one we replaced. 'post' is the cost of announcing one event while the consumer
+// is busy, which is the common case during a burst. 'wake' is the time from a post to a parked
+// consumer running again, as the median and 99th percentile of 20000 hand-offs; it is mostly
+// scheduler latency.
+//
+
+#define BENCH_WAKE_COUNT 20000
+
+static struct eventcount g_bench_eventcount;
+static sem_t g_bench_semaphore;
+static volatile uint64_t g_bench_wake_posted;
+static volatile int g_bench_wake_parked;
+static uint64_t g_bench_wake[BENCH_WAKE_COUNT];
+
+static void *bench_wake_eventcount(void *context)
+{
+    for (int i = 0; i < BENCH_WAKE_COUNT; ++i) {
+        uint32_t key = eventcount_prepare(&g_bench_eventcount);
+        g_bench_wake_parked = 1;
+        eventcount_wait(&g_bench_eventcount, key);
+        g_bench_wake[i] = time_monotonic_ns() - g_bench_wake_posted;
+    }
+
+    return NULL;
+}
+
+static void *bench_wake_semaphore(void *context)
+{
+    for (int i = 0; i < BENCH_WAKE_COUNT; ++i) {
+        g_bench_wake_parked = 1;
+        sem_wait(&g_bench_semaphore);
+        g_bench_wake[i] = time_monotonic_ns() - g_bench_wake_posted;
+    }
+
+    return NULL;
+}
+
+static void bench_wake_run(bool semaphore, double *median, double *p99)
+{
+    pthread_t thread;
+    pthread_create(&thread, NULL, semaphore ? bench_wake_semaphore : bench_wake_eventcount, NULL);
+
+    for (int i = 0; i < BENCH_WAKE_COUNT; ++i) {
+        while (!g_bench_wake_parked) sched_yield();
+        usleep(1);
+
+        g_bench_wake_parked = 0;
+        g_bench_wake_posted = time_monotonic_ns();
+        if (semaphore) sem_post(&g_bench_semaphore);
+        else eventcount_signal(&g_bench_eventcount);
+    }
+
+    pthread_join(thread, NULL);
+    qsort(g_bench_wake, BENCH_WAKE_COUNT, sizeof(uint64_t), bench_compare_u64);
+    *median = g_bench_wake[BENCH_WAKE_COUNT / 2] / 1e3;
+    *p99 = g_bench_wake[BENCH_WAKE_COUNT * 99 / 100] / 1e3;
+}
+
+static void bench_wake(void)
+{
+    enum { POSTS = 1000000 };
+
+    eventcount_init(&g_bench_eventcount);
+    sem_init(&g_bench_semaphore, 0, 0);
+
+    uint64_t begin = time_monotonic_ns();
+    for (int i = 0; i < POSTS; ++i) sem_post(&g_bench_semaphore);
+    uint64_t semaphore_post = time_monotonic_ns() - begin;
+    while (sem_trywait(&g_bench_semaphore) == 0);
+
+    begin = time_monotonic_ns();
+    for (int i = 0; i < POSTS; ++i) eventcount_signal(&g_bench_eventcount);
+    uint64_t eventcount_post = time_monotonic_ns() - begin;
+
+    double semaphore_median, semaphore_p99;
+    double eventcount_median, eventcount_p99;
+    bench_wake_run(true, &semaphore_median, &semaphore_p99);
+    bench_wake_run(false, &eventcount_median, &eventcount_p99);
+
+    printf("%-8s %-11s %10s %12s %12s\n", "wake", "", "post ns", "wake p50 us", "wake p99 us");
+    printf("%-8s %-11s %10.1f %12.1f %12.1f\n", "wake", "semaphore", (double) semaphore_post / POSTS, semaphore_median, semaphore_p99);
+    printf("%-8s %-11s %10.1f %12.1f %12.1f\n", "wake", "eventcount", (double) eventcount_post / POSTS, eventcount_median, eventcount_p99);
+
+    sem_destroy(&g_bench_semaphore);
+}
+
+struct benchmark
+{
+    const char *name;
+    void (*run)(void);
+};
+
+static struct benchmark benchmarks[] =
+{
+    { "table",        bench_table        },
+    { "table-insert", bench_table_insert },
+    { "table-sweep",  bench_table_sweep  },
+    { "slab",         bench_slab         },
+    { "arena",        bench_arena        },
+    { "ring",         bench_ring         },
+    { "wake",         bench_wake         },
+};
+
+int main(int argc, char **argv)
+{
+    bool found = false;
+    for (int i = 0; i < (int) array_count(benchmarks); ++i) {
+        if (argc > 1 && strcmp(argv[1], benchmarks[i].name) != 0) continue;
+
+        g_seed = 0x9e3779b97f4a7c15ULL;
+        benchmarks[i].run();
+        found = true;
+    }
+
+    if (!found) {
+        fprintf(stderr, "usage: limelight-bench [benchmark]\nbenchmarks:");
+        for (int i = 0; i < (int) array_count(benchmarks); ++i) fprintf(stderr, " %s", benchmarks[i].name);
+        fprintf(stderr, "\n");
+        return 1;
+    }
+
+    return 0;
+}
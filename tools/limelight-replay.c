@@ -0,0 +1,1274 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <execinfo.h>
+#include <stdarg.h>
+#include <sys/mman.h>
+
+//
+// NOTE(koekeishiya): Replay harness for the event pipeline. The event loop, the event queues,
+// coalescing, lanes, batching and the timer wheel are compiled in unchanged from src/, and events
+// are dispatched through the real event_handler[] table from event.h. The handlers themselves are
+// replaced by the ones below, which run against an in-memory window server: the real handlers
+// call into the Accessibility API, SkyLight and CoreFoundation on nearly every line, none of
+// which exist outside of macOS. The mock handlers make the same number of AX and SLS calls as
+// the real ones (following border.c and event.c), so that call counts can be compared between
+// revisions. Every allocation made by the event loop or the mock goes through replay_malloc.
+// With -w, geometry handlers run on event loop workers, so the mock counts calls atomically.
+// The daemon socket is real, and served the same way as in message.c.
+//
+
+static volatile uint64_t g_alloc_count;
+static volatile uint64_t g_alloc_bytes;
+static uint64_t g_alloc_count_base;
+static uint64_t g_alloc_bytes_base;
+
+static void *replay_malloc(size_t size)
+{
+    __sync_fetch_and_add(&g_alloc_count, 1);
+    __sync_fetch_and_add(&g_alloc_bytes, size);
+    return malloc(size);
+}
+
+static void *replay_realloc(void *ptr, size_t size)
+{
+    __sync_fetch_and_add(&g_alloc_count, 1);
+    __sync_fetch_and_add(&g_alloc_bytes, size);
+    return realloc(ptr, size);
+}
+
+#define malloc(size)       replay_malloc(size)
+#define realloc(ptr, size) replay_realloc(ptr, size)
+
+static inline void warn(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+//
+// NOTE(koekeishiya): Scenarios can move the clock forward with g_clock_offset, so that timers and
+// continuations fire without the harness having to wait for them.
+//
+
+static volatile uint64_t g_clock_offset;
+
+static inline uint64_t time_monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec + g_clock_offset;
+}
+
+#include "../src/misc/macros.h"
+#include "../src/misc/probe.h"
+#include "../src/misc/memory_pool.h"
+#include "../src/misc/eventcount.h"
+#include "../src/misc/poller.h"
+#include "../src/misc/timer_wheel.h"
+#include "../src/misc/histogram.h"
+#include "../src/misc/trace.h"
+//
+// NOTE(koekeishiya): Stand-in for the CoreGraphics type carried by event payloads. The AX call
+// counter is normally declared in helpers.h; the mock AX calls below bump it, so that the event
+// loop attributes them to event types the same way it does in the daemon.
+//
+
+typedef struct { struct { double x, y; } origin; struct { double width, height; } size; } CGRect;
+static __thread uint64_t g_ax_call_count;
+
+#include "../src/event.h"
+#include "../src/event_loop.h"
+#include "../src/event_loop.c"
+#include "../src/misc/socket.c"
+
+//
+// NOTE(koekeishiya): Copied from process_manager.h, which can not be included without Carbon.
+//
+
+#define PROCESS_LAUNCH_RETRY_MIN_MS 20
+#define PROCESS_LAUNCH_RETRY_MAX_MS 100
+
+enum process_launch_stage
+{
+    PROCESS_LAUNCH_OBSERVABLE,
+    PROCESS_LAUNCH_FINISHED_LAUNCHING,
+    PROCESS_LAUNCH_OBSERVE,
+    PROCESS_LAUNCH_DONE
+};
+
+#define FAKE_WINDOW_MAX 4096
+#define FAKE_APP_MAX    256
+
+struct fake_window
+{
+    volatile uint64_t posted;
+    uint32_t id;
+    int pid;
+    float x, y, w, h;
+    int level;
+    int space;
+    bool minimized;
+    bool observed;
+    bool fullscreen;
+    bool is_fullscreen;
+};
+
+enum fake_launch_wait
+{
+    FAKE_LAUNCH_WAIT_NONE,
+    FAKE_LAUNCH_WAIT_OBSERVABLE,
+    FAKE_LAUNCH_WAIT_FINISHED_LAUNCHING
+};
+
+struct fake_app
+{
+    int pid;
+    bool observed;
+    bool hidden;
+    uint32_t ax_delay_us;
+    uint64_t launched;
+    uint64_t observable_at;
+    uint64_t finished_at;
+    uint64_t ax_ready_at;
+    volatile uint8_t launch_stage;
+    uint8_t launch_attempt;
+    volatile uint8_t launch_wait;
+    bool has_observer;
+    uint8_t notification;
+    uint64_t retry_timer;
+};
+
+struct fake_server
+{
+    struct fake_window window[FAKE_WINDOW_MAX];
+    uint32_t window_count;
+    struct fake_app app[FAKE_APP_MAX];
+    uint32_t app_count;
+    int active_space;
+    uint64_t animation_end;
+    uint64_t continuations;
+    uint64_t fullscreen_exits;
+    int front_pid;
+    uint32_t focused_window_id;
+    volatile uint64_t ax_calls;
+    volatile uint64_t sls_calls;
+    volatile uint64_t sls_updates;
+    int update_disable_count;
+    uint64_t update_disabled_at;
+    uint64_t update_disabled_max;
+    volatile uint64_t workspace_calls;
+    uint64_t launch_retries;
+};
+
+#define fake_count(counter, n) __sync_fetch_and_add(&g_server.counter, n)
+#define fake_ax_count(n)       (fake_count(ax_calls, n), g_ax_call_count += (n))
+
+static struct fake_server g_server;
+static struct event_loop g_event_loop;
+static volatile uint64_t g_handled;
+static uint64_t g_posted;
+
+static struct fake_window *fake_window(uint32_t id)
+{
+    return id && id <= g_server.window_count ? &g_server.window[id - 1] : NULL;
+}
+
+static struct fake_app *fake_app(int pid)
+{
+    for (uint32_t i = 0; i < g_server.app_count; ++i) {
+        if (g_server.app[i].pid == pid) return &g_server.app[i];
+    }
+
+    return NULL;
+}
+
+static uint32_t fake_window_create(int pid, int space)
+{
+    assert(g_server.window_count < FAKE_WINDOW_MAX);
+    uint32_t id = ++g_server.window_count;
+    g_server.window[id - 1] = (struct fake_window) { .id = id, .pid = pid, .x = 100, .y = 100, .w = 800, .h = 600, .space = space };
+    return id;
+}
+
+static int fake_app_create(void)
+{
+    assert(g_server.app_count < FAKE_APP_MAX);
+    int pid = 1000 + g_server.app_count;
+    g_server.app[g_server.app_count++] = (struct fake_app) { .pid = pid };
+    return pid;
+}
+
+//
+// NOTE(koekeishiya): Like SLSDisableUpdate, the mock counts disabled updates per connection, and
+// records the longest time that updates stayed disabled for every thread.
+//
+
+static pthread_mutex_t g_update_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void fake_sls_disable_update(void)
+{
+    fake_count(sls_calls, 1);
+
+    pthread_mutex_lock(&g_update_lock);
+    if (g_server.update_disable_count++ == 0) g_server.update_disabled_at = time_monotonic_ns();
+    pthread_mutex_unlock(&g_update_lock);
+}
+
+static void fake_sls_reenable_update(void)
+{
+    fake_count(sls_calls, 1);
+    fake_count(sls_updates, 1);
+
+    pthread_mutex_lock(&g_update_lock);
+    if (--g_server.update_disable_count == 0) {
+        uint64_t disabled = time_monotonic_ns() - g_server.update_disabled_at;
+        if (disabled > g_server.update_disabled_max) g_server.update_disabled_max = disabled;
+    }
+    pthread_mutex_unlock(&g_update_lock);
+}
+
+static __thread bool g_batch;
+static __thread bool g_updates_disabled;
+static pthread_mutex_t g_latency_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct histogram g_latency;
+static bool g_measure_latency;
+static const char *g_latency_name = "border latency of other apps";
+static pthread_mutex_t g_gate = PTHREAD_MUTEX_INITIALIZER;
+static bool g_in_burst;
+static volatile uint64_t g_fences;
+
+static EVENT_LOOP_BATCH_CALLBACK(fake_batch_begin)
+{
+    pthread_mutex_lock(&g_gate);
+    pthread_mutex_unlock(&g_gate);
+    g_batch = pthread_equal(pthread_self(), g_event_loop.thread);
+}
+
+static EVENT_LOOP_BATCH_CALLBACK(fake_batch_end)
+{
+    if (g_updates_disabled) {
+        fake_sls_reenable_update();
+        g_updates_disabled = false;
+    }
+
+    g_batch = false;
+}
+
+static void fake_disable_update(void)
+{
+    if (!g_batch) {
+        fake_sls_disable_update();
+    } else if (!g_updates_disabled) {
+        fake_sls_disable_update();
+        g_updates_disabled = true;
+    }
+}
+
+static void fake_reenable_update(void)
+{
+    if (!g_batch) fake_sls_reenable_update();
+}
+
+static void fake_border_refresh_frame(struct fake_window *window)
+{
+    fake_count(sls_calls, 1);                                 // window_space_list
+    fake_count(sls_calls, window->space < 0 ? 1 : 2);         // tags / move to managed space
+    fake_disable_update();
+    fake_count(sls_calls, 3);                                 // order out, set shape, order in
+    fake_reenable_update();
+}
+
+static void fake_ax_wait(struct fake_window *window)
+{
+    struct fake_app *app = fake_app(window->pid);
+    if (app && app->ax_delay_us) usleep(app->ax_delay_us);
+}
+
+static void fake_border_refresh(struct fake_window *window)
+{
+    fake_ax_count(1);                                         // window_ax_frame
+    fake_ax_wait(window);
+    fake_border_refresh_frame(window);
+}
+
+static void fake_record_latency(struct fake_window *window)
+{
+    uint64_t posted = __sync_lock_test_and_set(&window->posted, 0);
+    struct fake_app *app = fake_app(window->pid);
+
+    if (g_measure_latency && posted && app && !app->ax_delay_us) {
+        pthread_mutex_lock(&g_latency_lock);
+        histogram_record(&g_latency, time_monotonic_ns() - posted);
+        pthread_mutex_unlock(&g_latency_lock);
+    }
+}
+
+static void fake_border_refresh_payload(struct fake_window *window, struct event_payload *payload)
+{
+    if (payload->type != EVENT_PAYLOAD_FRAME) fake_count(sls_calls, 1); // window_frame
+    fake_border_refresh_frame(window);
+}
+
+static void fake_border_set_level(struct fake_window *window)
+{
+    fake_disable_update();
+    fake_count(sls_calls, 1);                                 // SLSSetWindowLevel
+    fake_reenable_update();
+}
+
+static void fake_border_create(struct fake_window *window)
+{
+    fake_count(sls_calls, 5);                                 // new window, resolution, tags, opacity, level
+    fake_ax_count(3);                                         // window id, role, subrole
+    window->observed = true;
+    fake_border_refresh(window);
+}
+
+//
+// NOTE(koekeishiya): Follows the launch task in event.c. With g_launch_restart set, it instead
+// follows the launch handler as it was before: every event starts over from the first stage, the
+// observer is destroyed after a failed attempt, and failed attempts are retried every 100ms.
+// Retries are posted with param1 set, so that they can be counted with the fences.
+//
+
+static bool g_launch_restart;
+static struct histogram g_launch_lateness;
+
+static void fake_launch_retry(struct fake_app *app)
+{
+    uint32_t delay = 100;
+    if (!g_launch_restart) {
+        delay = PROCESS_LAUNCH_RETRY_MIN_MS << app->launch_attempt;
+        if (delay < PROCESS_LAUNCH_RETRY_MAX_MS) {
+            ++app->launch_attempt;
+        } else {
+            delay = PROCESS_LAUNCH_RETRY_MAX_MS;
+        }
+    }
+
+    if (app->retry_timer && event_loop_cancel(&g_event_loop, app->retry_timer)) __sync_fetch_and_add(&g_fences, 1);
+
+    struct event event = event_create(APPLICATION_LAUNCHED, (void *)(intptr_t) app->pid);
+    event.param1 = 1;
+    app->retry_timer = event_loop_post_after(&g_event_loop, &event, delay);
+    ++g_server.launch_retries;
+}
+
+static EVENT_CALLBACK(EVENT_HANDLER_APPLICATION_LAUNCHED)
+{
+    if (param1) __sync_fetch_and_add(&g_fences, 1);
+
+    struct fake_app *app = fake_app((int)(intptr_t) context);
+    if (!app || app->observed) return EVENT_FAILURE;
+
+    uint64_t now = time_monotonic_ns();
+    if (g_launch_restart) app->launch_stage = PROCESS_LAUNCH_OBSERVABLE;
+
+    switch (app->launch_stage) {
+    case PROCESS_LAUNCH_OBSERVABLE: {
+        fake_count(workspace_calls, 1);                       // workspace_application_is_observable
+        if (now < app->observable_at) {
+            app->launch_wait = FAKE_LAUNCH_WAIT_OBSERVABLE;
+            return EVENT_FAILURE;
+        }
+
+        app->launch_stage = PROCESS_LAUNCH_FINISHED_LAUNCHING;
+    } // fallthrough
+    case PROCESS_LAUNCH_FINISHED_LAUNCHING: {
+        fake_count(workspace_calls, 1);                       // workspace_application_is_finished_launching
+        if (now < app->finished_at) {
+            app->launch_wait = FAKE_LAUNCH_WAIT_FINISHED_LAUNCHING;
+            return EVENT_FAILURE;
+        }
+
+        app->launch_stage = PROCESS_LAUNCH_OBSERVE;
+    } // fallthrough
+    case PROCESS_LAUNCH_OBSERVE: {
+        if (!app->has_observer) {
+            fake_ax_count(1);                                 // AXObserverCreate
+            app->has_observer = true;
+        }
+
+        for (int i = 0; i < 6; ++i) {
+            if (app->notification & (1 << i)) continue;
+            fake_ax_count(1);                                 // AXObserverAddNotification
+            if (now >= app->ax_ready_at) app->notification |= 1 << i;
+        }
+
+        if (app->notification != 0x3f) {
+            if (g_launch_restart) {
+                app->has_observer = false;
+                app->notification = 0;
+            }
+
+            fake_launch_retry(app);
+            return EVENT_FAILURE;
+        }
+
+        if (app->retry_timer && event_loop_cancel(&g_event_loop, app->retry_timer)) __sync_fetch_and_add(&g_fences, 1);
+        app->retry_timer = 0;
+        app->launch_stage = PROCESS_LAUNCH_DONE;
+    } break;
+    case PROCESS_LAUNCH_DONE: {
+        return EVENT_SUCCESS;
+    } break;
+    }
+
+    app->observed = true;
+    if (app->launched && g_measure_latency) {
+        histogram_record(&g_latency, now - app->launched);
+        histogram_record(&g_launch_lateness, now - app->ax_ready_at);
+    }
+
+    fake_ax_count(1);                                         // application_window_list
+    for (uint32_t i = 0; i < g_server.window_count; ++i) {
+        struct fake_window *window = &g_server.window[i];
+        if (window->pid == app->pid && !window->observed) fake_border_create(window);
+    }
+
+    return EVENT_SUCCESS;
+}
+
+static EVENT_CALLBACK(EVENT_HANDLER_APPLICATION_TERMINATED)
+{
+    struct fake_app *app = fake_app((int)(intptr_t) context);
+    if (!app || !app->observed) return EVENT_FAILURE;
+
+    for (uint32_t i = 0; i < g_server.window_count; ++i) {
+        struct fake_window *window = &g_server.window[i];
+        if (window->pid == app->pid && window->observed) {
+            fake_count(sls_calls, 1);                         // SLSReleaseWindow
+            window->observed = false;
+        }
+    }
+
+    app->observed = false;
+    return EVENT_SUCCESS;
+}
+
+static EVENT_CALLBACK(EVENT_HANDLER_APPLICATION_FRONT_SWITCHED)
+{
+    g_server.front_pid = (int)(intptr_t) context;
+    fake_ax_count(1);                                         // focused window of the application
+    return EVENT_SUCCESS;
+}
+
+static EVENT_CALLBACK(EVENT_HANDLER_APPLICATION_ACTIVATED)   { return EVENT_SUCCESS; }
+static EVENT_CALLBACK(EVENT_HANDLER_APPLICATION_DEACTIVATED) { return EVENT_SUCCESS; }
+
+static EVENT_CALLBACK(EVENT_HANDLER_APPLICATION_VISIBLE)
+{
+    struct fake_app *app = fake_app((int)(intptr_t) context);
+    if (app) app->hidden = false;
+    return EVENT_SUCCESS;
+}
+
+static EVENT_CALLBACK(EVENT_HANDLER_APPLICATION_HIDDEN)
+{
+    struct fake_app *app = fake_app((int)(intptr_t) context);
+    if (app) app->hidden = true;
+    return EVENT_SUCCESS;
+}
+
+static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_CREATED)
+{
+    struct fake_window *window = fake_window((uint32_t)(uintptr_t) context);
+    if (!window || window->observed) return EVENT_FAILURE;
+
+    fake_border_create(window);
+    return EVENT_SUCCESS;
+}
+
+static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_DESTROYED)
+{
+    struct fake_window *window = fake_window((uint32_t)(uintptr_t) context);
+    if (!window || !window->observed) return EVENT_FAILURE;
+
+    fake_count(sls_calls, 1);                                 // SLSReleaseWindow
+    window->observed = false;
+    return EVENT_SUCCESS;
+}
+
+static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_FOCUSED)
+{
+    struct fake_window *window = fake_window((uint32_t)(uintptr_t) context);
+    if (!window || !window->observed) return EVENT_FAILURE;
+
+    struct fake_window *focused = fake_window(g_server.focused_window_id);
+    if (focused && focused != window) fake_border_set_level(focused);
+
+    fake_border_set_level(window);
+    g_server.focused_window_id = window->id;
+    return EVENT_SUCCESS;
+}
+
+static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_MOVED)
+{
+    struct fake_window *window = fake_window((uint32_t)(uintptr_t) context);
+    if (!window || !window->observed) return EVENT_FAILURE;
+
+    fake_border_refresh_payload(window, payload);
+    fake_record_latency(window);
+    return EVENT_SUCCESS;
+}
+
+static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_RESIZED)
+{
+    struct fake_window *window = fake_window((uint32_t)(uintptr_t) context);
+    if (!window || !window->observed) return EVENT_FAILURE;
+
+    fake_ax_count(1);                                         // window_is_fullscreen
+    fake_ax_wait(window);
+    if (param1) __sync_fetch_and_add(&g_fences, 1);
+
+    if (!window->is_fullscreen && window->fullscreen) {
+        fake_count(sls_calls, 1);                             // border_window_hide
+    } else if (window->is_fullscreen && !window->fullscreen) {
+        fake_count(sls_calls, 1);                             // window_display_id
+        fake_count(sls_calls, 1);                             // display_manager_display_is_animating
+
+        if (time_monotonic_ns() < g_server.animation_end) {
+            struct event event = event_create(WINDOW_RESIZED, context);
+            event.param1 = 1;
+            event_loop_continue_after(&g_event_loop, &event, 100);
+            ++g_server.continuations;
+            return EVENT_SUCCESS;
+        }
+
+        fake_count(sls_calls, 1);                             // border_window_show
+        ++g_server.fullscreen_exits;
+    }
+
+    window->is_fullscreen = window->fullscreen;
+    if (!window->is_fullscreen) {
+        fake_border_refresh_payload(window, payload);
+        if (!param1) fake_record_latency(window);
+    }
+
+    return EVENT_SUCCESS;
+}
+
+static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_MINIMIZED)
+{
+    struct fake_window *window = fake_window((uint32_t)(uintptr_t) context);
+    if (!window) return EVENT_FAILURE;
+
+    window->minimized = true;
+    fake_count(sls_calls, 1);                                 // order out
+    return EVENT_SUCCESS;
+}
+
+static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_DEMINIMIZED)
+{
+    struct fake_window *window = fake_window((uint32_t)(uintptr_t) context);
+    if (!window) return EVENT_FAILURE;
+
+    window->minimized = false;
+    fake_border_refresh(window);
+    return EVENT_SUCCESS;
+}
+
+static EVENT_CALLBACK(EVENT_HANDLER_SPACE_CHANGED)
+{
+    for (uint32_t i = 0; i < g_server.app_count; ++i) {
+        if (g_server.app[i].observed) fake_ax_count(1); // application_window_list
+    }
+
+    struct fake_window *focused = fake_window(g_server.focused_window_id);
+    if (focused && focused->space == g_server.active_space) fake_border_set_level(focused);
+
+    return EVENT_SUCCESS;
+}
+
+static EVENT_CALLBACK(EVENT_HANDLER_DISPLAY_CHANGED)
+{
+    return EVENT_HANDLER_SPACE_CHANGED(context, param1, payload);
+}
+
+static EVENT_CALLBACK(EVENT_HANDLER_MISSION_CONTROL_ENTER)          { return EVENT_SUCCESS; }
+static EVENT_CALLBACK(EVENT_HANDLER_MISSION_CONTROL_CHECK_FOR_EXIT) { return EVENT_SUCCESS; }
+static EVENT_CALLBACK(EVENT_HANDLER_MISSION_CONTROL_EXIT)           { return EVENT_SUCCESS; }
+static EVENT_CALLBACK(EVENT_HANDLER_SYSTEM_WOKE)                    { return EVENT_SUCCESS; }
+static EVENT_CALLBACK(EVENT_HANDLER_DAEMON_STARTED)                 { return EVENT_SUCCESS; }
+static struct daemon g_daemon;
+static char g_socket_file[64];
+static int g_connection_count;
+static volatile uint64_t g_connection_expired;
+
+static EVENT_CALLBACK(EVENT_HANDLER_DAEMON_MESSAGE)
+{
+    if (!context) return EVENT_SUCCESS;
+
+    socket_write_bytes(param1, "ok\n", 3);
+    socket_close(param1);
+    free(context);
+
+    return EVENT_SUCCESS;
+}
+
+struct event event_create(enum event_type type, void *context)
+{
+    return (struct event) { .context = context, .info = 0, .timestamp = 0, .type = type, .param1 = 0, .coalesce_owner = false, .payload = { .type = EVENT_PAYLOAD_NONE } };
+}
+
+uint32_t event_trace_id(struct event *event)
+{
+    return (uint32_t)(uintptr_t) event->context;
+}
+
+pid_t event_trace_pid(enum event_type type, uint32_t id)
+{
+    if (type >= APPLICATION_LAUNCHED && type <= APPLICATION_HIDDEN) return id;
+
+    struct fake_window *window = fake_window(id);
+    return window ? window->pid : 0;
+}
+
+void event_destroy(struct event_loop *event_loop, struct event *event)
+{
+    if (event->type == DAEMON_MESSAGE_TIMEOUT) return;
+    __sync_fetch_and_add(&g_handled, 1);
+}
+
+static uint64_t replay_merged(void)
+{
+    uint64_t result = 0;
+    for (int i = 0; i < EVENT_TYPE_COUNT; ++i) {
+        result += g_event_loop.coalesce.merged[i];
+    }
+    return result;
+}
+
+//
+// NOTE(koekeishiya): Scenarios are generated from a fixed seed, so every run posts the same
+// stream of events. Events are posted in bursts, the way the window server delivers
+// notifications, and the harness waits for the event loop to drain between bursts. A burst
+// starts with a no-op fence event; the event loop picks it up and then waits in the batch begin
+// hook until the whole burst has been posted. The event loop therefore always sees complete
+// bursts, and batching and coalescing come out the same on every run.
+//
+
+static void replay_post(enum event_type type, uintptr_t context)
+{
+    if (!g_in_burst) {
+        pthread_mutex_lock(&g_gate);
+        g_in_burst = true;
+
+        struct event fence = event_create(DAEMON_MESSAGE, NULL);
+        event_loop_post(&g_event_loop, &fence);
+        __sync_fetch_and_add(&g_fences, 1);
+    }
+
+    struct event event = event_create(type, (void *) context);
+    if (type == WINDOW_MOVED || type == WINDOW_RESIZED) {
+        struct fake_window *window = fake_window((uint32_t) context);
+        __sync_bool_compare_and_swap(&window->posted, 0, time_monotonic_ns());
+        fake_count(sls_calls, 1);                             // SLSGetWindowBounds
+        event.payload.type = EVENT_PAYLOAD_FRAME;
+        event.payload.frame = (CGRect) { { window->x, window->y }, { window->w, window->h } };
+    }
+
+    event_loop_post(&g_event_loop, &event);
+    ++g_posted;
+}
+
+static void replay_drain(void)
+{
+    if (!g_in_burst) return;
+
+    pthread_mutex_unlock(&g_gate);
+    g_in_burst = false;
+
+    while (g_handled + replay_merged() < g_posted + g_fences) {
+        sched_yield();
+    }
+}
+
+static uint64_t g_seed;
+
+static uint32_t replay_random(void)
+{
+    g_seed ^= g_seed << 13;
+    g_seed ^= g_seed >> 7;
+    g_seed ^= g_seed << 17;
+    return (uint32_t) g_seed;
+}
+
+static void scenario_login(void)
+{
+    for (int i = 0; i < 80; ++i) {
+        int pid = fake_app_create();
+        int window_count = 1 + replay_random() % 6;
+
+        for (int j = 0; j < window_count; ++j) {
+            fake_window_create(pid, 1 + replay_random() % 4);
+        }
+
+        replay_post(APPLICATION_LAUNCHED, pid);
+        for (uint32_t id = g_server.window_count - window_count + 1; id <= g_server.window_count; ++id) {
+            replay_post(WINDOW_CREATED, id);
+            replay_post(WINDOW_MOVED, id);
+            replay_post(WINDOW_RESIZED, id);
+        }
+
+        replay_post(APPLICATION_FRONT_SWITCHED, pid);
+        replay_post(WINDOW_FOCUSED, g_server.window_count);
+        replay_drain();
+    }
+}
+
+static void scenario_drag(void)
+{
+    int pid = fake_app_create();
+    uint32_t id = fake_window_create(pid, 1);
+    replay_post(APPLICATION_LAUNCHED, pid);
+    replay_post(WINDOW_FOCUSED, id);
+    replay_drain();
+
+    //
+    // NOTE(koekeishiya): 5 seconds at 120 Hz. The window server sends several moved
+    // notifications per frame while a window is being dragged.
+    //
+
+    for (int frame = 0; frame < 600; ++frame) {
+        struct fake_window *window = fake_window(id);
+        int notifications = 2 + replay_random() % 4;
+
+        for (int i = 0; i < notifications; ++i) {
+            window->x += 1;
+            window->y += 0.5f;
+            replay_post(WINDOW_MOVED, id);
+        }
+
+        replay_drain();
+    }
+}
+
+static void scenario_spaces(void)
+{
+    for (int i = 0; i < 10; ++i) {
+        int pid = fake_app_create();
+        for (int j = 0; j < 3; ++j) fake_window_create(pid, 1 + (i + j) % 4);
+        replay_post(APPLICATION_LAUNCHED, pid);
+    }
+    replay_drain();
+
+    for (int i = 0; i < 100; ++i) {
+        g_server.active_space = 1 + i % 4;
+
+        uint32_t id = 1 + replay_random() % g_server.window_count;
+        replay_post(SPACE_CHANGED, 0);
+        replay_post(APPLICATION_FRONT_SWITCHED, fake_window(id)->pid);
+        replay_post(WINDOW_FOCUSED, id);
+        for (uint32_t j = 1; j <= g_server.window_count; ++j) {
+            if (fake_window(j)->space == g_server.active_space) replay_post(WINDOW_MOVED, j);
+        }
+        replay_drain();
+    }
+}
+
+static void scenario_slow_app(void)
+{
+    for (int i = 0; i < 8; ++i) {
+        int pid = fake_app_create();
+        for (int j = 0; j < 4; ++j) fake_window_create(pid, 1);
+        replay_post(APPLICATION_LAUNCHED, pid);
+    }
+    replay_drain();
+
+    //
+    // NOTE(koekeishiya): The first application takes 5ms to answer every AX request, like a busy
+    // Electron app. Every frame resizes all 32 windows once, in random order; the resize handler
+    // asks every window whether it is fullscreen. The latency from posting to the border being
+    // redrawn is recorded for the windows of the other applications.
+    //
+
+    g_server.app[0].ax_delay_us = 5000;
+    g_measure_latency = true;
+
+    uint32_t order[32];
+    for (uint32_t i = 0; i < 32; ++i) order[i] = i + 1;
+
+    for (int frame = 0; frame < 100; ++frame) {
+        for (uint32_t i = 31; i > 0; --i) {
+            uint32_t j = replay_random() % (i + 1);
+            uint32_t temp = order[i];
+            order[i] = order[j];
+            order[j] = temp;
+        }
+
+        for (uint32_t i = 0; i < 32; ++i) {
+            fake_window(order[i])->w += 1;
+            replay_post(WINDOW_RESIZED, order[i]);
+        }
+
+        replay_drain();
+    }
+
+    //
+    // NOTE(koekeishiya): Workers reenable updates at the end of every redraw, so the worker that
+    // waits for the slow application never holds back the borders redrawn by the other workers.
+    //
+
+    if (g_event_loop.worker_count) assert(g_server.update_disabled_max < g_server.app[0].ax_delay_us * 1000ULL);
+}
+
+//
+// NOTE(koekeishiya): ipc-loop serves the daemon socket from the event loop thread, the same way
+// message.c does, including the deadline for clients that never send their message. A single
+// client sends requests back to back, and every 100th request a second client connects and then
+// takes 20ms to send its message. A third client connects once and never sends anything; the
+// daemon has to close it. The round trip of the first client is recorded.
+//
+
+static SOCKET_DAEMON_HANDLER(replay_message_handler)
+{
+    struct event event = event_create(DAEMON_MESSAGE, message);
+    event.param1 = sockfd;
+    event_loop_post(&g_event_loop, &event);
+}
+
+static void replay_connection_close(struct socket_connection *connection)
+{
+    event_loop_unwatch(&g_event_loop, connection->sockfd);
+    --g_connection_count;
+    free(connection);
+}
+
+static EVENT_CALLBACK(EVENT_HANDLER_DAEMON_MESSAGE_TIMEOUT)
+{
+    struct socket_connection *connection = context;
+    __sync_fetch_and_add(&g_connection_expired, 1);
+
+    int sockfd = connection->sockfd;
+    if (connection->message) free(connection->message);
+    replay_connection_close(connection);
+    socket_close(sockfd);
+
+    return EVENT_SUCCESS;
+}
+
+static EVENT_LOOP_WATCH_CALLBACK(replay_connection_read)
+{
+    struct socket_connection *connection = context;
+    if (!socket_connection_read(connection)) return;
+
+    event_loop_cancel(&g_event_loop, connection->timer);
+
+    char *message = connection->message;
+    int length = connection->length;
+    replay_connection_close(connection);
+
+    if (message) {
+        g_daemon.handler(message, length, fd);
+    } else {
+        socket_close(fd);
+    }
+}
+
+static EVENT_LOOP_WATCH_CALLBACK(replay_connection_accept)
+{
+    int sockfd;
+    while ((sockfd = socket_daemon_accept(&g_daemon)) != -1) {
+        if (g_connection_count == SOCKET_CONNECTION_MAX) {
+            socket_close(sockfd);
+            continue;
+        }
+
+        struct socket_connection *connection = malloc(sizeof(struct socket_connection));
+        memset(connection, 0, sizeof(struct socket_connection));
+        connection->sockfd = sockfd;
+        event_loop_watch(&g_event_loop, sockfd, replay_connection_read, connection);
+        ++g_connection_count;
+
+        struct event event = event_create(DAEMON_MESSAGE_TIMEOUT, connection);
+        connection->timer = event_loop_post_after(&g_event_loop, &event, SOCKET_CONNECTION_TIMEOUT_MS);
+    }
+}
+
+static void setup_ipc_loop(void)
+{
+    snprintf(g_socket_file, sizeof(g_socket_file), "/tmp/limelight-replay_%d.socket", getpid());
+    socket_daemon_listen_un(&g_daemon, g_socket_file, replay_message_handler);
+    event_loop_watch(&g_event_loop, g_daemon.sockfd, replay_connection_accept, NULL);
+}
+
+static uint64_t replay_request(uint64_t delay_us)
+{
+    char message[] = "config\0border_width\0" "4";
+    uint64_t begin = time_monotonic_ns();
+
+    int sockfd;
+    if (!socket_connect_un(&sockfd, g_socket_file)) return 0;
+
+    if (delay_us) usleep(delay_us);
+    socket_write_bytes(sockfd, message, sizeof(message));
+    shutdown(sockfd, SHUT_WR);
+    __sync_fetch_and_add(&g_posted, 1);
+
+    char rsp[BUFSIZ];
+    while (recv(sockfd, rsp, sizeof(rsp), 0) > 0);
+    socket_close(sockfd);
+
+    return time_monotonic_ns() - begin;
+}
+
+static void *replay_slow_client(void *context)
+{
+    replay_request(20000);
+    return NULL;
+}
+
+static void *replay_stalled_client(void *context)
+{
+    int sockfd;
+    if (!socket_connect_un(&sockfd, g_socket_file)) return NULL;
+
+    char rsp[BUFSIZ];
+    while (recv(sockfd, rsp, sizeof(rsp), 0) > 0);
+    socket_close(sockfd);
+
+    return NULL;
+}
+
+static void scenario_ipc(void)
+{
+    pthread_t stalled_client;
+    pthread_create(&stalled_client, NULL, replay_stalled_client, NULL);
+
+    g_latency_name = "ipc round trip";
+    g_measure_latency = true;
+
+    pthread_t slow_client[20];
+    for (int i = 0; i < 2000; ++i) {
+        if (i % 100 == 0) {
+            pthread_create(&slow_client[i / 100], NULL, replay_slow_client, NULL);
+            usleep(1000);
+        }
+
+        histogram_record(&g_latency, replay_request(0));
+    }
+
+    for (int i = 0; i < 20; ++i) {
+        pthread_join(slow_client[i], NULL);
+    }
+
+    pthread_join(stalled_client, NULL);
+    assert(g_connection_expired == 1);
+
+    unlink(g_socket_file);
+}
+
+//
+// NOTE(koekeishiya): One application hangs for 300ms on every AX request. The watchdog budget is
+// lowered to 100ms, so each of its resized windows must be reported once, and attributed to it.
+//
+
+static void scenario_hung_app(void)
+{
+    for (int i = 0; i < 4; ++i) {
+        int pid = fake_app_create();
+        for (int j = 0; j < 2; ++j) fake_window_create(pid, 1);
+        replay_post(APPLICATION_LAUNCHED, pid);
+    }
+    replay_drain();
+
+    event_loop_set_watchdog_budget(&g_event_loop, 100);
+    g_server.app[1].ax_delay_us = 300000;
+
+    for (uint32_t id = 1; id <= 8; ++id) {
+        fake_window(id)->w += 1;
+        replay_post(WINDOW_RESIZED, id);
+    }
+    replay_drain();
+}
+
+//
+// NOTE(koekeishiya): A window leaves native fullscreen while its display animates for another
+// second. Its resize handler must not block until the animation is over, but re-check every 100ms
+// through a continuation, while the other windows keep moving. The clock is moved forward by 10ms
+// every frame. Handled continuations are counted with the fences, as the scenario never posts them.
+//
+
+static void scenario_fullscreen_exit(void)
+{
+    for (int i = 0; i < 4; ++i) {
+        int pid = fake_app_create();
+        for (int j = 0; j < 2; ++j) fake_window_create(pid, 1);
+        replay_post(APPLICATION_LAUNCHED, pid);
+    }
+    replay_drain();
+
+    fake_window(1)->is_fullscreen = true;
+    g_server.animation_end = time_monotonic_ns() + 1000000000ULL;
+    g_measure_latency = true;
+
+    replay_post(WINDOW_RESIZED, 1);
+    replay_drain();
+
+    for (int frame = 0; frame < 150; ++frame) {
+        __sync_fetch_and_add(&g_clock_offset, 10000000ULL);
+
+        for (uint32_t id = 2; id <= 8; ++id) {
+            fake_window(id)->x += 1;
+            replay_post(WINDOW_MOVED, id);
+        }
+
+        replay_drain();
+    }
+
+    printf("%-18s continuations %llu  fullscreen exits %llu\n", "fullscreen-exit",
+           (unsigned long long) g_server.continuations, (unsigned long long) g_server.fullscreen_exits);
+}
+
+//
+// NOTE(koekeishiya): 60 applications are launched at once, like at login. Each one becomes
+// observable, finishes launching and starts answering AX requests after a random delay. The
+// harness plays the part of KVO, and posts APPLICATION_LAUNCHED once the condition that an
+// application is waiting for holds. The time from launch to the first border is recorded.
+//
+
+static void scenario_launch(void)
+{
+    g_latency_name = "time to first border";
+    g_measure_latency = true;
+
+    uint64_t now = time_monotonic_ns();
+    for (int i = 0; i < 60; ++i) {
+        int pid = fake_app_create();
+        for (uint32_t j = 0; j < 1 + replay_random() % 3; ++j) fake_window_create(pid, 1);
+
+        struct fake_app *app = fake_app(pid);
+        app->launched = now;
+        app->observable_at = replay_random() % 3 == 0 ? now + (replay_random() % 200) * 1000000ULL : 0;
+        app->finished_at = (app->observable_at ? app->observable_at : now) + (replay_random() % 400) * 1000000ULL;
+        app->ax_ready_at = app->finished_at + (replay_random() % 600) * 1000000ULL;
+
+        replay_post(APPLICATION_LAUNCHED, pid);
+    }
+    replay_drain();
+
+    for (;;) {
+        int done = 0;
+        bool posted = false;
+        now = time_monotonic_ns();
+
+        for (uint32_t i = 0; i < g_server.app_count; ++i) {
+            struct fake_app *app = &g_server.app[i];
+            if (app->observed) {
+                ++done;
+            } else if ((app->launch_wait == FAKE_LAUNCH_WAIT_OBSERVABLE && now >= app->observable_at) ||
+                       (app->launch_wait == FAKE_LAUNCH_WAIT_FINISHED_LAUNCHING && now >= app->finished_at)) {
+                app->launch_wait = FAKE_LAUNCH_WAIT_NONE;
+                replay_post(APPLICATION_LAUNCHED, app->pid);
+                posted = true;
+            }
+        }
+
+        if (posted) replay_drain();
+        if (done == (int) g_server.app_count) break;
+        usleep(1000);
+    }
+
+    printf("%-18s launch retries %llu  workspace calls %llu  first border after ready  p50 %8.3f ms  p99 %8.3f ms  max %8.3f ms\n",
+           g_launch_restart ? "launch-60-restart" : "launch-60-apps", (unsigned long long) g_server.launch_retries,
+           (unsigned long long) g_server.workspace_calls, histogram_percentile(&g_launch_lateness, 50.0) / 1e6,
+           histogram_percentile(&g_launch_lateness, 99.0) / 1e6, g_launch_lateness.max / 1e6);
+}
+
+static void scenario_launch_restart(void)
+{
+    g_launch_restart = true;
+    scenario_launch();
+}
+
+static char *g_trace_path;
+
+static void scenario_trace(void)
+{
+    FILE *file = fopen(g_trace_path, "rb");
+    if (!file) {
+        fprintf(stderr, "could not open '%s'\n", g_trace_path);
+        exit(1);
+    }
+
+    struct trace_header header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 ||
+        header.byte_order != TRACE_BYTE_ORDER || header.version != TRACE_VERSION || header.record_size != sizeof(struct trace_record)) {
+        fprintf(stderr, "'%s' is not a limelight trace written on this architecture\n", g_trace_path);
+        exit(1);
+    }
+
+    int type_map[header.name_count];
+    for (uint32_t i = 0; i < header.name_count; ++i) {
+        char name[TRACE_NAME_LENGTH];
+        if (fread(name, TRACE_NAME_LENGTH, 1, file) != 1) exit(1);
+
+        type_map[i] = EVENT_TYPE_UNKNOWN;
+        for (int type = EVENT_TYPE_UNKNOWN + 1; type < EVENT_TYPE_COUNT; ++type) {
+            if (strncmp(name, event_type_str[type], TRACE_NAME_LENGTH) == 0) type_map[i] = type;
+        }
+    }
+
+    struct trace_record *records = malloc(header.record_count * sizeof(struct trace_record) + 1);
+    if (fread(records, sizeof(struct trace_record), header.record_count, file) != header.record_count) exit(1);
+    fclose(file);
+
+    g_alloc_count_base = g_alloc_count;
+    g_alloc_bytes_base = g_alloc_bytes;
+
+    //
+    // NOTE(koekeishiya): Every application and window in the trace gets a fake counterpart, and
+    // posted events are replayed in timestamp order. Events that were handled in the same batch
+    // are posted as one burst.
+    //
+
+    int pid = fake_app_create();
+    while (g_server.window_count < FAKE_WINDOW_MAX - 1) fake_window_create(pid, 1);
+    replay_post(APPLICATION_LAUNCHED, pid);
+    replay_drain();
+
+    uint64_t last = 0;
+    for (uint64_t i = 0; i < header.record_count; ++i) {
+        struct trace_record *record = &records[i];
+        if (record->kind != TRACE_POSTED || record->event_type >= header.name_count) continue;
+
+        int type = type_map[record->event_type];
+        if (type == EVENT_TYPE_UNKNOWN || type == DAEMON_MESSAGE || type == DAEMON_MESSAGE_TIMEOUT) continue;
+
+        if (record->timestamp - last > 1000000) replay_drain();
+        last = record->timestamp;
+
+        uintptr_t context = record->id;
+        if (type >= WINDOW_CREATED && type <= WINDOW_DEMINIMIZED) context = 1 + record->id % (FAKE_WINDOW_MAX - 1);
+        if (type >= APPLICATION_LAUNCHED && type <= APPLICATION_HIDDEN) context = pid;
+        replay_post(type, context);
+    }
+
+    replay_drain();
+    free(records);
+}
+
+struct scenario
+{
+    const char *name;
+    void (*run)(void);
+    void (*setup)(void);
+};
+
+static struct scenario scenarios[] =
+{
+    { "login-80-apps",     scenario_login      },
+    { "drag-window-5s",    scenario_drag       },
+    { "switch-spaces-100", scenario_spaces     },
+    { "slow-app-ax",       scenario_slow_app   },
+    { "hung-app-ax",       scenario_hung_app   },
+    { "fullscreen-exit",   scenario_fullscreen_exit },
+    { "launch-60-apps",    scenario_launch     },
+    { "launch-60-restart", scenario_launch_restart },
+    { "ipc-loop",          scenario_ipc,        setup_ipc_loop },
+};
+
+int main(int argc, char **argv)
+{
+    int worker_count = 0;
+    if (argc > 2 && strcmp(argv[1], "-w") == 0) {
+        worker_count = atoi(argv[2]);
+        argc -= 2;
+        argv += 2;
+    }
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: limelight-replay [-w <workers>] <scenario> | trace <path>\nscenarios:");
+        for (int i = 0; i < (int) array_count(scenarios); ++i) fprintf(stderr, " %s", scenarios[i].name);
+        fprintf(stderr, "\n");
+        return 1;
+    }
+
+    struct scenario scenario = { "trace", scenario_trace };
+    if (strcmp(argv[1], "trace") == 0) {
+        if (argc < 3) return 1;
+        g_trace_path = argv[2];
+    } else {
+        for (int i = 0; i < (int) array_count(scenarios); ++i) {
+            if (strcmp(argv[1], scenarios[i].name) == 0) scenario = scenarios[i];
+        }
+
+        if (scenario.run == scenario_trace) {
+            fprintf(stderr, "unknown scenario '%s'\n", argv[1]);
+            return 1;
+        }
+    }
+
+    g_seed = 0x9e3779b97f4a7c15ULL;
+    event_loop_init(&g_event_loop);
+    g_event_loop.on_batch_begin = fake_batch_begin;
+    g_event_loop.on_batch_end = fake_batch_end;
+    g_event_loop.worker_count = worker_count;
+    if (scenario.setup) scenario.setup();
+    event_loop_begin(&g_event_loop);
+
+    g_alloc_count_base = g_alloc_count;
+    g_alloc_bytes_base = g_alloc_bytes;
+    uint64_t begin = time_monotonic_ns();
+
+    scenario.run();
+
+    uint64_t end = time_monotonic_ns();
+    event_loop_end(&g_event_loop);
+
+    uint64_t batches = 0;
+    for (int i = 0; i < EVENT_BATCH_BUCKET_COUNT; ++i) {
+        batches += g_event_loop.batch_size[i];
+    }
+
+    printf("%-18s posted %8llu  handled %8llu  merged %8llu  batches %7llu  %8.0f events/s  ax %8llu  sls %8llu  sls_updates %7llu  allocs %5llu (%llu bytes)\n",
+           scenario.name, (unsigned long long) g_posted, (unsigned long long)(g_handled - g_fences), (unsigned long long) replay_merged(),
+           (unsigned long long) batches, (g_handled - g_fences) / ((end - begin) / 1e9), (unsigned long long) g_server.ax_calls,
+           (unsigned long long) g_server.sls_calls, (unsigned long long) g_server.sls_updates,
+           (unsigned long long)(g_alloc_count - g_alloc_count_base), (unsigned long long)(g_alloc_bytes - g_alloc_bytes_base));
+
+    if (g_server.ax_calls) {
+        printf("%-18s ax calls per event", scenario.name);
+        for (int i = EVENT_TYPE_UNKNOWN + 1; i < EVENT_TYPE_COUNT; ++i) {
+            uint64_t count = g_event_loop.stats[i].total.count;
+            uint64_t ax_calls = g_event_loop.stats[i].ax_calls;
+            for (int j = 0; j < g_event_loop.worker_count; ++j) {
+                count += g_event_loop.worker[j].stats[i].total.count;
+                ax_calls += g_event_loop.worker[j].stats[i].ax_calls;
+            }
+
+            if (count && i != DAEMON_MESSAGE && i != DAEMON_MESSAGE_TIMEOUT) printf("  %s %.2f", event_type_str[i], (double) ax_calls / count);
+        }
+        printf("\n");
+    }
+
+    if (g_event_loop.stall_count) {
+        printf("%-18s handler_stalls %llu", scenario.name, (unsigned long long) g_event_loop.stall_count);
+        for (int i = 0; i < g_event_loop.stall_pid_count; ++i) {
+            printf("  pid_%d_stalls %llu", g_event_loop.stall[i].pid, (unsigned long long) g_event_loop.stall[i].count);
+        }
+        if (g_event_loop.stall_pid_overflow) printf("  pid_stalls_overflow %llu", (unsigned long long) g_event_loop.stall_pid_overflow);
+        printf("\n");
+    }
+
+    if (g_measure_latency) {
+        printf("%-18s workers %2d  %s  p50 %8.3f ms  p99 %8.3f ms  max %8.3f ms  updates disabled max %8.3f ms\n",
+               scenario.name, g_event_loop.worker_count, g_latency_name, histogram_percentile(&g_latency, 50.0) / 1e6,
+               histogram_percentile(&g_latency, 99.0) / 1e6, g_latency.max / 1e6, g_server.update_disabled_max / 1e6);
+    }
+
+    return 0;
+}
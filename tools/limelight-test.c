@@ -0,0 +1,1322 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+//
+// NOTE(koekeishiya): Regression tests for the event loop and the data structures in src/misc,
+// compiled against the sources unchanged. Run them all with 'make test', or a single one by name.
+// A failed expectation is reported with its line and the test carries on, so that one run shows
+// every failure.
+//
+
+static inline uint64_t time_monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#include "../src/misc/macros.h"
+#include "../src/misc/memory_pool.h"
+#include "../src/misc/hashtable.h"
+#include "event_loop_stub.h"
+
+static const char *g_test;
+static int g_failures;
+
+#define expect(condition) \
+    do { if (!(condition)) { ++g_failures; fprintf(stderr, "%s: %s:%d: expected %s\n", g_test, __FILE__, __LINE__, #condition); } } while (0)
+
+static uint64_t g_seed;
+
+static uint32_t test_random(void)
+{
+    g_seed ^= g_seed << 13;
+    g_seed ^= g_seed >> 7;
+    g_seed ^= g_seed << 17;
+    return (uint32_t) g_seed;
+}
+
+//
+// NOTE(koekeishiya): While a table grows, entries live in both the old and the new slot array,
+// and removing an entry from either one shifts its neighbours back. The table is checked against
+// a reference after every operation, and every entry is looked up while a migration is running.
+//
+
+#define TEST_TABLE_KEY_MAX 8192
+
+TABLE_DEFINE(number_table, uint32_t, uint32_t)
+
+static inline uint32_t number_table_value(uint32_t key)
+{
+    return 2 * key + 1;
+}
+
+static bool number_table_in_old_slots(struct number_table *table, uint32_t key)
+{
+    return table->old_slots && number_table_probe(table->old_slots, table->old_slot_capacity, key);
+}
+
+static void number_table_check(struct number_table *table, bool *present, int count)
+{
+    expect(table->count == count);
+
+    int index = 0;
+    struct number_table_entry *entry;
+    table_foreach(entry, table) {
+        struct number_table_slot *slot = number_table_get_slot(table, entry->key);
+        expect(slot && slot->index == index);
+        expect(present[entry->key] && entry->value == number_table_value(entry->key));
+        ++index;
+    }
+    expect(index == count);
+}
+
+static void test_table_rehash(void)
+{
+    uint64_t finds_during_rehash = 0;
+    uint64_t removes_from_old_slots = 0;
+    uint64_t rehashes = 0;
+    uint64_t migrations = 0;
+    uint64_t removes_during_migration = 0;
+
+    for (int cycle = 0; cycle < 8; ++cycle) {
+        bool present[TEST_TABLE_KEY_MAX] = {0};
+        int count = 0;
+
+        struct number_table table;
+        number_table_init(&table, 8);
+
+        //
+        // NOTE(koekeishiya): Grow to a random size with a bias towards adding, then churn and
+        // shrink with a bias towards removing, so that migrations run while entries are removed.
+        //
+
+        int target = 256 + test_random() % 3840;
+        for (int op = 0; op < 4 * target; ++op) {
+            uint32_t key = 1 + test_random() % (TEST_TABLE_KEY_MAX - 1);
+            bool add = (test_random() % 100) < (op < 2 * target ? 70 : 30);
+            bool was_rehashing = table.old_slots != NULL;
+            bool was_migrating = table.old_entries != NULL;
+
+            if (add) {
+                number_table_add(&table, key, number_table_value(key));
+                if (!present[key]) ++count;
+                present[key] = true;
+            } else {
+                if (number_table_in_old_slots(&table, key)) ++removes_from_old_slots;
+                if (was_migrating) ++removes_during_migration;
+                number_table_remove(&table, key);
+                if (present[key]) --count;
+                present[key] = false;
+            }
+
+            if (!was_rehashing && table.old_slots) ++rehashes;
+            if (!was_migrating && table.old_entries) ++migrations;
+            expect(table.count == count);
+
+            if (table.old_slots || table.old_entries) {
+                for (uint32_t k = 1; k < TEST_TABLE_KEY_MAX; ++k) {
+                    expect(number_table_find(&table, k) == (present[k] ? number_table_value(k) : 0));
+                }
+                finds_during_rehash += TEST_TABLE_KEY_MAX - 1;
+                number_table_check(&table, present, count);
+            }
+        }
+
+        number_table_check(&table, present, count);
+        for (uint32_t k = 1; k < TEST_TABLE_KEY_MAX; ++k) {
+            expect(number_table_find(&table, k) == (present[k] ? number_table_value(k) : 0));
+        }
+
+        number_table_free(&table);
+    }
+
+    expect(rehashes > 0);
+    expect(finds_during_rehash > 0);
+    expect(removes_from_old_slots > 0);
+    expect(migrations > 0);
+    expect(removes_during_migration > 0);
+}
+
+//
+// NOTE(koekeishiya): A cluster that wraps around the end of the slot array is the one case where
+// a backward shift moves an entry from the front of the array to the back, behind rehash_index.
+// Build one, start a migration, and remove the cluster one entry at a time while it runs.
+//
+
+static void test_table_rehash_wrap(void)
+{
+    struct number_table table;
+    number_table_init(&table, 8);
+
+    int mask = table.slot_capacity - 1;
+    uint32_t cluster[4];
+    int cluster_count = 0;
+
+    for (uint32_t key = 1; cluster_count < (int) array_count(cluster); ++key) {
+        if ((table_hash_integer(key) & mask) == mask) cluster[cluster_count++] = key;
+    }
+
+    bool present[TEST_TABLE_KEY_MAX] = {0};
+    int count = 0;
+
+    for (int i = 0; i < cluster_count; ++i) {
+        number_table_add(&table, cluster[i], number_table_value(cluster[i]));
+        present[cluster[i]] = true;
+        ++count;
+    }
+
+    expect(table.slots[0].distance > 1);
+
+    uint32_t key = 1;
+    int old_slot_capacity = table.slot_capacity;
+    while (!table.old_slots) {
+        while (present[key]) ++key;
+        number_table_add(&table, key, number_table_value(key));
+        present[key] = true;
+        ++count;
+    }
+
+    expect(table.old_slot_capacity == old_slot_capacity);
+    expect(number_table_in_old_slots(&table, cluster[0]));
+
+    for (int i = 0; i < cluster_count; ++i) {
+        number_table_remove(&table, cluster[i]);
+        present[cluster[i]] = false;
+        --count;
+
+        number_table_check(&table, present, count);
+        for (uint32_t k = 1; k < TEST_TABLE_KEY_MAX; ++k) {
+            expect(number_table_find(&table, k) == (present[k] ? number_table_value(k) : 0));
+        }
+    }
+
+    number_table_free(&table);
+}
+
+//
+// NOTE(koekeishiya): table_foreach visits entries in insertion order until the first removal,
+// which moves the last entry into the freed position.
+//
+
+static void test_table_foreach(void)
+{
+    struct number_table table;
+    number_table_init(&table, 8);
+
+    bool present[TEST_TABLE_KEY_MAX] = {0};
+    for (uint32_t key = 1; key <= 100; ++key) {
+        number_table_add(&table, key, number_table_value(key));
+        present[key] = true;
+    }
+
+    uint32_t expected = 1;
+    struct number_table_entry *entry;
+    table_foreach(entry, &table) {
+        expect(entry->key == expected);
+        ++expected;
+    }
+    expect(expected == 101);
+
+    number_table_remove(&table, 10);
+    present[10] = false;
+
+    expect(table_entry(&table, 9)->key == 100);
+    expect(table_entry(&table, 98)->key == 99);
+    number_table_check(&table, present, 99);
+
+    int visited = 0;
+    table_foreach(entry, &table) {
+        expect(entry->key != 10);
+        ++visited;
+    }
+    expect(visited == 99);
+
+    number_table_free(&table);
+}
+
+//
+// NOTE(koekeishiya): Objects are zeroed, a freed object is handed out again before the pool is
+// touched, and running out of pool maps a new one without moving the objects that are still live.
+//
+
+static void test_slab(void)
+{
+    enum { OBJECTS = 64 };
+
+    struct memory_slab slab;
+    expect(memory_slab_init(&slab, 100, 16 * 128));
+    expect(slab.object_size == 128);
+
+    uint8_t *object[OBJECTS];
+    for (int i = 0; i < OBJECTS; ++i) {
+        object[i] = memory_slab_alloc(&slab);
+        expect(object[i] != NULL);
+        for (int j = 0; j < 100; ++j) expect(object[i][j] == 0);
+        memset(object[i], i + 1, 100);
+    }
+
+    expect(slab.live == OBJECTS);
+    expect(slab.high_water == OBJECTS);
+    expect(slab.overflow == OBJECTS / 16 - 1);
+
+    for (int i = 0; i < OBJECTS; ++i) {
+        for (int j = i + 1; j < OBJECTS; ++j) expect(object[i] != object[j]);
+        expect(object[i][0] == i + 1 && object[i][99] == i + 1);
+    }
+
+    memory_slab_free(&slab, object[3]);
+    memory_slab_free(&slab, object[7]);
+    expect(slab.live == OBJECTS - 2);
+
+    uint8_t *reused = memory_slab_alloc(&slab);
+    expect(reused == object[7]);
+    expect(reused[0] == 0 && reused[99] == 0);
+    expect(memory_slab_alloc(&slab) == object[3]);
+
+    expect(slab.live == OBJECTS);
+    expect(slab.high_water == OBJECTS);
+    expect(slab.overflow == OBJECTS / 16 - 1);
+}
+
+//
+// NOTE(koekeishiya): Requests that do not fit in the pool are malloc'd and chained, and stay valid
+// until the next reset. A reset frees them and starts over at the beginning of the pool.
+//
+
+static void test_arena(void)
+{
+    struct memory_arena arena;
+    expect(memory_arena_init(&arena, 1024));
+
+    uint8_t *first = memory_arena_push_size(&arena, 1);
+    uint8_t *second = memory_arena_push_size(&arena, 100);
+    expect(first == arena.pool.memory);
+    expect(second == first + 16);
+    expect(((uintptr_t) second & 15) == 0);
+    memset(second, 0xab, 100);
+
+    uint8_t *overflow[4];
+    for (int i = 0; i < (int) array_count(overflow); ++i) {
+        overflow[i] = memory_arena_push_size(&arena, 1000);
+        expect(overflow[i] != NULL);
+        expect(overflow[i] < (uint8_t *) arena.pool.memory || overflow[i] >= (uint8_t *) arena.pool.memory + arena.pool.size);
+        memset(overflow[i], i, 1000);
+    }
+
+    expect(arena.overflow_count == array_count(overflow));
+    expect(arena.pool.used == 16 + 112);
+
+    for (int i = 0; i < (int) array_count(overflow); ++i) {
+        expect(overflow[i][0] == i && overflow[i][999] == i);
+    }
+    expect(second[0] == 0xab && second[99] == 0xab);
+
+    uint8_t *fits = memory_arena_push_size(&arena, 800);
+    expect(fits == second + 112);
+
+    memory_arena_reset(&arena);
+    expect(arena.overflow == NULL);
+    expect(arena.pool.used == 0);
+    expect(memory_arena_push_size(&arena, 8) == first);
+}
+
+//
+// NOTE(koekeishiya): Producers race for cells of a small ring while the consumer drains it. No
+// event may be lost, duplicated or torn, and the events of every producer arrive in the order it
+// posted them. Every event carries a frame derived from its producer and sequence number, which
+// is checked on the way out. This is the stress test for event allocation: events are copied
+// into the cells of the ring, which is the only memory they occupy until they are handled.
+//
+
+#define TEST_RING_SIZE      256
+#define TEST_RING_PRODUCERS 4
+#define TEST_RING_EVENTS    1000000
+
+struct test_ring_producer
+{
+    struct queue *queue;
+    int index;
+    pthread_t thread;
+};
+
+static inline CGRect test_ring_frame(int index, uint32_t sequence)
+{
+    return (CGRect) { { sequence, index }, { sequence ^ 0x5555, index + 1 } };
+}
+
+static void *test_ring_produce(void *context)
+{
+    struct test_ring_producer *producer = context;
+
+    for (uint32_t i = 0; i < TEST_RING_EVENTS; ++i) {
+        struct event event = event_create_p1(WINDOW_CREATED, (void *)(uintptr_t) i, producer->index);
+        event.payload.type = EVENT_PAYLOAD_FRAME;
+        event.payload.frame = test_ring_frame(producer->index, i);
+        while (!queue_push(producer->queue, &event)) sched_yield();
+    }
+
+    return NULL;
+}
+
+static void test_ring_producers(void)
+{
+    struct queue queue;
+    expect(queue_init(&queue, TEST_RING_SIZE));
+
+    struct test_ring_producer producer[TEST_RING_PRODUCERS];
+    for (int i = 0; i < TEST_RING_PRODUCERS; ++i) {
+        producer[i] = (struct test_ring_producer) { .queue = &queue, .index = i };
+        pthread_create(&producer[i].thread, NULL, test_ring_produce, &producer[i]);
+    }
+
+    uint32_t next[TEST_RING_PRODUCERS] = {0};
+    uint64_t received = 0;
+    uint64_t out_of_order = 0;
+    uint64_t corrupt = 0;
+
+    while (received < TEST_RING_PRODUCERS * TEST_RING_EVENTS) {
+        struct event event;
+        if (!queue_pop(&queue, &event)) {
+            sched_yield();
+            continue;
+        }
+
+        expect(event.param1 >= 0 && event.param1 < TEST_RING_PRODUCERS);
+        if (event.param1 < 0 || event.param1 >= TEST_RING_PRODUCERS) break;
+
+        uint32_t sequence = (uint32_t)(uintptr_t) event.context;
+        CGRect frame = test_ring_frame(event.param1, sequence);
+        if (event.type != WINDOW_CREATED ||
+            event.payload.type != EVENT_PAYLOAD_FRAME ||
+            memcmp(&event.payload.frame, &frame, sizeof(CGRect)) != 0) {
+            ++corrupt;
+        }
+
+        if (sequence != next[event.param1]) ++out_of_order;
+        next[event.param1] = sequence + 1;
+        ++received;
+    }
+
+    for (int i = 0; i < TEST_RING_PRODUCERS; ++i) {
+        pthread_join(producer[i].thread, NULL);
+        expect(next[i] == TEST_RING_EVENTS);
+    }
+
+    expect(out_of_order == 0);
+    expect(corrupt == 0);
+    expect(!queue_ready(&queue));
+    expect(queue.depth_high_water <= TEST_RING_SIZE);
+
+    free(queue.cells);
+}
+
+//
+// NOTE(koekeishiya): The consumer of a full ring posts to a spill buffer. Spilled events must be
+// handled after everything that was in the ring when the spill started, before anything another
+// producer pushed into the ring afterwards, and in the order they were posted, even when the
+// consumer keeps posting after the ring has room again.
+//
+
+static void test_ring_spill(void)
+{
+    struct event_loop event_loop;
+    expect(event_loop_init(&event_loop));
+    event_loop.thread = pthread_self();
+
+    struct queue *queue = &event_loop.queue[EVENT_LANE_LIFECYCLE];
+    uint32_t posted = 0;
+
+    for (int i = 0; i < EVENT_QUEUE_SIZE + 100; ++i) {
+        struct event event = event_create(WINDOW_CREATED, (void *)(uintptr_t) posted++);
+        event_loop_route(&event_loop, &event);
+    }
+
+    expect(queue->overflow == 100);
+    expect(queue->spill_count == 100);
+
+    struct event event;
+    uint32_t expected = 0;
+    for (int i = 0; i < 10; ++i) {
+        expect(event_loop_pop(&event_loop, &event));
+        expect((uint32_t)(uintptr_t) event.context == expected++);
+    }
+
+    for (int i = 0; i < 10; ++i) {
+        struct event self = event_create(WINDOW_CREATED, (void *)(uintptr_t) posted++);
+        event_loop_route(&event_loop, &self);
+    }
+
+    expect(queue->overflow == 110);
+
+    uint32_t foreign = 1000000;
+    for (int i = 0; i < 5; ++i) {
+        struct event other = event_create(WINDOW_CREATED, (void *)(uintptr_t) (foreign + i));
+        expect(queue_push(queue, &other));
+    }
+
+    while (expected < posted) {
+        expect(event_loop_pop(&event_loop, &event));
+        uint32_t context = (uint32_t)(uintptr_t) event.context;
+        expect(context == expected);
+        if (context != expected) break;
+        ++expected;
+    }
+
+    expect(queue->spill_count == 0);
+
+    for (int i = 0; i < 5; ++i) {
+        expect(event_loop_pop(&event_loop, &event));
+        expect((uint32_t)(uintptr_t) event.context == foreign + i);
+    }
+
+    expect(!event_loop_pop(&event_loop, &event));
+
+    struct event again = event_create(WINDOW_CREATED, (void *)(uintptr_t) posted);
+    event_loop_route(&event_loop, &again);
+    expect(queue->spill_count == 0);
+    expect(queue->overflow == 110);
+    expect(event_loop_pop(&event_loop, &event) && (uint32_t)(uintptr_t) event.context == posted);
+}
+
+//
+// NOTE(koekeishiya): A producer hands work to a consumer that parks whenever it runs out. The
+// consumer waits with a timeout, so that a lost wake-up shows up as a timeout while work was
+// pending instead of a hang.
+//
+
+#define TEST_HANDOFF_COUNT 100000
+
+static struct eventcount g_test_eventcount;
+static volatile uint64_t g_test_handoff_posted;
+
+static void *test_handoff_produce(void *context)
+{
+    for (int i = 0; i < TEST_HANDOFF_COUNT; ++i) {
+        __sync_fetch_and_add(&g_test_handoff_posted, 1);
+        eventcount_signal(&g_test_eventcount);
+        if (i % 3 == 0) sched_yield();
+    }
+
+    return NULL;
+}
+
+static void test_eventcount_handoff(void)
+{
+    eventcount_init(&g_test_eventcount);
+    g_test_handoff_posted = 0;
+
+    pthread_t producer;
+    pthread_create(&producer, NULL, test_handoff_produce, NULL);
+
+    uint64_t taken = 0;
+    uint64_t parked = 0;
+    uint64_t lost = 0;
+
+    while (taken < TEST_HANDOFF_COUNT) {
+        if (g_test_handoff_posted > taken) {
+            taken = g_test_handoff_posted;
+            continue;
+        }
+
+        uint32_t key = eventcount_prepare(&g_test_eventcount);
+        if (g_test_handoff_posted > taken) {
+            eventcount_cancel(&g_test_eventcount);
+            continue;
+        }
+
+        ++parked;
+        uint64_t begin = time_monotonic_ns();
+        eventcount_wait_timeout(&g_test_eventcount, key, 1000000000ULL);
+        if (time_monotonic_ns() - begin >= 1000000000ULL && g_test_handoff_posted > taken) ++lost;
+    }
+
+    pthread_join(producer, NULL);
+
+    expect(lost == 0);
+    expect(parked > 0);
+    expect(!(g_test_eventcount.state & EVENTCOUNT_PARKED));
+}
+
+//
+// NOTE(koekeishiya): Events are posted and handled on the test thread, which poses as the event
+// loop thread, so every test below sees the event loop in a known state. test_handled records
+// what the handlers saw; a test may set g_test_repost to have a handler post an event itself.
+//
+
+#define TEST_HANDLED_MAX 64
+
+struct test_handled
+{
+    enum event_type type;
+    uint32_t id;
+    enum event_payload_type payload;
+};
+
+static struct test_handled g_test_handled[TEST_HANDLED_MAX];
+static int g_test_handled_count;
+static struct event_loop *g_test_event_loop;
+static struct event g_test_repost;
+
+static STUB_HANDLER(test_record_handler)
+{
+    if (g_test_handled_count < TEST_HANDLED_MAX) {
+        g_test_handled[g_test_handled_count++] = (struct test_handled) { type, (uint32_t)(uintptr_t) context, payload->type };
+    }
+
+    if (g_test_repost.type) {
+        struct event event = g_test_repost;
+        g_test_repost.type = EVENT_TYPE_UNKNOWN;
+        event_loop_post(g_test_event_loop, &event);
+    }
+
+    return EVENT_SUCCESS;
+}
+
+static void test_event_loop_init(struct event_loop *event_loop)
+{
+    expect(event_loop_init(event_loop));
+    event_loop->thread = pthread_self();
+    event_loop->is_running = true;
+
+    g_test_event_loop = event_loop;
+    g_test_handled_count = 0;
+    g_test_repost.type = EVENT_TYPE_UNKNOWN;
+    g_stub_handler = test_record_handler;
+}
+
+static int test_event_loop_drain(struct event_loop *event_loop)
+{
+    int count = 0;
+    struct event event;
+    while (event_loop_pop(event_loop, &event)) {
+        event_loop_dispatch(event_loop, event_loop->stats, &event_loop->scratch, &event_loop->running, &event);
+        ++count;
+    }
+    return count;
+}
+
+static void test_post_frame(struct event_loop *event_loop, enum event_type type, uint32_t window_id, double x)
+{
+    struct event event = event_create(type, (void *)(uintptr_t) window_id);
+    event.payload.type = EVENT_PAYLOAD_FRAME;
+    event.payload.frame.origin.x = x;
+    event_loop_post(event_loop, &event);
+}
+
+//
+// NOTE(koekeishiya): Geometry events are merged per window and type, space and display changes
+// per type, and nothing else is merged. A merged event loses its payload; an event that was
+// posted while the previous one for its window was being handled is queued again.
+//
+
+static void test_coalesce(void)
+{
+    struct event_loop event_loop;
+    test_event_loop_init(&event_loop);
+
+    for (int i = 0; i < 3; ++i) test_post_frame(&event_loop, WINDOW_MOVED, 7, i);
+    test_post_frame(&event_loop, WINDOW_RESIZED, 7, 0);
+    test_post_frame(&event_loop, WINDOW_MOVED, 8, 0);
+    test_post_frame(&event_loop, WINDOW_MOVED, 0, 0);
+    test_post_frame(&event_loop, WINDOW_MOVED, 0, 0);
+
+    for (int i = 0; i < 2; ++i) {
+        struct event space = event_create(SPACE_CHANGED, NULL);
+        struct event display = event_create(DISPLAY_CHANGED, NULL);
+        struct event focused = event_create(WINDOW_FOCUSED, (void *)(uintptr_t) 7);
+        event_loop_post(&event_loop, &space);
+        event_loop_post(&event_loop, &display);
+        event_loop_post(&event_loop, &focused);
+    }
+
+    expect(event_loop.coalesce.merged[WINDOW_MOVED] == 2);
+    expect(event_loop.coalesce.merged[WINDOW_RESIZED] == 0);
+    expect(event_loop.coalesce.merged[SPACE_CHANGED] == 1);
+    expect(event_loop.coalesce.merged[DISPLAY_CHANGED] == 1);
+    expect(event_loop.coalesce.merged[WINDOW_FOCUSED] == 0);
+
+    expect(test_event_loop_drain(&event_loop) == 9);
+
+    int moved_7 = 0, moved_0 = 0, focused = 0;
+    for (int i = 0; i < g_test_handled_count; ++i) {
+        struct test_handled *handled = &g_test_handled[i];
+        if (handled->type == WINDOW_MOVED && handled->id == 7) {
+            ++moved_7;
+            expect(handled->payload == EVENT_PAYLOAD_NONE);
+        } else if (handled->type == WINDOW_MOVED && handled->id == 0) {
+            ++moved_0;
+        } else if (handled->type == WINDOW_FOCUSED) {
+            ++focused;
+        } else if (handled->type == WINDOW_MOVED || handled->type == WINDOW_RESIZED) {
+            expect(handled->payload == EVENT_PAYLOAD_FRAME);
+        }
+    }
+
+    expect(moved_7 == 1);
+    expect(moved_0 == 2);
+    expect(focused == 2);
+
+    //
+    // NOTE(koekeishiya): The slot is released before the handler runs, so a move that arrives
+    // while the handler is running is queued again, with its payload.
+    //
+
+    g_test_handled_count = 0;
+    test_post_frame(&event_loop, WINDOW_MOVED, 7, 0);
+    g_test_repost = event_create(WINDOW_MOVED, (void *)(uintptr_t) 7);
+    g_test_repost.payload.type = EVENT_PAYLOAD_FRAME;
+
+    expect(test_event_loop_drain(&event_loop) == 2);
+    expect(g_test_handled_count == 2);
+    expect(g_test_handled[1].type == WINDOW_MOVED && g_test_handled[1].payload == EVENT_PAYLOAD_FRAME);
+    expect(event_loop.coalesce.merged[WINDOW_MOVED] == 2);
+
+    //
+    // NOTE(koekeishiya): While the slot is held by one window, events of another window that
+    // hashes to the same slot are not merged at all, not even with each other.
+    //
+
+    uint32_t collision = 8;
+    while (((collision * 0x9e3779b1) >> 22) != ((7 * 0x9e3779b1) >> 22)) ++collision;
+
+    g_test_handled_count = 0;
+    test_post_frame(&event_loop, WINDOW_MOVED, 7, 0);
+    test_post_frame(&event_loop, WINDOW_MOVED, collision, 0);
+    test_post_frame(&event_loop, WINDOW_MOVED, collision, 0);
+
+    expect(test_event_loop_drain(&event_loop) == 3);
+    expect(g_test_handled[1].id == collision && g_test_handled[1].payload == EVENT_PAYLOAD_FRAME);
+    expect(g_test_handled[2].id == collision && g_test_handled[2].payload == EVENT_PAYLOAD_FRAME);
+    expect(event_loop.coalesce.merged[WINDOW_MOVED] == 2);
+
+    //
+    // NOTE(koekeishiya): A move of window 7 that was queued while the other window held the slot
+    // did not claim it, so handling it must not release the slot that a later move of window 7
+    // claimed, nor take the mark of the move that was merged into that one.
+    //
+
+    g_test_handled_count = 0;
+    test_post_frame(&event_loop, WINDOW_MOVED, collision, 0);
+    test_post_frame(&event_loop, WINDOW_MOVED, 7, 1);
+
+    struct event event;
+    expect(event_loop_pop(&event_loop, &event) && (uint32_t)(uintptr_t) event.context == collision);
+    event_loop_dispatch(&event_loop, event_loop.stats, &event_loop.scratch, &event_loop.running, &event);
+
+    test_post_frame(&event_loop, WINDOW_MOVED, 7, 2);
+    test_post_frame(&event_loop, WINDOW_MOVED, 7, 3);
+    expect(event_loop.coalesce.merged[WINDOW_MOVED] == 3);
+
+    expect(test_event_loop_drain(&event_loop) == 2);
+    expect(g_test_handled_count == 3);
+    expect(g_test_handled[1].id == 7 && g_test_handled[1].payload == EVENT_PAYLOAD_FRAME);
+    expect(g_test_handled[2].id == 7 && g_test_handled[2].payload == EVENT_PAYLOAD_NONE);
+
+    //
+    // NOTE(koekeishiya): An event sent through event_loop_post_and_wait never claims a slot.
+    //
+
+    g_test_handled_count = 0;
+    struct event waited = event_create(WINDOW_MOVED, (void *)(uintptr_t) 7);
+    waited.payload.type = EVENT_PAYLOAD_FRAME;
+    event_loop_enqueue(&event_loop, &waited);
+
+    test_post_frame(&event_loop, WINDOW_MOVED, 7, 4);
+    test_post_frame(&event_loop, WINDOW_MOVED, 7, 5);
+    expect(event_loop.coalesce.merged[WINDOW_MOVED] == 4);
+
+    expect(test_event_loop_drain(&event_loop) == 2);
+    expect(g_test_handled[0].payload == EVENT_PAYLOAD_FRAME);
+    expect(g_test_handled[1].payload == EVENT_PAYLOAD_NONE);
+}
+
+//
+// NOTE(koekeishiya): Lanes are drained in priority order and each lane in posting order, so a
+// focus change posted behind a burst of geometry updates is handled first.
+//
+
+static void test_lanes(void)
+{
+    struct event_loop event_loop;
+    test_event_loop_init(&event_loop);
+
+    for (uint32_t id = 1; id <= 1000; ++id) {
+        test_post_frame(&event_loop, WINDOW_RESIZED, id, 0);
+    }
+
+    enum event_type types[] = { WINDOW_CREATED, WINDOW_FOCUSED, WINDOW_DESTROYED, APPLICATION_FRONT_SWITCHED, WINDOW_MINIMIZED, SYSTEM_WOKE };
+    for (int i = 0; i < (int) array_count(types); ++i) {
+        struct event event = event_create(types[i], (void *)(uintptr_t)(2000 + i));
+        event_loop_post(&event_loop, &event);
+    }
+
+    test_event_loop_drain(&event_loop);
+
+    struct test_handled *handled = g_test_handled;
+    expect(handled[0].type == WINDOW_FOCUSED && handled[0].id == 2001);
+    expect(handled[1].type == APPLICATION_FRONT_SWITCHED && handled[1].id == 2003);
+    expect(handled[2].type == SYSTEM_WOKE && handled[2].id == 2005);
+    expect(handled[3].type == WINDOW_CREATED && handled[3].id == 2000);
+    expect(handled[4].type == WINDOW_DESTROYED && handled[4].id == 2002);
+    expect(handled[5].type == WINDOW_MINIMIZED && handled[5].id == 2004);
+
+    for (int i = 6; i < TEST_HANDLED_MAX; ++i) {
+        expect(handled[i].type == WINDOW_RESIZED && handled[i].id == (uint32_t) i - 5);
+    }
+
+    expect(event_loop.queue[EVENT_LANE_GEOMETRY].depth_high_water == 1000);
+    expect(event_loop.queue[EVENT_LANE_FOCUS].depth_high_water == 3);
+}
+
+//
+// NOTE(koekeishiya): Runs the event loop thread for real. The first event blocks its handler until
+// 200 more have been posted, so the loop finds them all queued once it continues. Every handler
+// must run between on_batch_begin and on_batch_end, and no batch may be larger than
+// EVENT_BATCH_MAX.
+//
+
+#define TEST_BATCH_EVENTS 200
+#define TEST_BATCH_FENCE  0xfe
+
+static volatile int g_test_batch_open;
+static volatile int g_test_batch_size;
+static volatile int g_test_batch_outside;
+static volatile int g_test_batch_nested;
+static volatile int g_test_batch_fence_entered;
+static volatile int g_test_batch_fence_open;
+static int g_test_batch[TEST_BATCH_EVENTS];
+static volatile int g_test_batch_count;
+
+static EVENT_LOOP_BATCH_CALLBACK(test_batch_begin)
+{
+    if (g_test_batch_open) ++g_test_batch_nested;
+    g_test_batch_open = 1;
+    g_test_batch_size = 0;
+}
+
+static EVENT_LOOP_BATCH_CALLBACK(test_batch_end)
+{
+    if (!g_test_batch_open) ++g_test_batch_nested;
+    g_test_batch_open = 0;
+    if (g_test_batch_count < TEST_BATCH_EVENTS) g_test_batch[g_test_batch_count++] = g_test_batch_size;
+}
+
+static STUB_HANDLER(test_batch_handler)
+{
+    if (!g_test_batch_open) ++g_test_batch_outside;
+    ++g_test_batch_size;
+
+    if ((uintptr_t) context == TEST_BATCH_FENCE) {
+        g_test_batch_fence_entered = 1;
+        while (!g_test_batch_fence_open) sched_yield();
+    }
+
+    return EVENT_SUCCESS;
+}
+
+static void test_batch(void)
+{
+    struct event_loop event_loop;
+    expect(event_loop_init(&event_loop));
+    event_loop.on_batch_begin = test_batch_begin;
+    event_loop.on_batch_end = test_batch_end;
+    g_stub_handler = test_batch_handler;
+    g_stub_handled = 0;
+    expect(event_loop_begin(&event_loop));
+
+    struct event fence = event_create(WINDOW_CREATED, (void *)(uintptr_t) TEST_BATCH_FENCE);
+    event_loop_post(&event_loop, &fence);
+    while (!g_test_batch_fence_entered) sched_yield();
+
+    for (int i = 0; i < TEST_BATCH_EVENTS; ++i) {
+        struct event event = event_create(WINDOW_CREATED, (void *)(uintptr_t)(0x100 + i));
+        event_loop_post(&event_loop, &event);
+    }
+
+    g_test_batch_fence_open = 1;
+    while (g_stub_handled < TEST_BATCH_EVENTS + 1) sched_yield();
+    while (g_test_batch_open) sched_yield();
+
+    expect(event_loop_end(&event_loop));
+
+    expect(g_test_batch_outside == 0);
+    expect(g_test_batch_nested == 0);
+    expect(g_test_batch_count == 4);
+    expect(g_test_batch[0] == EVENT_BATCH_MAX);
+    expect(g_test_batch[1] == EVENT_BATCH_MAX);
+    expect(g_test_batch[2] == EVENT_BATCH_MAX);
+    expect(g_test_batch[3] == TEST_BATCH_EVENTS + 1 - 3 * EVENT_BATCH_MAX);
+    expect(event_loop.batch_size[6] == 3);
+    expect(event_loop.batch_size[3] == 1);
+}
+
+//
+// NOTE(koekeishiya): Timers with deadlines on every level of the wheel, and beyond its range,
+// checked against a sorted reference while the wheel is advanced one tick at a time. Every timer
+// must expire on exactly its deadline tick, cancelled timers never, and the next deadline the
+// wheel reports must never be later than the earliest pending timer. A second pass inserts timers
+// while the wheel is running, so that they land in partially cascaded levels.
+//
+
+#define TEST_TIMER_COUNT 20000
+
+struct test_timer
+{
+    struct timer_node node;
+    bool pending;
+    bool fired;
+};
+
+static struct test_timer g_test_timer[TEST_TIMER_COUNT];
+static uint32_t g_test_timer_order[TEST_TIMER_COUNT];
+
+static uint64_t test_timer_delta(void)
+{
+    uint32_t bucket = test_random() % 100;
+    if (bucket < 40) return 1 + test_random() % 63;
+    if (bucket < 70) return 64 + test_random() % (4096 - 64);
+    if (bucket < 90) return 4096 + test_random() % ((1 << 18) - 4096);
+    if (bucket < 98) return (1 << 18) + test_random() % ((1 << 24) - (1 << 18));
+    return TIMER_WHEEL_RANGE + test_random() % TIMER_WHEEL_RANGE;
+}
+
+static int test_timer_compare(const void *a, const void *b)
+{
+    uint64_t da = g_test_timer[*(const uint32_t *) a].node.deadline;
+    uint64_t db = g_test_timer[*(const uint32_t *) b].node.deadline;
+    return da < db ? -1 : da > db;
+}
+
+static void test_timer_expire(struct timer_wheel *wheel, uint64_t now, uint64_t *fired, uint64_t *wrong)
+{
+    struct timer_node *node;
+    while ((node = timer_wheel_pop_expired(wheel))) {
+        struct test_timer *timer = (struct test_timer *) node;
+        if (!timer->pending || timer->node.deadline != now) ++*wrong;
+        timer->pending = false;
+        timer->fired = true;
+        ++*fired;
+    }
+}
+
+static void test_timer_wheel(void)
+{
+    struct timer_wheel wheel;
+    uint64_t start = 1000003;
+    timer_wheel_init(&wheel, start);
+
+    uint64_t end = start;
+    for (int i = 0; i < TEST_TIMER_COUNT; ++i) {
+        g_test_timer[i] = (struct test_timer) { .pending = true };
+        timer_wheel_insert(&wheel, &g_test_timer[i].node, start + test_timer_delta());
+        if (g_test_timer[i].node.deadline > end) end = g_test_timer[i].node.deadline;
+        g_test_timer_order[i] = i;
+    }
+
+    qsort(g_test_timer_order, TEST_TIMER_COUNT, sizeof(uint32_t), test_timer_compare);
+
+    int cancelled = 0;
+    for (int i = 0; i < TEST_TIMER_COUNT / 10; ++i) {
+        struct test_timer *timer = &g_test_timer[test_random() % TEST_TIMER_COUNT];
+        if (!timer->pending) continue;
+        timer_wheel_remove(&wheel, &timer->node);
+        timer->pending = false;
+        ++cancelled;
+    }
+
+    uint64_t fired = 0;
+    uint64_t wrong = 0;
+    uint64_t late_deadline = 0;
+    int next = 0;
+
+    for (uint64_t now = start + 1; now <= end; ++now) {
+        timer_wheel_advance(&wheel, now);
+        test_timer_expire(&wheel, now, &fired, &wrong);
+
+        if ((now & 1023) == 0) {
+            struct test_timer *timer = &g_test_timer[test_random() % TEST_TIMER_COUNT];
+            if (timer->pending) {
+                timer_wheel_remove(&wheel, &timer->node);
+                timer->pending = false;
+                ++cancelled;
+            }
+        }
+
+        if ((now % 997) == 0) {
+            while (next < TEST_TIMER_COUNT && !g_test_timer[g_test_timer_order[next]].pending) ++next;
+            uint64_t deadline = timer_wheel_next_deadline(&wheel);
+
+            if (next < TEST_TIMER_COUNT) {
+                uint64_t earliest = g_test_timer[g_test_timer_order[next]].node.deadline;
+                if (deadline > earliest || deadline <= now) ++late_deadline;
+            } else if (deadline != UINT64_MAX) {
+                ++late_deadline;
+            }
+        }
+    }
+
+    expect(wrong == 0);
+    expect(late_deadline == 0);
+    expect(fired + cancelled == TEST_TIMER_COUNT);
+    expect(wheel.count == 0);
+    expect(timer_wheel_next_deadline(&wheel) == UINT64_MAX);
+
+    //
+    // NOTE(koekeishiya): Inserting while the wheel runs, one timer every few ticks.
+    //
+
+    int inserted = 0;
+    fired = 0;
+    end = wheel.now + 4 * TEST_TIMER_COUNT + (1 << 21);
+
+    for (uint64_t now = wheel.now + 1; (inserted < TEST_TIMER_COUNT || wheel.count) && now < end; ++now) {
+        if (inserted < TEST_TIMER_COUNT && (test_random() % 4) == 0) {
+            struct test_timer *timer = &g_test_timer[inserted++];
+            *timer = (struct test_timer) { .pending = true };
+            uint64_t delta = test_timer_delta();
+            if (delta > (1 << 20)) delta = 1 + delta % (1 << 20);
+            timer_wheel_insert(&wheel, &timer->node, now - 1 + delta);
+        }
+
+        timer_wheel_advance(&wheel, now);
+        test_timer_expire(&wheel, now, &fired, &wrong);
+    }
+
+    expect(wrong == 0);
+    expect(fired == TEST_TIMER_COUNT);
+}
+
+//
+// NOTE(koekeishiya): Timer ids carry a generation, so a cancel with the id of a timer that has
+// already fired or been cancelled fails, even after the timer has been reused. A cancelled event
+// is destroyed without being handled.
+//
+
+static void test_timer_cancel(void)
+{
+    struct event_loop event_loop;
+    test_event_loop_init(&event_loop);
+    g_stub_handled = 0;
+
+    uint64_t now = event_loop.timer_wheel.now;
+    struct event event = event_create(SYSTEM_WOKE, (void *)(uintptr_t) 1);
+
+    uint64_t first = event_loop_timer_schedule(&event_loop, &event, (now + 5) * EVENT_TIMER_TICK_NS);
+    expect(first != 0);
+    expect(event_loop_cancel(&event_loop, first));
+    expect(g_stub_handled == 1);
+    expect(!event_loop_cancel(&event_loop, first));
+
+    event.context = (void *)(uintptr_t) 2;
+    uint64_t second = event_loop_timer_schedule(&event_loop, &event, (now + 5) * EVENT_TIMER_TICK_NS);
+    expect((uint32_t) second == (uint32_t) first);
+    expect(second != first);
+    expect(!event_loop_cancel(&event_loop, first));
+
+    event.context = (void *)(uintptr_t) 3;
+    uint64_t third = event_loop_timer_schedule(&event_loop, &event, (now + 3) * EVENT_TIMER_TICK_NS + 1);
+
+    timer_wheel_advance(&event_loop.timer_wheel, now + 3);
+    expect(test_event_loop_drain(&event_loop) == 0);
+
+    timer_wheel_advance(&event_loop.timer_wheel, now + 4);
+    expect(test_event_loop_drain(&event_loop) == 1);
+    expect(g_test_handled_count == 1 && g_test_handled[0].id == 3);
+    expect(!event_loop_cancel(&event_loop, third));
+
+    timer_wheel_advance(&event_loop.timer_wheel, now + 5);
+    expect(test_event_loop_drain(&event_loop) == 1);
+    expect(g_test_handled_count == 2 && g_test_handled[1].id == 2);
+    expect(!event_loop_cancel(&event_loop, second));
+
+    expect(!event_loop_cancel(&event_loop, 0));
+    expect(!event_loop_cancel(&event_loop, ((uint64_t) 1 << 32) | 100000));
+    expect(g_stub_handled == 3);
+    expect(event_loop.timer_wheel.count == 0);
+}
+
+//
+// NOTE(koekeishiya): event_loop_post_and_wait returns the info word the handler left behind,
+// for events handled by the event loop thread as well as by a worker, to several waiting threads
+// at once. A timed wait gives up while the handler is still blocked, and the event is handled
+// afterwards all the same; the abandoned info word is then freed by the event loop. A waiter may
+// return before the event is destroyed, so handled events are counted once the loop has ended.
+//
+
+#define TEST_WAIT_THREADS 4
+#define TEST_WAIT_ROUNDS  2000
+#define TEST_WAIT_GATE    0xffff
+
+struct test_waiter
+{
+    pthread_t thread;
+    struct event_loop *event_loop;
+    int index;
+    int wrong;
+};
+
+static volatile int g_test_wait_gate_open;
+
+static STUB_HANDLER(test_wait_handler)
+{
+    uint32_t value = (uint32_t)(uintptr_t) context;
+    if (value != TEST_WAIT_GATE) return value & 0xff;
+
+    while (!g_test_wait_gate_open) usleep(100);
+    return EVENT_SUCCESS;
+}
+
+static void *test_wait_post(void *context)
+{
+    struct test_waiter *waiter = context;
+
+    for (int i = 0; i < TEST_WAIT_ROUNDS; ++i) {
+        uint32_t value = (uint32_t)(waiter->index * TEST_WAIT_ROUNDS + i + 1);
+        enum event_type type = i % 2 ? WINDOW_MOVED : WINDOW_CREATED;
+        struct event event = event_create(type, (void *)(uintptr_t) value);
+
+        uint32_t info = event_loop_post_and_wait(waiter->event_loop, &event, 0);
+        if (info != (((value & 0xff) << 0x1) | EVENT_PROCESSED)) ++waiter->wrong;
+    }
+
+    return NULL;
+}
+
+static void test_post_and_wait(void)
+{
+    struct event_loop event_loop;
+    expect(event_loop_init(&event_loop));
+    event_loop.worker_count = 2;
+    g_stub_handler = test_wait_handler;
+    g_stub_handled = 0;
+    expect(event_loop_begin(&event_loop));
+
+    struct test_waiter waiter[TEST_WAIT_THREADS];
+    for (int i = 0; i < TEST_WAIT_THREADS; ++i) {
+        waiter[i] = (struct test_waiter) { .event_loop = &event_loop, .index = i };
+        pthread_create(&waiter[i].thread, NULL, test_wait_post, &waiter[i]);
+    }
+
+    for (int i = 0; i < TEST_WAIT_THREADS; ++i) {
+        pthread_join(waiter[i].thread, NULL);
+        expect(waiter[i].wrong == 0);
+    }
+
+    expect(event_loop_end(&event_loop));
+    expect(g_stub_handled == TEST_WAIT_THREADS * TEST_WAIT_ROUNDS);
+}
+
+static void test_post_and_wait_timeout(void)
+{
+    struct event_loop event_loop;
+    expect(event_loop_init(&event_loop));
+    g_stub_handler = test_wait_handler;
+    g_stub_handled = 0;
+    g_test_wait_gate_open = 0;
+    expect(event_loop_begin(&event_loop));
+
+    struct event event = event_create(WINDOW_CREATED, (void *)(uintptr_t) 3);
+    expect(event_loop_post_and_wait(&event_loop, &event, 1000) == ((3 << 0x1) | EVENT_PROCESSED));
+
+    uint64_t begin = time_monotonic_ns();
+    event = event_create(WINDOW_CREATED, (void *)(uintptr_t) TEST_WAIT_GATE);
+    expect(event_loop_post_and_wait(&event_loop, &event, 20) == EVENT_ABANDONED);
+    expect(time_monotonic_ns() - begin >= 20 * 1000000ULL);
+    expect(g_stub_handled == 1);
+
+    g_test_wait_gate_open = 1;
+    event = event_create(WINDOW_CREATED, (void *)(uintptr_t) 4);
+    expect(event_loop_post_and_wait(&event_loop, &event, 1000) == ((4 << 0x1) | EVENT_PROCESSED));
+
+    expect(event_loop_end(&event_loop));
+    expect(g_stub_handled == 3);
+}
+
+//
+// NOTE(koekeishiya): A handler on the event loop thread floods a worker that is stuck in its first
+// event. The event loop keeps what does not fit in the worker ring in its backlog instead of
+// waiting for room, so it still answers; once the worker moves again every event is handled, in
+// the order it was posted.
+//
+
+#define TEST_BACKLOG_EVENTS (EVENT_QUEUE_SIZE + 100)
+
+static volatile int g_test_backlog_gate_open;
+static uint32_t g_test_backlog_expected;
+static int g_test_backlog_wrong;
+
+static STUB_HANDLER(test_backlog_handler)
+{
+    if (type == WINDOW_CREATED) {
+        for (uint32_t id = 1; id <= TEST_BACKLOG_EVENTS; ++id) {
+            struct event event = event_create(WINDOW_MOVED, (void *)(uintptr_t) id);
+            event_loop_post(g_test_event_loop, &event);
+        }
+        return EVENT_SUCCESS;
+    }
+
+    if (type != WINDOW_MOVED) return EVENT_SUCCESS;
+
+    uint32_t id = (uint32_t)(uintptr_t) context;
+    if (id != g_test_backlog_expected++) ++g_test_backlog_wrong;
+    while (!g_test_backlog_gate_open) usleep(100);
+    return EVENT_SUCCESS;
+}
+
+static void test_worker_backlog(void)
+{
+    struct event_loop event_loop;
+    expect(event_loop_init(&event_loop));
+    event_loop.worker_count = 1;
+    g_test_event_loop = &event_loop;
+    g_stub_handler = test_backlog_handler;
+    g_stub_handled = 0;
+    g_test_backlog_gate_open = 0;
+    g_test_backlog_expected = 1;
+    g_test_backlog_wrong = 0;
+    expect(event_loop_begin(&event_loop));
+
+    struct event event = event_create(WINDOW_CREATED, NULL);
+    expect(event_loop_post_and_wait(&event_loop, &event, 1000) == ((EVENT_SUCCESS << 0x1) | EVENT_PROCESSED));
+    expect(event_loop.worker[0].backlog_count > 0);
+    expect(event_loop.worker[0].queue.overflow > 0);
+
+    event = event_create(WINDOW_FOCUSED, NULL);
+    expect(event_loop_post_and_wait(&event_loop, &event, 1000) == ((EVENT_SUCCESS << 0x1) | EVENT_PROCESSED));
+
+    g_test_backlog_gate_open = 1;
+    for (int i = 0; i < 1000 && g_stub_handled < TEST_BACKLOG_EVENTS + 2; ++i) usleep(1000);
+
+    expect(g_stub_handled == TEST_BACKLOG_EVENTS + 2);
+    expect(g_test_backlog_expected == TEST_BACKLOG_EVENTS + 1);
+    expect(g_test_backlog_wrong == 0);
+    expect(event_loop.worker[0].backlog_count == 0);
+    expect(event_loop_end(&event_loop));
+}
+
+//
+// NOTE(koekeishiya): An idle watchdog waits without a timeout, so it only notices a stalled
+// handler because the thread that started the handler woke it up. Stalls of more applications
+// than there are slots for are counted in stall_pid_overflow. The stall report is written to
+// stderr, which is silenced while the handler stalls.
+//
+
+#define TEST_WATCHDOG_BUDGET_MS 10
+
+static int test_wait_for(volatile uint32_t *value, uint32_t expected)
+{
+    for (int i = 0; i < 1000 && *value != expected; ++i) usleep(1000);
+    return *value == expected;
+}
+
+static STUB_HANDLER(test_watchdog_handler)
+{
+    uint64_t end = time_monotonic_ns() + 6 * TEST_WATCHDOG_BUDGET_MS * 1000000ULL;
+    while (time_monotonic_ns() < end) usleep(1000);
+    return EVENT_SUCCESS;
+}
+
+static void test_watchdog(void)
+{
+    struct event_loop event_loop;
+    expect(event_loop_init(&event_loop));
+    g_stub_handler = test_watchdog_handler;
+    g_stub_handled = 0;
+    expect(event_loop_begin(&event_loop));
+    event_loop_set_watchdog_budget(&event_loop, TEST_WATCHDOG_BUDGET_MS);
+
+    expect(test_wait_for(&event_loop.watchdog_idle, 1));
+
+    fflush(stderr);
+    int saved_stderr = dup(STDERR_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDERR_FILENO);
+
+    struct event event = event_create(WINDOW_CREATED, (void *)(uintptr_t) 1);
+    event_loop_post(&event_loop, &event);
+    while (g_stub_handled < 1) sched_yield();
+
+    fflush(stderr);
+    dup2(saved_stderr, STDERR_FILENO);
+    close(saved_stderr);
+    close(null_fd);
+
+    expect(event_loop.stall_count == 1);
+    expect(event_loop.stall_type[WINDOW_CREATED] == 1);
+    expect(test_wait_for(&event_loop.watchdog_idle, 1));
+    expect(event_loop_end(&event_loop));
+
+    for (int pid = 1; pid <= EVENT_WATCHDOG_PID_MAX + 3; ++pid) {
+        event_loop_record_stall(&event_loop, WINDOW_CREATED, pid);
+    }
+    event_loop_record_stall(&event_loop, WINDOW_CREATED, 1);
+    event_loop_record_stall(&event_loop, WINDOW_CREATED, EVENT_WATCHDOG_PID_MAX + 1);
+
+    expect(event_loop.stall_pid_count == EVENT_WATCHDOG_PID_MAX);
+    expect(event_loop.stall[0].pid == 1 && event_loop.stall[0].count == 2);
+    expect(event_loop.stall_pid_overflow == 4);
+    expect(event_loop.stall_count == 1 + EVENT_WATCHDOG_PID_MAX + 5);
+}
+
+struct test
+{
+    const char *name;
+    void (*run)(void);
+};
+
+static struct test tests[] =
+{
+    { "table-rehash",          test_table_rehash          },
+    { "table-rehash-wrap",     test_table_rehash_wrap     },
+    { "table-foreach",         test_table_foreach         },
+    { "slab",                  test_slab                  },
+    { "arena",                 test_arena                 },
+    { "ring-producers",        test_ring_producers        },
+    { "ring-spill",            test_ring_spill            },
+    { "eventcount-handoff",    test_eventcount_handoff    },
+    { "coalesce",              test_coalesce              },
+    { "lanes",                 test_lanes                 },
+    { "batch",                 test_batch                 },
+    { "timer-wheel",           test_timer_wheel           },
+    { "timer-cancel",          test_timer_cancel          },
+    { "post-and-wait",         test_post_and_wait         },
+    { "post-and-wait-timeout", test_post_and_wait_timeout },
+    { "worker-backlog",        test_worker_backlog        },
+    { "watchdog",              test_watchdog              },
+};
+
+int main(int argc, char **argv)
+{
+    bool found = false;
+    for (int i = 0; i < (int) array_count(tests); ++i) {
+        if (argc > 1 && strcmp(argv[1], tests[i].name) != 0) continue;
+
+        int failures = g_failures;
+        uint64_t begin = time_monotonic_ns();
+
+        g_test = tests[i].name;
+        g_seed = 0x9e3779b97f4a7c15ULL;
+        tests[i].run();
+
+        printf("%-24s %s  %8.1f ms\n", tests[i].name, g_failures == failures ? "ok  " : "FAIL", (time_monotonic_ns() - begin) / 1e6);
+        found = true;
+    }
+
+    if (!found) {
+        fprintf(stderr, "usage: limelight-test [test]\ntests:");
+        for (int i = 0; i < (int) array_count(tests); ++i) fprintf(stderr, " %s", tests[i].name);
+        fprintf(stderr, "\n");
+        return 1;
+    }
+
+    return g_failures ? 1 : 0;
+}
@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "../src/misc/trace.h"
+
+//
+// NOTE(koekeishiya): Decoder for the files written by 'limelight -m query trace <path>'.
+// Records from all threads are merged and printed in timestamp order, relative to the first
+// record. This file only depends on the C standard library, so it builds on Linux as well.
+//
+
+static uint16_t swap16(uint16_t v) { return (uint16_t)((v >> 8) | (v << 8)); }
+static uint32_t swap32(uint32_t v) { return __builtin_bswap32(v); }
+static uint64_t swap64(uint64_t v) { return __builtin_bswap64(v); }
+
+static int record_compare(const void *a, const void *b)
+{
+    const struct trace_record *ra = a;
+    const struct trace_record *rb = b;
+    if (ra->timestamp != rb->timestamp) return ra->timestamp < rb->timestamp ? -1 : 1;
+    return ra->kind - rb->kind;
+}
+
+static const char *kind_str(uint8_t kind)
+{
+    switch (kind) {
+    case TRACE_POSTED:  return "posted";
+    case TRACE_HANDLED: return "handled";
+    default:            return "unknown";
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <trace-file>\n", argv[0]);
+        return 1;
+    }
+
+    FILE *file = fopen(argv[1], "rb");
+    if (!file) {
+        fprintf(stderr, "could not open '%s'\n", argv[1]);
+        return 1;
+    }
+
+    struct trace_header header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0) {
+        fprintf(stderr, "'%s' is not a limelight trace\n", argv[1]);
+        return 1;
+    }
+
+    bool swap = header.byte_order != TRACE_BYTE_ORDER;
+    if (swap) {
+        header.version = swap32(header.version);
+        header.record_size = swap32(header.record_size);
+        header.name_count = swap32(header.name_count);
+        header.record_count = swap64(header.record_count);
+    }
+
+    if (header.version != TRACE_VERSION || header.record_size != sizeof(struct trace_record)) {
+        fprintf(stderr, "unsupported trace version %u (record size %u)\n", header.version, header.record_size);
+        return 1;
+    }
+
+    char (*names)[TRACE_NAME_LENGTH] = malloc((size_t) header.name_count * TRACE_NAME_LENGTH + 1);
+    struct trace_record *records = malloc(header.record_count * sizeof(struct trace_record) + 1);
+    if (!names || !records) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    if (fread(names, TRACE_NAME_LENGTH, header.name_count, file) != header.name_count ||
+        fread(records, sizeof(struct trace_record), header.record_count, file) != header.record_count) {
+        fprintf(stderr, "'%s' is truncated\n", argv[1]);
+        return 1;
+    }
+
+    fclose(file);
+
+    for (uint64_t i = 0; i < header.record_count; ++i) {
+        struct trace_record *record = &records[i];
+        if (swap) {
+            record->timestamp = swap64(record->timestamp);
+            record->duration = swap64(record->duration);
+            record->id = swap32(record->id);
+            record->thread = swap32(record->thread);
+            record->event_type = swap16(record->event_type);
+        }
+    }
+
+    qsort(records, header.record_count, sizeof(struct trace_record), record_compare);
+
+    uint64_t base = header.record_count ? records[0].timestamp : 0;
+    for (uint64_t i = 0; i < header.record_count; ++i) {
+        struct trace_record *record = &records[i];
+        const char *name = record->event_type < header.name_count ? names[record->event_type] : "event_type_unknown";
+
+        printf("%14.6f ms  thread %-2u  %-8s %-32.*s id %-8u", (record->timestamp - base) / 1e6, record->thread, kind_str(record->kind), TRACE_NAME_LENGTH, name, record->id);
+        if (record->kind == TRACE_HANDLED) {
+            printf("  result %u  duration %.3f us", record->result, record->duration / 1e3);
+        }
+        printf("\n");
+    }
+
+    free(records);
+    free(names);
+    return 0;
+}